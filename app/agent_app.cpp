@@ -1,7 +1,25 @@
-#include "agent/agent.hpp"
-#include <iostream>
-
-int main(){
-  int result = agent::add_one(1);
-  std::cout << "1 + 1 = " << result << std::endl;
+#include "agent/agent.hpp"
+#include "agent/Logging.hpp"
+#include <fstream>
+#include <iostream>
+#include <json/json.h>
+
+int main(int argc, char** argv){
+  // Logging is set up from the configuration before anything makes a logger
+  if (argc > 1)
+  {
+    Json::Value config;
+    Json::CharReaderBuilder builder;
+    Json::String errs;
+    std::ifstream file(argv[1]);
+    if (!Json::parseFromStream(builder, file, &config, &errs))
+    {
+      std::cerr << "Could not read " << argv[1] << ": " << errs << std::endl;
+      return 1;
+    }
+    agent::ConfigureLogging(config);
+  }
+
+  int result = agent::add_one(1);
+  std::cout << "1 + 1 = " << result << std::endl;
 }
\ No newline at end of file
@@ -43,7 +43,7 @@ int main()
         }
     );
     auto message = agent::Messages::CreateMessage(builder, 0, 3, 3, pixels);
-    builder.Finish(message);
+    agent::Messages::FinishMessageBuffer(builder, message);
 
     auto buffer = builder.GetBufferPointer();
     auto size = builder.GetSize();
@@ -8,11 +8,15 @@
  * override ProcessMessage to deserialize the message and operate on its data.
  *
  * Here the "work" is a trivial image operation: we sum all of the pixel values
- * of the incoming image and log the brightness. Swap this out for OpenCV calls,
- * a neural-network inference, a database write, or anything else you need.
+ * of the incoming image and log the brightness, using the vectorized kernels in
+ * agent/Kernels.hpp, which read the pixels straight out of the message. Swap
+ * this out for OpenCV calls, a neural-network inference, a database write, or
+ * anything else you need.
  */
 
 #include "agent/IWorker.hpp"
+#include "agent/ImageMessage.hpp"
+#include "agent/Kernels.hpp"
 #include "agent/agent_config.hpp"
 #include "Message_generated.h"
 
@@ -54,24 +58,18 @@ namespace
             const int id = message->id();
             const int width = message->width();
             const int height = message->height();
-            const auto* pixels = message->pixels();
 
-            // Step 2: do some real work on the data. Here we sum the pixels.
-            long long brightness = 0;
-            if (pixels != nullptr)
-            {
-                for (auto value : *pixels)
-                {
-                    brightness += value;
-                }
-            }
+            // Step 2: do some real work on the data. Here we sum the pixels,
+            // without copying them out of the message.
+            const auto image = agent::ImageMessage(message).View();
+            const long long brightness = static_cast<long long>(agent::kernels::Sum(image));
 
             _logger->info(
                 "Processed image id={} ({}x{}) total brightness={}",
                 id, width, height, brightness);
 
             // Step 3 (optional): hand a result back to the caller.
-            if (result != nullptr && rsize != nullptr)
+            if (result != nullptr && rsize != nullptr && ResultCapacity() >= sizeof(brightness))
             {
                 *static_cast<long long*>(result) = brightness;
                 *rsize = static_cast<std::uint32_t>(sizeof(brightness));
@@ -107,7 +105,7 @@ int main()
             }
         );
         auto message = agent::Messages::CreateMessage(builder, id, 3, 3, pixels);
-        builder.Finish(message);
+        agent::Messages::FinishMessageBuffer(builder, message);
 
         // Copy the serialized bytes so they outlive the builder reuse.
         const std::uint8_t* data = builder.GetBufferPointer();
@@ -59,7 +59,7 @@ int main()
         }
     );
     auto message = agent::Messages::CreateMessage(builder, 1, 3, 3, pixels);
-    builder.Finish(message);
+    agent::Messages::FinishMessageBuffer(builder, message);
 
     std::vector<std::uint8_t> payload(
         builder.GetBufferPointer(),
@@ -0,0 +1,351 @@
+#pragma once
+
+#include "IConnectionHandler.hpp"
+#include "Logging.hpp"
+#include "IWorker.hpp"
+#include "SymbolMaps.hpp"
+#include "BufferPool.hpp"
+#include "MessageAssembler.hpp"
+#include "IStreamHandler.hpp"
+#include "StreamDispatcher.hpp"
+#include "ConfirmTracker.hpp"
+#include "ChannelPool.hpp"
+#include "QueueBinding.hpp"
+#include "RetryPolicy.hpp"
+#include "WorkItem.hpp"
+#include "RpcClient.hpp"
+#include "DedupCache.hpp"
+#include "ChunkAssembler.hpp"
+#include "ClaimStore.hpp"
+#include "Codec.hpp"
+#include "BuilderPool.hpp"
+#include "Metrics.hpp"
+#include "MetricsServer.hpp"
+#include "Tracer.hpp"
+
+#include <map>
+#include <set>
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <utility>
+
+#include <amqpcpp.h>
+#include <flatbuffers/flatbuffers.h>
+#include <json/json.h>
+#include <spdlog/spdlog.h>
+
+namespace agent
+{
+	/**
+	 * @brief What an AMQP worker does on top of its connection handler
+	 *
+	 * Consuming, settling and publishing, written once over the handler:
+	 * @c IAMQPWorker runs it over a plain @c IConnectionHandler and
+	 * @c IAMQPWorkerSSL over an @c IConnectionHandlerSSL . The members are
+	 * defined in AMQPWorkerBase.cpp and instantiated for those two only.
+	 *
+	 * @tparam Handler Connection handler, @c IConnectionHandler or a subclass of it
+	 */
+	template <class Handler>
+	class AMQPWorkerBase : public Handler
+	{
+	public:
+		using Handler::GetId;
+		using Handler::GetName;
+		using Handler::Run;
+		using Handler::Post;
+		using Handler::SetMetrics;
+		using Handler::SetTracer;
+		using Handler::SetReconnectBackoff;
+
+		virtual ~AMQPWorkerBase();
+
+		/**
+		 * @brief Create the queues and exchanges and bind them, each binding
+		 * on its own channel
+		 * 
+		 */
+		void InitializeQueue();
+
+		/**
+		 * @brief Set the consumer callbacks, one consumer per binding
+		 * 
+		 */
+		void SetConsumerCallbacks();
+
+		/**
+		 * @brief Overridden version of @c AddMessage from @c IWorker which,
+		 * instead of adding to the local @c std::deque of message, adds the
+		 * message to the AMQP queue
+		 * 
+		 * The message is copied and published from the IO thread, and kept
+		 * until the broker confirms it; if the connection drops first it is
+		 * published again after reconnecting.
+		 * 
+		 * @param _msg Raw message content serialized
+		 * @param _size Number of bytes contained in the message
+		 * @param _exchange Exchange to send to
+		 * @param _key Key associated with message
+		 */
+		void AddMessage(const void* _msg, std::uint32_t _size, std::string _exchange = "", std::string _key = "");
+
+		/**
+		 * @brief Publishes a message straight from the memory it was built in
+		 * 
+		 * Takes the message over instead of copying it; its block is kept
+		 * until the broker confirms it and then goes back to its pool. Bodies
+		 * which are compressed, chunked or claim-checked are copied on the
+		 * way as before, and released early.
+		 * 
+		 * @param _msg Message released from a builder, e.g. one from @c Builders()
+		 * @param _exchange Exchange to send to
+		 * @param _key Key associated with message
+		 */
+		void AddMessage(flatbuffers::DetachedBuffer&& _msg, std::string _exchange = "", std::string _key = "");
+
+		/**
+		 * @brief Gets the builders for messages to publish
+		 * 
+		 * One per calling thread, using the connection's buffer pool for
+		 * their memory; see @c BuilderPool .
+		 * 
+		 * @return BuilderPool& The builders
+		 */
+		BuilderPool& Builders();
+
+		/**
+		 * @brief Sends a request and calls back with its reply
+		 * 
+		 * Replies come back over RabbitMQ's direct reply-to, so there is no
+		 * reply queue to declare, and any number of calls can be outstanding
+		 * at once. The callback runs on the IO thread; keep it short.
+		 * 
+		 * @param _msg Raw request content serialized
+		 * @param _size Number of bytes contained in the request
+		 * @param _exchange Exchange to send to
+		 * @param _key Key associated with the request
+		 * @param _callback Told the reply, or that none came in time
+		 * @param _timeout How long to wait for the reply
+		 */
+		void Call(const void* _msg, std::uint32_t _size, std::string _exchange, std::string _key, RpcClient::Callback _callback, std::chrono::milliseconds _timeout = std::chrono::milliseconds(AGENT_RPC_TIMEOUT_MSEC));
+
+		/**
+		 * @brief Gets the cache of processed messages
+		 * 
+		 * Set up by the @c dedup section of the configuration; its hit and
+		 * miss counters tell how many duplicates were skipped.
+		 * 
+		 * @return const DedupCache* The cache, or null if deduplication is off
+		 */
+		const DedupCache* GetDedupCache() const;
+
+		/**
+		 * @brief Gets the codecs bodies can be compressed with
+		 * 
+		 * Register custom codecs here before publishing; which one each
+		 * exchange uses comes from the @c compression section of the
+		 * configuration. Received bodies are decompressed with whichever
+		 * codec their content encoding names.
+		 * 
+		 * @return CodecRegistry& The codecs
+		 */
+		CodecRegistry& Codecs();
+
+		/**
+		 * @brief Switch to streaming delivery of message bodies
+		 * 
+		 * From the next message on, bodies are no longer collected and passed
+		 * to @c _worker but fed frame by frame to @c _handler on a dedicated
+		 * thread. Each is acked once @c OnEnd returns, or rejected if it
+		 * failed. Can only be set once; messages already queued are
+		 * unaffected.
+		 * 
+		 * @param _handler Handler to stream bodies to; must outlive this worker
+		 * @param _binding Which binding's messages to stream
+		 */
+		void SetStreamHandler(IStreamHandler* _handler, std::size_t _binding = 0);
+
+		/**
+		 * @brief Worker that runs a single message
+		 * 
+		 * The worker can be run with any number of threads, the idea being that
+		 * if you set the AMQP prefetch within QOS settings to something greater
+		 * than one you should be able to pull in multiple messages at once
+		 * which can then be processed using your @c IWorker .
+		 */
+		IWorker *_worker; ///< Pointer to an IWorker that knows how to process a single message
+
+	protected:
+		using Handler::_logSampler;
+		using Handler::_tracer;
+
+		std::shared_ptr<spdlog::logger> _logger; ///< Exposing the logger for subclasses
+
+		/**
+		 * @brief Construct a new AMQPWorkerBase object, not yet started
+		 *
+		 * @param _iworker Pointer to the worker who knows how to process a message
+		 * @param __creds AMQP login
+		 * @param __vhost AMQP virtual host to use
+		 * @param __bindings Queues to consume, one channel each
+		 * @param __messagePool Pool backing message bodies, in and out
+		 * @param _handlerArgs Arguments of the @c Handler constructor
+		 */
+		template <class... HandlerArgs>
+		AMQPWorkerBase(
+			IWorker *_iworker,
+			AMQP::Login __creds,
+			std::string __vhost,
+			std::vector<QueueBinding> __bindings,
+			std::shared_ptr<BufferPool> __messagePool,
+			HandlerArgs&&... _handlerArgs)
+			: Handler(std::forward<HandlerArgs>(_handlerArgs)...),
+			  _worker(_iworker),
+			  _logger(GetLogger(GetName())),
+			  _creds(std::move(__creds)),
+			  _vhost(std::move(__vhost)),
+			  _connection(std::make_unique<AMQP::Connection>(this, _creds, _vhost)),
+			  _bindings(std::move(__bindings)),
+			  _messagePool(std::move(__messagePool)),
+			  _builders(_messagePool),
+			  _channels(GetName())
+		{}
+
+		/**
+		 * @brief Reads the optional sections of a configuration
+		 *
+		 * Retries, replies, memoization, deduplication, reconnects, chunking,
+		 * compression, claim checks, tracing and metrics; call before
+		 * @c _start .
+		 *
+		 * @param _config The whole configuration
+		 */
+		void _configure(const Json::Value &_config);
+
+		/**
+		 * @brief Opens the channels, declares and consumes the queues and starts the IO thread
+		 *
+		 */
+		void _start();
+
+	private:
+		AMQP::Login _creds; ///< Login credentials for AMQP connection
+		std::string _vhost; ///< Virtual host, kept for reconnecting
+		
+		/**
+		 * @brief Connection variable _created_ here
+		 * 
+		 * The reason we need another @c _connection comes from the fact that
+		 * the parent class @c ConnectionHandler merely passes around a pointer
+		 * to the connection handler we create here; it doesn't actually make
+		 * one, only takes what you give it. It is replaced on every reconnect
+		 */
+		std::unique_ptr<AMQP::Connection> _connection;
+
+		std::vector<QueueBinding> _bindings; ///< Queues consumed, one channel each
+		const int _eventLoopFlags = 0;
+
+		/**
+		 * @brief Per-binding state of the delivery being received
+		 * 
+		 */
+		struct Delivery
+		{
+			Delivery(std::shared_ptr<BufferPool> _pool) : assembler(std::move(_pool)) {}
+
+			MessageAssembler assembler; ///< Collects the body frames of the current delivery
+			std::unique_ptr<StreamDispatcher> stream; ///< Streaming dispatcher, if one was set
+			std::atomic<StreamDispatcher*> streamTarget{nullptr}; ///< Published @c stream for the IO thread
+			StreamDispatcher* streaming = nullptr; ///< Dispatcher receiving the current delivery, if any
+			std::uint64_t bodySize = 0; ///< Body size of the current delivery
+			unsigned int attempt = 1; ///< Attempt the current delivery is on
+			std::string replyTo; ///< Reply address of the current delivery, if a request
+			std::string correlationId; ///< Correlation ID of the current delivery
+			std::string messageId; ///< Message ID of the current delivery, if any
+			ChunkInfo chunk; ///< Place of the current delivery in a larger message, if a chunk
+			char* chunkTarget = nullptr; ///< Where the current chunk's bytes go
+			std::uint64_t chunkReceived = 0; ///< Bytes of the current chunk so far
+			bool chunkQueued = false; ///< Whether the rest of the current chunk's message waits in a queue of its own
+			bool chunkLasting = false; ///< Whether that queue never expires, so is deleted once the message is settled
+			bool claimCheck = false; ///< Whether the current delivery is a claim check
+			std::string contentEncoding; ///< Codec the current delivery is compressed with, if any
+			std::uint64_t decodedSize = 0; ///< Size of the current delivery once decompressed
+			std::uint64_t traceId = 0; ///< ID the current delivery is traced under, if tracing
+			std::chrono::steady_clock::time_point arrived; ///< When the current delivery began to arrive, if tracing
+			std::set<std::uint64_t> unsettled; ///< Tags delivered on the binding's channel and not yet acked or rejected
+			std::map<std::uint64_t, std::string> spentQueues; ///< Chunk queues to delete once the tag completing their message is settled
+		};
+
+		/**
+		 * @brief Chunks of a message still being put together
+		 * 
+		 * Their acks are held until the message is settled as a whole.
+		 */
+		struct HeldChunks
+		{
+			std::size_t binding = 0; ///< Binding whose channel the chunks came on
+			std::vector<std::uint64_t> tags; ///< Tags of the chunks in so far
+			std::string queue; ///< Queue the rest are consumed from, once that has begun
+			bool lasting = false; ///< Whether @c queue is to be deleted, not left to expire
+		};
+
+		static constexpr std::size_t _publishChannel = 0; ///< Channel used by @c AddMessage
+
+		std::shared_ptr<BufferPool> _messagePool; ///< Pool backing received message bodies
+		BuilderPool _builders; ///< Builders for publishers, backed by @c _messagePool
+		std::vector<std::unique_ptr<Delivery>> _deliveries; ///< Delivery state by binding
+		ChannelPool _channels; ///< Publish channel, then one channel per binding
+		RetryPolicy _retry; ///< Retries and dead-lettering of failed messages
+		std::uint64_t _generation = 0; ///< Bumped on every disconnect; tags from older ones are stale
+		std::size_t _resultSize = AGENT_RPC_RESULT_SIZE; ///< Room given to a request's reply
+		RpcClient _rpc; ///< Outstanding calls made with @c Call
+		bool _replyConsumer = false; ///< Whether the direct reply-to consumer is set up
+		std::unique_ptr<DedupCache> _dedup; ///< Processed messages, if deduplicating
+		bool _bodyKeys = false; ///< Whether messages without an AMQP message ID are keyed by @c IWorker::MessageKey
+		std::uint64_t _chunkThreshold = AGENT_CHUNK_THRESHOLD; ///< Bodies larger than this are sent in chunks; 0 never
+		std::chrono::milliseconds _chunkTimeout{AGENT_CHUNK_TIMEOUT_MSEC}; ///< Longest wait for the next chunk of a message
+		std::unique_ptr<ChunkSplitter> _splitter; ///< Cuts large bodies into chunks
+		std::unique_ptr<ChunkAssembler> _chunks; ///< Puts chunked messages back together
+		std::unordered_map<std::string, HeldChunks> _heldChunks; ///< Unacked chunks of unfinished messages, by message ID
+		CodecRegistry _codecs; ///< Codecs bodies can be compressed with
+		CompressionPolicy _compression; ///< Which bodies are compressed, by exchange
+		std::unique_ptr<ClaimStore> _claimStore; ///< Where claim-checked payloads go, if enabled
+		std::uint64_t _claimThreshold = AGENT_CLAIM_THRESHOLD; ///< Bodies larger than this are claim-checked
+		std::uint32_t _claimCount = 1; ///< Consumers that will release each claim-checked payload
+		std::chrono::steady_clock::time_point _claimsCollected; ///< When abandoned segments were last removed
+		Histogram* _ackLatency = nullptr; ///< Time from delivery to ack, if recording metrics
+		std::unique_ptr<MetricsServer> _metricsServer; ///< Serves the metrics, if enabled in the configuration
+		Histogram* _transitLatency = nullptr; ///< Time from publication to delivery of stamped messages, if recording metrics
+		bool _stampPublished = false; ///< Whether published messages carry the time they were published
+
+		std::size_t _bindingChannel(std::size_t _binding) const;
+		void _consumeWith(AMQP::DeferredConsumer &_consumer, Delivery *_delivery, std::size_t _channel, std::size_t _binding);
+		void _ack(std::size_t _binding, std::vector<std::uint64_t> _tags);
+		void _reject(std::size_t _binding, const std::vector<std::uint64_t> &_tags);
+		void _removeSpent(std::size_t _binding, const std::vector<std::uint64_t> &_tags);
+		WorkItem::Completion _settler(std::size_t _binding, std::vector<std::uint64_t> _tags, unsigned int _attempt, std::string _replyTo, std::string _correlationId, std::string _key, std::shared_ptr<Claim> _claim);
+		bool _skipDuplicate(std::size_t _binding, const std::vector<std::uint64_t> &_tags, const std::string &_key, bool _redelivered, const std::string &_replyTo, const std::string &_correlationId);
+		bool _settle(std::size_t _binding, const std::vector<std::uint64_t> &_tags, unsigned int _attempt, std::uint64_t __generation, bool _success, Publication &&_outcome);
+		void _startReplyConsumer();
+		void _onPoll() override;
+		bool _takeChunk(std::size_t _binding, std::uint64_t _tag, Delivery &_delivery, PooledBuffer &_body, std::vector<std::uint64_t> &_tags);
+		void _dropChunks(const std::string &_id);
+		void _publishChunks(ManagedChannel &_channel, std::vector<Publication> &&_chunks, std::chrono::milliseconds _wait = std::chrono::milliseconds(0));
+		std::shared_ptr<Claim> _openClaim(const WorkItem &_item, std::string &_why);
+		void _publish(const std::shared_ptr<Publication> &_publication, const char *_data, std::size_t _size);
+		bool _compress(Publication &_publication, const char *_data, std::size_t _size);
+		bool _prepareDecode(WorkItem &_item, const std::string &_encoding, std::uint64_t _decodedSize, std::string &_why);
+		void _deadLetter(std::size_t _binding, const std::vector<std::uint64_t> &_tags, const Delivery &_delivery, const WorkItem &_item, const std::shared_ptr<Claim> &_claim, const std::string &_why);
+		std::vector<Publication> _split(const Publication &_whole, const char *_data, std::size_t _size);
+		void _onDisconnected() override;
+		void _onReconnected() override;
+		void _registerMetrics(MetricsRegistry &_registry) override;
+		void _observeTransit(const Delivery &_delivery, std::int64_t _publishedAt);
+		void _endTrace(std::uint64_t _traceId);
+	};
+}
\ No newline at end of file
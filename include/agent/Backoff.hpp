@@ -0,0 +1,56 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <chrono>
+#include <random>
+#include <cstdint>
+
+namespace agent
+{
+	/**
+	 * @brief Jittered exponential backoff for reconnect attempts
+	 *
+	 * The ceiling doubles with every attempt, from the initial delay up to
+	 * the maximum; each delay is half the ceiling plus a random amount up to
+	 * the other half. The jitter keeps a fleet of clients that lost the same
+	 * broker from coming back in lockstep.
+	 */
+	class Backoff
+	{
+	public:
+		/**
+		 * @brief Construct a new Backoff object
+		 *
+		 * @param __initial Ceiling of the first delay
+		 * @param __maximum Largest ceiling any delay can have
+		 */
+		Backoff(std::chrono::milliseconds __initial = std::chrono::milliseconds(AGENT_RECONNECT_MIN_MSEC), std::chrono::milliseconds __maximum = std::chrono::milliseconds(AGENT_RECONNECT_MAX_MSEC));
+
+		/**
+		 * @brief Gets the delay before the next attempt and counts the attempt
+		 *
+		 * @return std::chrono::milliseconds Time to wait
+		 */
+		std::chrono::milliseconds Next();
+
+		/**
+		 * @brief Starts over from the initial delay
+		 *
+		 */
+		void Reset();
+
+		/**
+		 * @brief Gets the number of attempts since the last @c Reset
+		 *
+		 * @return unsigned int Number of calls to @c Next
+		 */
+		unsigned int Attempts() const;
+
+	private:
+		std::chrono::milliseconds _initial; ///< Ceiling of the first delay
+		std::chrono::milliseconds _maximum; ///< Largest ceiling
+		unsigned int _attempts = 0; ///< Attempts since the last reset
+		std::mt19937 _rng; ///< Source of the jitter
+	};
+}
@@ -1,60 +1,147 @@
-#pragma once
-
-#include <agent/agent.hpp>
-#include <vector>
-#include <cstdint>
-
-namespace agent
-{
-	class Buffer
-	{
-	public:
-		/**
-		 * @brief Construct a new Buffer object
-		 * 
-		 * @param _size The number of bytes to allocate
-		 */
-		Buffer(std::size_t _size = AGENT_CONN_BUFFER_SIZE);
-		~Buffer() = default;
-
-		/**
-		 * @brief Write data into the buffer
-		 * 
-		 * @param _data Pointer to the data to be written
-		 * @param _size The number of bytes to be written
-		 * @return std::size_t Number of bytes actually written
-		 */
-		std::size_t Write(const char* _data, std::size_t _size);
-
-		/**
-		 * @brief Requests the number of bytes available to read
-		 * 
-		 * @return std::size_t Number of bytes available
-		 */
-		std::size_t Available() const;
-
-		/**
-		 * @brief Gets a pointer to the contents of the buffer
-		 * 
-		 * @return const char* A pointer to the contents
-		 */
-		const char* Data() const;
-
-		/**
-		 * @brief Clears the buffer
-		 * 
-		 */
-		void Drain();
-
-		/**
-		 * @brief Shifts the contents of the buffer left
-		 * 
-		 * @param _size Number of bytes by which to shift
-		 */
-		void Shift(std::size_t _size);
-
-	private:
-		std::vector<char> _data;
-		std::size_t _used;
-	};
-}
\ No newline at end of file
+#pragma once
+
+#include <agent/agent.hpp>
+#include "BufferPool.hpp"
+
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+namespace agent
+{
+	/**
+	 * @brief Byte queue built from a chain of pooled segments
+	 *
+	 * Segments are borrowed from a @c BufferPool as data is written and handed
+	 * back as soon as they have been consumed, so an idle buffer holds no
+	 * memory at all. The total number of bytes held is capped at
+	 * @c Capacity(); writes beyond the cap are refused rather than dropped,
+	 * leaving it to the caller to apply backpressure.
+	 */
+	class Buffer
+	{
+	public:
+		/**
+		 * @brief Construct a new Buffer object
+		 *
+		 * @param _capacity Maximum number of bytes the buffer may hold
+		 * @param _pool Pool to borrow segments from; a private one is created
+		 * if none is given
+		 */
+		Buffer(std::size_t _capacity = AGENT_CONN_BUFFER_SIZE, std::shared_ptr<BufferPool> _pool = nullptr);
+		~Buffer() = default;
+
+		/**
+		 * @brief Write data into the buffer
+		 *
+		 * @param _data Pointer to the data to be written
+		 * @param _size The number of bytes to be written
+		 * @return std::size_t Number of bytes actually written; less than
+		 * @c _size only when the buffer has reached @c Capacity()
+		 */
+		std::size_t Write(const char* _data, std::size_t _size);
+
+		/**
+		 * @brief Gets writable space at the end of the buffer
+		 *
+		 * Lets callers (e.g. a socket read) fill the buffer in place. The
+		 * bytes only count as written once passed to @c Commit .
+		 *
+		 * @param _size Set to the number of contiguous bytes available at the
+		 * returned pointer; zero when the buffer is full
+		 * @return char* Pointer to the writable space
+		 */
+		char* Reserve(std::size_t& _size);
+
+		/**
+		 * @brief Marks bytes filled in after @c Reserve as written
+		 *
+		 * @param _size Number of bytes written at the reserved pointer
+		 */
+		void Commit(std::size_t _size);
+
+		/**
+		 * @brief Requests the number of bytes available to read
+		 *
+		 * @return std::size_t Number of bytes available
+		 */
+		std::size_t Available() const;
+
+		/**
+		 * @brief Gets the maximum number of bytes the buffer may hold
+		 *
+		 * @return std::size_t The per-buffer cap
+		 */
+		std::size_t Capacity() const;
+
+		/**
+		 * @brief Gets the number of bytes that may still be written
+		 *
+		 * @return std::size_t @c Capacity() less @c Available()
+		 */
+		std::size_t Writable() const;
+
+		/**
+		 * @brief Gets a pointer to the contents of the buffer
+		 *
+		 * Only the first @c Contiguous() bytes are guaranteed to follow the
+		 * pointer; use @c Linearize to make more of them contiguous.
+		 *
+		 * @return const char* A pointer to the contents
+		 */
+		const char* Data() const;
+
+		/**
+		 * @brief Gets the number of readable bytes stored contiguously at @c Data()
+		 *
+		 * @return std::size_t Number of contiguous bytes
+		 */
+		std::size_t Contiguous() const;
+
+		/**
+		 * @brief Makes the first @c _size bytes contiguous
+		 *
+		 * Copies at most @c _size bytes, and only when they currently span
+		 * more than one segment.
+		 *
+		 * @param _size Number of bytes required at @c Data()
+		 * @return true If at least @c _size bytes are now contiguous
+		 */
+		bool Linearize(std::size_t _size);
+
+		/**
+		 * @brief Clears the buffer
+		 *
+		 */
+		void Drain();
+
+		/**
+		 * @brief Shifts the contents of the buffer left
+		 *
+		 * Segments which have been fully consumed go back to the pool.
+		 *
+		 * @param _size Number of bytes by which to shift
+		 */
+		void Shift(std::size_t _size);
+
+		/**
+		 * @brief Gets the number of segments currently held
+		 *
+		 * @return std::size_t Number of segments
+		 */
+		std::size_t Segments() const;
+
+	private:
+		struct Segment
+		{
+			PooledBuffer block; ///< Memory borrowed from the pool
+			std::size_t begin; ///< Offset of the first unread byte
+			std::size_t end; ///< Offset one past the last written byte
+		};
+
+		std::shared_ptr<BufferPool> _pool; ///< Where segments come from
+		std::deque<Segment> _segments; ///< Segments in write order
+		std::size_t _capacity; ///< Maximum number of bytes held
+		std::size_t _used; ///< Number of bytes held
+	};
+}
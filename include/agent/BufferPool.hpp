@@ -0,0 +1,192 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace agent
+{
+	class BufferPool;
+
+	/**
+	 * @brief Owned handle to a block of memory borrowed from a @c BufferPool
+	 *
+	 * Move-only; the block is handed back to the pool it came from when the
+	 * handle is destroyed or reset, so the memory can be reused by the next
+	 * caller without another trip to the allocator.
+	 */
+	class PooledBuffer
+	{
+	public:
+		PooledBuffer() = default;
+
+		/**
+		 * @brief Construct a new PooledBuffer object
+		 *
+		 * @param _pool Pool to which the block is returned
+		 * @param _block Pointer to the block of memory
+		 * @param _capacity Number of bytes allocated for @c _block
+		 */
+		PooledBuffer(std::shared_ptr<BufferPool> _pool, char* _block, std::size_t _capacity);
+
+		PooledBuffer(PooledBuffer&& _other) noexcept;
+		PooledBuffer& operator=(PooledBuffer&& _other) noexcept;
+		PooledBuffer(const PooledBuffer&) = delete;
+		PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+		/**
+		 * @brief Destroy the PooledBuffer object, returning the block
+		 *
+		 */
+		~PooledBuffer();
+
+		/**
+		 * @brief Gets a pointer to the start of the block
+		 *
+		 * @return char* Pointer to the block, @c nullptr if empty
+		 */
+		char* Data();
+		const char* Data() const;
+
+		/**
+		 * @brief Number of bytes in use
+		 *
+		 * @return std::size_t Bytes in use, never more than @c Capacity()
+		 */
+		std::size_t Size() const;
+
+		/**
+		 * @brief Number of bytes allocated for the block
+		 *
+		 * @return std::size_t Allocated bytes
+		 */
+		std::size_t Capacity() const;
+
+		/**
+		 * @brief Sets the number of bytes in use
+		 *
+		 * @param _size New size; clamped to @c Capacity()
+		 */
+		void Resize(std::size_t _size);
+
+		/**
+		 * @brief Returns the block to the pool early and empties the handle
+		 *
+		 */
+		void Reset();
+
+		/**
+		 * @brief Whether the handle currently owns a block
+		 *
+		 * @return true If a block is held
+		 */
+		explicit operator bool() const;
+
+	private:
+		std::shared_ptr<BufferPool> _pool; ///< Pool the block goes back to
+		char* _data = nullptr; ///< The block itself
+		std::size_t _size = 0; ///< Bytes in use
+		std::size_t _capacity = 0; ///< Bytes allocated
+	};
+
+	/**
+	 * @brief Thread-safe pool of size-classed memory blocks
+	 *
+	 * Blocks are handed out in size classes of @c SegmentSize() doubled until
+	 * the request fits, so a block released by one connection or message can
+	 * serve any later request of the same class. Idle blocks are kept up to
+	 * @c _maxIdleBytes; anything released beyond that goes straight back to
+	 * the allocator so an idle pool shrinks on its own.
+	 *
+	 * The pool must be owned by a @c std::shared_ptr because every
+	 * @c PooledBuffer keeps its pool alive until the block is returned.
+	 * Blocks start on an @c Alignment boundary, so aligned fields of a
+	 * message received into one are aligned in memory too.
+	 */
+	class BufferPool : public std::enable_shared_from_this<BufferPool>
+	{
+	public:
+		static constexpr std::size_t Alignment = 64; ///< Alignment of every block
+
+		/**
+		 * @brief Construct a new BufferPool object
+		 *
+		 * @param _segmentSize Size of the smallest size class in bytes
+		 * @param _maxIdleBytes Maximum number of idle bytes kept for reuse
+		 */
+		BufferPool(std::size_t _segmentSize = AGENT_CONN_SEGMENT_SIZE, std::size_t _maxIdleBytes = AGENT_POOL_MAX_IDLE_SIZE);
+
+		/**
+		 * @brief Destroy the BufferPool object and free all idle blocks
+		 *
+		 */
+		~BufferPool();
+
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		/**
+		 * @brief Borrow a block able to hold at least @c _size bytes
+		 *
+		 * Freshly allocated blocks are zero-filled; recycled ones are not.
+		 *
+		 * @param _size Number of bytes required
+		 * @return PooledBuffer Handle with @c Size() set to @c _size
+		 * @throw std::length_error If no size class is that large
+		 */
+		PooledBuffer Acquire(std::size_t _size);
+
+		/**
+		 * @brief Return a block to the pool
+		 *
+		 * Called by @c PooledBuffer; there should be no need to call it
+		 * directly.
+		 *
+		 * @param _block Pointer to the block
+		 * @param _capacity Allocated size of the block
+		 */
+		void Release(char* _block, std::size_t _capacity);
+
+		/**
+		 * @brief Frees a block allocated by a pool
+		 *
+		 * @param _block Pointer to the block
+		 */
+		static void Free(char* _block);
+
+		/**
+		 * @brief Free idle blocks until at most @c _keepBytes remain
+		 *
+		 * @param _keepBytes Number of idle bytes to retain
+		 * @return std::size_t Number of bytes freed
+		 */
+		std::size_t Trim(std::size_t _keepBytes = 0);
+
+		/**
+		 * @brief Gets the size of the smallest size class
+		 *
+		 * @return std::size_t Segment size in bytes
+		 */
+		std::size_t SegmentSize() const;
+
+		/**
+		 * @brief Gets the number of bytes sitting idle in the pool
+		 *
+		 * @return std::size_t Idle bytes
+		 */
+		std::size_t IdleBytes() const;
+
+	private:
+		std::size_t _classSize(std::size_t _size) const;
+
+		const std::size_t _segmentSize; ///< Smallest block handed out
+		const std::size_t _maxIdleBytes; ///< Cap on memory held while idle
+		std::size_t _idleBytes = 0; ///< Bytes currently held while idle
+		std::map<std::size_t, std::vector<char*>> _free; ///< Idle blocks by size class
+		mutable std::mutex _lock; ///< Mutex lock for @c _free and @c _idleBytes
+	};
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <flatbuffers/flatbuffers.h>
+
+#include "BufferPool.hpp"
+
+namespace agent
+{
+	/**
+	 * @brief FlatBuffers allocator drawing its memory from a @c BufferPool
+	 *
+	 * Lets a builder reuse the blocks received messages and publications go
+	 * back to, instead of a fresh heap allocation per message. Like the
+	 * builder using it, it is not thread-safe.
+	 */
+	class PoolAllocator : public flatbuffers::Allocator
+	{
+	public:
+		/**
+		 * @brief Construct a new PoolAllocator object
+		 *
+		 * @param __pool Pool to borrow blocks from; kept alive by the allocator
+		 */
+		explicit PoolAllocator(std::shared_ptr<BufferPool> __pool);
+
+		std::uint8_t* allocate(std::size_t _size) override;
+		void deallocate(std::uint8_t* _p, std::size_t _size) override;
+
+	private:
+		std::shared_ptr<BufferPool> _pool; ///< Where blocks come from
+		std::vector<PooledBuffer> _blocks; ///< Blocks handed out; two at most, while growing
+	};
+
+	class BuilderPool;
+
+	/**
+	 * @brief A builder borrowed from a @c BuilderPool
+	 *
+	 * Move-only; the builder is cleared and handed back when the lease is
+	 * destroyed, keeping its memory for the next message built on the
+	 * thread.
+	 */
+	class BuilderLease
+	{
+	public:
+		BuilderLease(BuilderLease&& _other) noexcept = default;
+		BuilderLease& operator=(BuilderLease&& _other) noexcept;
+		BuilderLease(const BuilderLease&) = delete;
+		BuilderLease& operator=(const BuilderLease&) = delete;
+
+		/**
+		 * @brief Destroy the BuilderLease object, returning the builder
+		 *
+		 */
+		~BuilderLease();
+
+		flatbuffers::FlatBufferBuilder& operator*() { return *_builder; }
+		flatbuffers::FlatBufferBuilder* operator->() { return _builder.get(); }
+
+		/**
+		 * @brief Takes the finished message out of the builder
+		 *
+		 * The message keeps the pooled block it was built in, which goes back
+		 * to the pool once the message is destroyed, e.g. when the broker has
+		 * confirmed it. The builder is left ready for the next message.
+		 *
+		 * @return flatbuffers::DetachedBuffer The message, for @c IAMQPWorker::AddMessage
+		 */
+		flatbuffers::DetachedBuffer Release();
+
+	private:
+		friend class BuilderPool;
+
+		BuilderLease(std::uint64_t __owner, std::unique_ptr<flatbuffers::FlatBufferBuilder> __builder, std::shared_ptr<BufferPool> __pool, std::size_t __initialSize, std::size_t __keepBytes);
+
+		void _return();
+
+		std::uint64_t _owner = 0; ///< Serial number of the pool leased from
+		std::unique_ptr<flatbuffers::FlatBufferBuilder> _builder; ///< The builder
+		std::shared_ptr<BufferPool> _pool; ///< Where a replacement builder's memory comes from
+		std::size_t _initialSize = 0; ///< Initial size of a replacement builder
+		std::size_t _keepBytes = 0; ///< Builders which grew larger are not kept
+	};
+
+	/**
+	 * @brief Reusable FlatBuffers builders for publishers, one per thread
+	 *
+	 * Each thread publishing through the pool keeps one builder, whose
+	 * memory comes from the pool's @c BufferPool and stays with it between
+	 * messages, so building a message costs no allocation once warm.
+	 * Finished messages can be published straight from the builder's memory
+	 * with @c BuilderLease::Release :
+	 * @code
+	 * auto builder = worker.Builders().Acquire();
+	 * Messages::FinishMessageBuffer(*builder, Messages::CreateMessage(*builder, id, width, height, pixels));
+	 * worker.AddMessage(builder.Release(), "Exchange", "Key");
+	 * @endcode
+	 */
+	class BuilderPool
+	{
+	public:
+		/**
+		 * @brief Construct a new BuilderPool object
+		 *
+		 * @param __pool Pool for the builders' memory; a private one is created if none is given
+		 * @param __initialSize First block a builder asks for
+		 * @param __keepBytes Builders which grew larger than this are dropped rather than kept
+		 */
+		BuilderPool(std::shared_ptr<BufferPool> __pool = nullptr, std::size_t __initialSize = AGENT_FB_BUFFER_SIZE, std::size_t __keepBytes = AGENT_POOL_MAX_IDLE_SIZE);
+
+		/**
+		 * @brief Borrows the calling thread's builder
+		 *
+		 * A thread holding a lease already gets a new builder; only one is
+		 * kept per thread.
+		 *
+		 * @return BuilderLease The builder, cleared
+		 */
+		BuilderLease Acquire();
+
+		/**
+		 * @brief Gets the pool the builders' memory comes from
+		 *
+		 * @return std::shared_ptr<BufferPool> The pool
+		 */
+		std::shared_ptr<BufferPool> Pool() const;
+
+	private:
+		const std::uint64_t _serial; ///< Tells this pool's builders from other pools'
+		std::shared_ptr<BufferPool> _pool; ///< Where the builders' memory comes from
+		std::size_t _initialSize; ///< First block a builder asks for
+		std::size_t _keepBytes; ///< Builders which grew larger are not kept
+	};
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "Backoff.hpp"
+#include "Topology.hpp"
+#include "ConfirmTracker.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+#include <amqpcpp.h>
+#include <spdlog/spdlog.h>
+
+namespace agent
+{
+	/**
+	 * @brief One AMQP channel with everything needed to rebuild it
+	 *
+	 * Declarations and consumers made through it are recorded, and publishes
+	 * are kept until the broker confirms them, so after a reconnect @c Open
+	 * gives back an equivalent channel and sends whatever was unconfirmed.
+	 * Messages the broker refuses go out again after a backoff, up to a
+	 * number of attempts, and are then handed to the refused handler.
+	 * Only use it from the connection's IO thread.
+	 */
+	class ManagedChannel
+	{
+	public:
+		using RefusedHandler = std::function<void(Publication&&)>;
+
+		/**
+		 * @brief Construct a new ManagedChannel object
+		 *
+		 * @param __logger Logger to report confirms and errors to
+		 * @param __maxAttempts Attempts at publishing a message the broker keeps refusing
+		 */
+		ManagedChannel(std::shared_ptr<spdlog::logger> __logger, unsigned int __maxAttempts = AGENT_PUBLISH_MAX_ATTEMPTS);
+
+		/**
+		 * @brief Opens the channel on a connection, restoring its state
+		 *
+		 * @param _connection Connection to open the channel on
+		 */
+		void Open(AMQP::Connection* _connection);
+
+		/**
+		 * @brief Forgets the channel after its connection has gone
+		 *
+		 */
+		void Drop();
+
+		/**
+		 * @brief Closes the channel with the broker
+		 *
+		 */
+		void Close();
+
+		/**
+		 * @brief Whether the channel is open
+		 *
+		 * @return true If there is a channel to use
+		 */
+		bool IsOpen() const;
+
+		/**
+		 * @brief Gets the underlying channel; only valid while open
+		 *
+		 * @return AMQP::Channel& The channel
+		 */
+		AMQP::Channel& Channel();
+
+		/**
+		 * @brief See @c Topology::DeclareExchange
+		 */
+		void DeclareExchange(const std::string& _name, AMQP::ExchangeType _type, int _flags, const AMQP::Table& _arguments = AMQP::Table());
+
+		/**
+		 * @brief See @c Topology::DeclareQueue
+		 */
+		void DeclareQueue(const std::string& _name, int _flags, const AMQP::Table& _arguments = AMQP::Table());
+
+		/**
+		 * @brief See @c Topology::BindQueue
+		 */
+		void BindQueue(const std::string& _exchange, const std::string& _queue, const std::string& _key, const AMQP::Table& _arguments = AMQP::Table());
+
+		/**
+		 * @brief See @c Topology::SetQos
+		 */
+		void SetQos(std::uint16_t _prefetch);
+
+		/**
+		 * @brief See @c Topology::Consume
+		 */
+		void Consume(const std::string& _queue, const std::string& _tag, int _flags, Topology::ConsumerSetup _setup);
+
+		/**
+		 * @brief Publishes a message, keeping it until it is confirmed
+		 *
+		 * Held for the next @c Open if the channel cannot take it now.
+		 *
+		 * @param _publication The message to publish
+		 */
+		void Publish(Publication&& _publication);
+
+		/**
+		 * @brief Gets the number of publishes not yet confirmed
+		 *
+		 * @return std::size_t Unconfirmed and held messages
+		 */
+		std::size_t Unconfirmed() const;
+
+		/**
+		 * @brief Publishes again the refused messages whose backoff is over
+		 *
+		 * @param _now The time now
+		 */
+		void Retry(ConfirmTracker::Clock::time_point _now);
+
+		/**
+		 * @brief Sets what gets the messages refused on every attempt
+		 *
+		 * They are dropped, after being logged, if there is no handler.
+		 *
+		 * @param _handler Called with each message given up on
+		 */
+		void OnRefused(RefusedHandler _handler);
+
+	private:
+		void _refuse(std::vector<Publication>&& _refused);
+
+		std::shared_ptr<spdlog::logger> _logger; ///< Where to report
+		unsigned int _maxAttempts; ///< Attempts at publishing before giving up
+		std::unique_ptr<AMQP::Channel> _channel; ///< The channel, while open
+		Topology _topology; ///< Declarations and consumers to restore
+		ConfirmTracker _confirms; ///< Publishes awaiting a broker confirm
+		Backoff _backoff; ///< Delays before publishing refused messages again
+		RefusedHandler _onRefused; ///< Gets the messages given up on
+	};
+
+	/**
+	 * @brief The channels sharing one AMQP connection
+	 *
+	 * Many channels on one connection are far cheaper than many connections,
+	 * each with its own socket, IO thread and buffers. Channels are numbered
+	 * in the order they are added.
+	 */
+	class ChannelPool
+	{
+	public:
+		/**
+		 * @brief Construct a new ChannelPool object
+		 *
+		 * @param __name Name of the logger to use
+		 */
+		ChannelPool(const std::string& __name);
+
+		/**
+		 * @brief Adds a channel
+		 *
+		 * @param _connection Connection to open it on now; none to open it later
+		 * @return std::size_t Number of the new channel
+		 */
+		std::size_t Add(AMQP::Connection* _connection = nullptr);
+
+		/**
+		 * @brief Gets a channel by number
+		 *
+		 * @param _index Number returned by @c Add
+		 * @return ManagedChannel& The channel
+		 */
+		ManagedChannel& At(std::size_t _index);
+
+		/**
+		 * @brief Gets the number of channels
+		 *
+		 * @return std::size_t Number of channels added
+		 */
+		std::size_t Size() const;
+
+		/**
+		 * @brief Opens every channel on a (new) connection
+		 *
+		 * @param _connection The connection
+		 */
+		void Open(AMQP::Connection* _connection);
+
+		/**
+		 * @brief Forgets every channel after the connection has gone
+		 *
+		 */
+		void Drop();
+
+		/**
+		 * @brief Closes every channel with the broker
+		 *
+		 */
+		void Close();
+
+		/**
+		 * @brief See @c ManagedChannel::Retry , for every channel
+		 */
+		void Retry(ConfirmTracker::Clock::time_point _now);
+
+	private:
+		std::shared_ptr<spdlog::logger> _logger; ///< Logger shared by the channels
+		std::vector<std::unique_ptr<ManagedChannel>> _channels; ///< Channels by number
+	};
+}
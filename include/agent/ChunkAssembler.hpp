@@ -0,0 +1,202 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include "BufferPool.hpp"
+#include "ConfirmTracker.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <amqpcpp.h>
+
+namespace agent
+{
+	/**
+	 * @brief Where one chunk of a split message belongs
+	 *
+	 * Carried in the chunk's application headers: @c x-chunk-id names the
+	 * whole message, @c x-chunk-seq and @c x-chunk-total number the chunks,
+	 * and @c x-chunk-offset and @c x-chunk-bytes place this chunk's bytes
+	 * in the whole. The first chunk also carries @c x-chunk-queue when the
+	 * rest wait in the message's own queue, and @c x-chunk-lasting when
+	 * that queue never expires and is for its consumer to delete.
+	 */
+	struct ChunkInfo
+	{
+		std::string id; ///< Shared by every chunk of the message; empty if not a chunk
+		std::uint32_t seq = 0; ///< Number of this chunk, from 0
+		std::uint32_t total = 0; ///< Number of chunks in the message
+		std::uint64_t offset = 0; ///< Where this chunk's bytes go in the message
+		std::uint64_t size = 0; ///< Bytes in this chunk
+		std::uint64_t bytes = 0; ///< Bytes in the whole message
+
+		/**
+		 * @brief Whether this describes a chunk at all
+		 *
+		 * @return true If the message was split
+		 */
+		bool Valid() const { return !id.empty(); }
+
+		/**
+		 * @brief Gets the queue all but the first chunk of the message are sent to
+		 *
+		 * So that the consumer given the first chunk, and no other, gets
+		 * the rest.
+		 *
+		 * @return std::string Name of the queue
+		 */
+		std::string Queue() const;
+
+		/**
+		 * @brief Reads the chunk headers of a delivery
+		 *
+		 * @param _headers Application headers of the delivery
+		 * @return ChunkInfo Its place, or an invalid one if it is whole; @c size is left to the caller
+		 */
+		static ChunkInfo FromHeaders(const AMQP::Table& _headers);
+
+		/**
+		 * @brief Writes the chunk headers for a publication
+		 *
+		 * @param _headers Application headers to add to
+		 */
+		void ToHeaders(AMQP::Table& _headers) const;
+	};
+
+	/**
+	 * @brief Cuts messages too big to send whole into chunks
+	 *
+	 * Safe to call from any thread.
+	 */
+	class ChunkSplitter
+	{
+	public:
+		/**
+		 * @brief Construct a new ChunkSplitter object
+		 *
+		 * @param __chunkSize Bytes in every chunk but the last
+		 */
+		ChunkSplitter(std::uint64_t __chunkSize = AGENT_CHUNK_SIZE);
+
+		/**
+		 * @brief Plans the chunks of a message
+		 *
+		 * @param _bytes Bytes in the whole message
+		 * @return std::vector<ChunkInfo> One per chunk, in order, under a new ID
+		 */
+		std::vector<ChunkInfo> Split(std::uint64_t _bytes);
+
+		/**
+		 * @brief Sends all but the first chunk of a message to the message's own queue
+		 *
+		 * The first chunk keeps its destination and names the queue the
+		 * rest go to through the default exchange.
+		 *
+		 * @param _chunks Publications of the chunks of one message, in order
+		 * @param _expires How long the queue may go unused before the broker
+		 * removes it; zero for never, for chunks that may wait indefinitely
+		 * @return AMQP::Table Arguments to declare the queue with
+		 */
+		static AMQP::Table Route(std::vector<Publication>& _chunks, std::chrono::milliseconds _expires);
+
+	private:
+		std::uint64_t _chunkSize; ///< Bytes in every chunk but the last
+		std::string _prefix; ///< Random, so IDs from different clients differ
+		std::atomic<std::uint64_t> _next{0}; ///< Number of the last message split
+	};
+
+	/**
+	 * @brief Puts split messages back together as their chunks arrive
+	 *
+	 * Every message is collected into one pooled buffer sized for the whole
+	 * of it when its first chunk arrives, and each chunk is written straight
+	 * to its place there, so the body is copied once however it was cut up.
+	 * Chunks may come in any order, and repeats are harmless. Messages that
+	 * stop receiving chunks are dropped by @c Expire , and the bytes held for
+	 * unfinished messages are capped. Not thread-safe; the IO thread owns it.
+	 */
+	class ChunkAssembler
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Construct a new ChunkAssembler object
+		 *
+		 * @param __pool Pool to borrow message buffers from
+		 * @param __maxBytes Most bytes held for unfinished messages
+		 */
+		ChunkAssembler(std::shared_ptr<BufferPool> __pool, std::uint64_t __maxBytes = AGENT_CHUNK_MAX_PENDING);
+
+		/**
+		 * @brief Gets where a chunk's bytes go
+		 *
+		 * @param _chunk The chunk arriving, with its @c size set
+		 * @param _now Current time
+		 * @return char* Room for @c _chunk.size bytes, or null if the chunk
+		 * does not fit its message, the message claims more chunks than it
+		 * has bytes, or the message would exceed the cap
+		 */
+		char* Begin(const ChunkInfo& _chunk, Clock::time_point _now = Clock::now());
+
+		/**
+		 * @brief Records that a chunk's bytes are all in
+		 *
+		 * @param _chunk The chunk, as given to @c Begin
+		 * @param _message Set to the whole message if this completed it
+		 * @return true If the message is complete
+		 */
+		bool Complete(const ChunkInfo& _chunk, PooledBuffer& _message);
+
+		/**
+		 * @brief Abandons an unfinished message
+		 *
+		 * @param _id ID of the message
+		 */
+		void Drop(const std::string& _id);
+
+		/**
+		 * @brief Abandons messages that have gone quiet
+		 *
+		 * @param _maxAge Longest wait for a message's next chunk
+		 * @param _now Current time
+		 * @param _expired Appended the IDs of the messages abandoned (optional)
+		 * @return std::size_t Number of messages abandoned
+		 */
+		std::size_t Expire(std::chrono::milliseconds _maxAge, Clock::time_point _now = Clock::now(), std::vector<std::string>* _expired = nullptr);
+
+		/**
+		 * @brief Gets the number of unfinished messages
+		 *
+		 * @return std::size_t Messages with chunks still to come
+		 */
+		std::size_t Pending() const;
+
+		/**
+		 * @brief Gets the bytes held for unfinished messages
+		 *
+		 * @return std::uint64_t Bytes reserved
+		 */
+		std::uint64_t PendingBytes() const;
+
+	private:
+		struct Partial
+		{
+			PooledBuffer buffer; ///< The whole message, as far as it has come
+			std::vector<bool> received; ///< Which chunks are in
+			std::uint32_t remaining = 0; ///< Chunks still to come
+			Clock::time_point touched; ///< When a chunk last arrived
+		};
+
+		std::shared_ptr<BufferPool> _pool; ///< Where message buffers come from
+		std::uint64_t _maxBytes; ///< Cap on @c _pendingBytes
+		std::uint64_t _pendingBytes = 0; ///< Bytes held in @c _partials
+		std::unordered_map<std::string, Partial> _partials; ///< Unfinished messages by ID
+	};
+}
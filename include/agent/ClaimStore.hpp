@@ -0,0 +1,169 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <cstdint>
+#include <mutex>
+
+namespace agent
+{
+	/**
+	 * @brief Where a claim-checked payload lies
+	 *
+	 * Published over AMQP in place of the payload, encoded as a
+	 * @c Messages::ClaimCheck FlatBuffer.
+	 */
+	struct ClaimHandle
+	{
+		std::string segment; ///< Name of the segment within the store's directory
+		std::uint64_t offset = 0; ///< Where the payload starts in the segment
+		std::uint64_t length = 0; ///< Bytes in the payload
+		std::uint64_t generation = 0; ///< Random stamp, so a reused name is not mistaken for the payload
+
+		/**
+		 * @brief Serializes the handle for publishing
+		 *
+		 * @return std::string The @c ClaimCheck FlatBuffer
+		 */
+		std::string Encode() const;
+
+		/**
+		 * @brief Reads a handle from a received message
+		 *
+		 * @param _data The message body
+		 * @param _size Bytes in the body
+		 * @param _handle Set to the handle if the body is one
+		 * @return true If the body is a valid @c ClaimCheck
+		 */
+		static bool Decode(const void* _data, std::size_t _size, ClaimHandle& _handle);
+	};
+
+	/**
+	 * @brief A claim-checked payload mapped into this process
+	 *
+	 * The mapping lasts as long as the object; @c Release gives up this
+	 * consumer's claim on the segment, and whoever gives up the last one
+	 * removes it.
+	 */
+	class Claim
+	{
+	public:
+		Claim(std::string __path, char* __base, std::size_t __mapped, ClaimHandle __handle);
+		~Claim();
+
+		Claim(const Claim&) = delete;
+		Claim& operator=(const Claim&) = delete;
+
+		/**
+		 * @brief Gets the payload
+		 *
+		 * @return const char* Start of the payload
+		 */
+		const char* Data() const;
+
+		/**
+		 * @brief Gets the payload size
+		 *
+		 * @return std::size_t Bytes in the payload
+		 */
+		std::size_t Size() const;
+
+		/**
+		 * @brief Gets the handle the payload was claimed with
+		 *
+		 * @return const ClaimHandle& The handle
+		 */
+		const ClaimHandle& Handle() const;
+
+		/**
+		 * @brief Gives up this claim on the segment, at most once
+		 *
+		 * @return true If this was the last claim and the segment is removed
+		 */
+		bool Release();
+
+	private:
+		std::string _path; ///< File of the segment
+		char* _base; ///< Start of the mapping
+		std::size_t _mapped; ///< Bytes mapped
+		ClaimHandle _handle; ///< Where the payload lies
+		bool _released = false; ///< Set once @c Release has run
+	};
+
+	/**
+	 * @brief Passes payloads between processes on one host outside the broker
+	 *
+	 * The claim-check pattern: a producer writes the payload into a segment,
+	 * a file in a directory both sides can see, and publishes only a small
+	 * @c ClaimHandle ; the consumer maps the segment and processes the
+	 * payload in place. With the directory on a tmpfs such as @c /dev/shm
+	 * the segments are plain POSIX shared memory, and the payload is copied
+	 * once in all instead of through two sockets and the broker.
+	 *
+	 * Every segment counts the claims still outstanding on it; the last
+	 * consumer to release it removes it. A segment with claims outstanding
+	 * is never removed otherwise, however old: its message may be waiting
+	 * out a retry or sitting in the dead letters. @c Collect only removes
+	 * old segments nobody has a claim on, e.g. ones whose last consumer
+	 * died before it could remove them, or whose producer died writing
+	 * them. Safe to use from any thread.
+	 */
+	class ClaimStore
+	{
+	public:
+		/**
+		 * @brief Construct a new ClaimStore object
+		 *
+		 * @param __directory Directory holding the segments; created, with its parents, if missing
+		 * @param __maxAge Age past which @c Collect removes an unclaimed segment
+		 * @throw std::runtime_error If the directory cannot be created
+		 */
+		ClaimStore(std::string __directory = AGENT_CLAIM_DIRECTORY, std::chrono::seconds __maxAge = std::chrono::seconds(AGENT_CLAIM_MAX_AGE_SEC));
+
+		/**
+		 * @brief Writes a payload into a new segment
+		 *
+		 * @param _data The payload
+		 * @param _size Bytes in the payload
+		 * @param _handle Set to where the payload now lies
+		 * @param _claims Number of consumers that will each release it
+		 * @return true If the segment was written
+		 */
+		bool Put(const void* _data, std::size_t _size, ClaimHandle& _handle, std::uint32_t _claims = 1);
+
+		/**
+		 * @brief Maps the payload a handle points at
+		 *
+		 * @param _handle Handle from a received message
+		 * @return std::shared_ptr<Claim> The payload, or null if its segment
+		 * is gone or is not the one the handle was made for
+		 */
+		std::shared_ptr<Claim> Open(const ClaimHandle& _handle);
+
+		/**
+		 * @brief Removes unclaimed segments older than the maximum age
+		 *
+		 * @return std::size_t Number of segments removed
+		 */
+		std::size_t Collect();
+
+		/**
+		 * @brief Gets the directory holding the segments
+		 *
+		 * @return const std::string& The directory
+		 */
+		const std::string& Directory() const;
+
+	private:
+		std::string _path(const std::string& _segment) const;
+
+		std::string _directory; ///< Directory holding the segments
+		std::chrono::seconds _maxAge; ///< Age past which unclaimed segments are collected
+		std::mt19937_64 _random; ///< Source of generations, which also name the segments
+		std::mutex _random_lock; ///< Mutex lock for @c _random
+	};
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include "BufferPool.hpp"
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <json/json.h>
+
+namespace agent
+{
+	/**
+	 * @brief A content encoding message bodies can be compressed with
+	 *
+	 * Implementations must be stateless, as one instance serves every
+	 * worker thread at once.
+	 */
+	class Codec
+	{
+	public:
+		virtual ~Codec() = default;
+
+		/**
+		 * @brief Gets the name sent as the message's content encoding
+		 *
+		 * @return const char* The encoding, e.g. @c deflate
+		 */
+		virtual const char* Name() const = 0;
+
+		/**
+		 * @brief Compresses a body
+		 *
+		 * @param _data Bytes to compress
+		 * @param _size Number of bytes at @c _data
+		 * @param _out Buffer to compress into, up to its capacity; resized to the bytes written
+		 * @param _level Codec-specific compression level
+		 * @return true If the compressed body fit in @c _out
+		 */
+		virtual bool Encode(const char* _data, std::size_t _size, PooledBuffer& _out, int _level) const = 0;
+
+		/**
+		 * @brief Decompresses a body
+		 *
+		 * Throws @c PermanentFailure if the body is corrupt or does not
+		 * decompress to exactly @c _outSize bytes, as no retry would fix it.
+		 *
+		 * @param _data Bytes to decompress
+		 * @param _size Number of bytes at @c _data
+		 * @param _out Where the decompressed body goes
+		 * @param _outSize Size of the decompressed body
+		 */
+		virtual void Decode(const char* _data, std::size_t _size, char* _out, std::size_t _outSize) const = 0;
+	};
+
+	/**
+	 * @brief The codecs a worker can encode and decode with, by name
+	 *
+	 * Starts with @c deflate (zlib, through Poco) and, when the library was
+	 * built with them, @c zstd and @c lz4 . More can be registered before
+	 * messages start flowing.
+	 */
+	class CodecRegistry
+	{
+	public:
+		/**
+		 * @brief Construct a new CodecRegistry object with the built-in codecs
+		 *
+		 */
+		CodecRegistry();
+
+		/**
+		 * @brief Adds a codec, replacing any of the same name
+		 *
+		 * @param _codec The codec
+		 */
+		void Register(std::shared_ptr<const Codec> _codec);
+
+		/**
+		 * @brief Looks a codec up by its content encoding
+		 *
+		 * @param _name The encoding
+		 * @return std::shared_ptr<const Codec> The codec, or null if unknown
+		 */
+		std::shared_ptr<const Codec> Find(const std::string& _name) const;
+
+		/**
+		 * @brief Gets the names of every codec registered
+		 *
+		 * @return std::vector<std::string> The encodings, in order
+		 */
+		std::vector<std::string> Names() const;
+
+	private:
+		std::map<std::string, std::shared_ptr<const Codec>> _codecs; ///< Codecs by name
+		mutable std::mutex _codecs_lock; ///< Mutex lock for @c _codecs
+	};
+
+	/**
+	 * @brief Which bodies get compressed, and how, by exchange
+	 *
+	 * Read from the @c compression section of a configuration: its @c codec
+	 * , @c threshold and @c level apply to every exchange, and entries under
+	 * @c exchanges override them for one exchange each. An empty codec
+	 * leaves bodies as they are. Its @c maxDecodedSize caps what a received
+	 * body may claim to decompress to.
+	 */
+	struct CompressionPolicy
+	{
+		struct Rule
+		{
+			std::string codec; ///< Encoding to compress with; empty for none
+			std::uint64_t threshold = AGENT_COMPRESS_THRESHOLD; ///< Smallest body worth compressing
+			int level = AGENT_COMPRESS_LEVEL; ///< Codec-specific compression level
+		};
+
+		Rule defaults; ///< Rule for exchanges without their own
+		std::map<std::string, Rule> exchanges; ///< Rules for particular exchanges
+		std::uint64_t maxDecodedSize = AGENT_MAX_DECODED_SIZE; ///< Largest decompressed body accepted
+
+		/**
+		 * @brief Gets the rule for publishing to an exchange
+		 *
+		 * @param _exchange The exchange
+		 * @return const Rule& Its own rule, else the default one
+		 */
+		const Rule& For(const std::string& _exchange) const;
+
+		/**
+		 * @brief Reads a policy from the @c compression section of a configuration
+		 *
+		 * @param _config The @c compression object; missing keys keep their defaults
+		 * @return CompressionPolicy The policy described
+		 */
+		static CompressionPolicy FromJson(const Json::Value& _config);
+	};
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <string_view>
+#include <cstdint>
+
+#include "BufferPool.hpp"
+
+#include <amqpcpp.h>
+
+namespace agent
+{
+	/**
+	 * @brief A message published (or about to be) on an AMQP channel
+	 *
+	 * The body is either copied into @c body or, to avoid that copy, owned
+	 * as a pooled buffer in @c buffer , or left where it was built and
+	 * kept alive through @c mapping .
+	 */
+	struct Publication
+	{
+		std::string exchange; ///< Exchange to publish to
+		std::string key; ///< Routing key
+		std::string body; ///< Message body, unless @c buffer is set
+		AMQP::Table headers; ///< Application headers, if any
+		std::string correlationId; ///< Correlation ID, if any
+		std::string replyTo; ///< Where replies should go, if anywhere
+		std::string contentEncoding; ///< Codec the body is compressed with, if any
+		PooledBuffer buffer; ///< Message body, when not in @c body
+		std::shared_ptr<const void> mapping; ///< Owner of @c view , e.g. a message released from its builder
+		std::string_view view; ///< Message body, when in neither @c buffer nor @c body
+		unsigned int refusals = 0; ///< Times the broker has nacked it
+
+		/**
+		 * @brief Gets the body bytes
+		 *
+		 * @return const char* Start of the body
+		 */
+		const char* Data() const { return buffer ? buffer.Data() : mapping ? view.data() : body.data(); }
+
+		/**
+		 * @brief Gets the body size
+		 *
+		 * @return std::size_t Bytes in the body
+		 */
+		std::size_t Size() const { return buffer ? buffer.Size() : mapping ? view.size() : body.size(); }
+	};
+
+	/**
+	 * @brief Keeps publications until the broker confirms them
+	 *
+	 * With publisher confirms enabled the broker numbers the messages on a
+	 * channel from 1 and acks or nacks them by that number, possibly many
+	 * at once. Anything still held when the channel is lost has not been
+	 * confirmed and can be handed back for publishing again.
+	 */
+	class ConfirmTracker
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Records a publication that went out on the channel
+		 *
+		 * @param _publication The message sent
+		 * @return std::uint64_t The tag the broker will confirm it under
+		 */
+		std::uint64_t Sent(Publication&& _publication);
+
+		/**
+		 * @brief Records a publication the channel could not take
+		 *
+		 * It is handed back, after the unconfirmed ones, by @c Reset .
+		 *
+		 * @param _publication The message not sent
+		 */
+		void Hold(Publication&& _publication);
+
+		/**
+		 * @brief Forgets publications the broker has confirmed
+		 *
+		 * @param _tag Tag being acked
+		 * @param _multiple Whether every tag up to @c _tag is acked as well
+		 */
+		void Ack(std::uint64_t _tag, bool _multiple);
+
+		/**
+		 * @brief Takes back publications the broker has refused
+		 *
+		 * @param _tag Tag being nacked
+		 * @param _multiple Whether every tag up to @c _tag is nacked as well
+		 * @return std::vector<Publication> The refused messages, in order
+		 */
+		std::vector<Publication> Nack(std::uint64_t _tag, bool _multiple);
+
+		/**
+		 * @brief Keeps a refused publication to publish again later
+		 *
+		 * @param _publication The message refused
+		 * @param _retryAt When to hand it back from @c Due
+		 */
+		void Refused(Publication&& _publication, Clock::time_point _retryAt);
+
+		/**
+		 * @brief Takes back the refused publications whose time has come
+		 *
+		 * @param _now The time now
+		 * @return std::vector<Publication> The messages to publish again, oldest retry time first
+		 */
+		std::vector<Publication> Due(Clock::time_point _now);
+
+		/**
+		 * @brief Takes back everything not yet confirmed, for a new channel
+		 *
+		 * Tags start again from 1 afterwards. Refused messages keep waiting
+		 * for @c Due .
+		 *
+		 * @return std::vector<Publication> Unconfirmed then held messages, in order
+		 */
+		std::vector<Publication> Reset();
+
+		/**
+		 * @brief Gets the number of messages not yet confirmed
+		 *
+		 * @return std::size_t Sent but unconfirmed, held and refused messages
+		 */
+		std::size_t Pending() const;
+
+	private:
+		std::vector<Publication> _take(std::uint64_t _tag, bool _multiple);
+
+		std::map<std::uint64_t, Publication> _unconfirmed; ///< Sent messages by tag
+		std::deque<Publication> _held; ///< Messages waiting for a channel
+		std::multimap<Clock::time_point, Publication> _refused; ///< Refused messages by when to retry them
+		std::uint64_t _tag = 0; ///< Tag of the last message sent
+	};
+}
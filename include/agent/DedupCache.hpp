@@ -0,0 +1,117 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+namespace agent
+{
+	/**
+	 * @brief Remembers which messages have been processed, and their results
+	 *
+	 * A bounded LRU map from a message key (its AMQP message ID, or a key
+	 * taken from the body) to the reply it produced, so that a redelivered
+	 * duplicate can be acked, or answered, without doing the work again.
+	 * Bounded both by entry count and by bytes of keys and results; the
+	 * least recently used entries go first. Keys are spread over shards,
+	 * each with its own lock, so worker threads recording results rarely
+	 * contend with the IO thread looking them up.
+	 */
+	class DedupCache
+	{
+	public:
+		/**
+		 * @brief Construct a new DedupCache object
+		 *
+		 * @param _maxEntries Most keys remembered at once
+		 * @param _maxBytes Most bytes of keys and results held at once
+		 * @param _shards Number of independently locked shards
+		 */
+		DedupCache(std::size_t _maxEntries = AGENT_DEDUP_MAX_ENTRIES, std::size_t _maxBytes = AGENT_DEDUP_MAX_BYTES, std::size_t _shards = AGENT_DEDUP_SHARDS);
+
+		/**
+		 * @brief Looks up a key, counting a hit or a miss
+		 *
+		 * @param _key Key of the message
+		 * @param _result Set to the recorded result on a hit
+		 * @return true If the message has been processed before
+		 */
+		bool Find(const std::string& _key, std::string& _result);
+
+		/**
+		 * @brief Records a processed message
+		 *
+		 * Results too big for a shard are not kept.
+		 *
+		 * @param _key Key of the message
+		 * @param _result Result it produced; empty if none
+		 */
+		void Insert(const std::string& _key, std::string _result = "");
+
+		/**
+		 * @brief Gets the number of lookups that found their key
+		 *
+		 * @return std::uint64_t Hits since construction
+		 */
+		std::uint64_t Hits() const;
+
+		/**
+		 * @brief Gets the number of lookups that did not find their key
+		 *
+		 * @return std::uint64_t Misses since construction
+		 */
+		std::uint64_t Misses() const;
+
+		/**
+		 * @brief Gets the share of lookups that found their key
+		 *
+		 * @return double Hits over lookups; 0 before any lookup
+		 */
+		double HitRate() const;
+
+		/**
+		 * @brief Gets the number of keys remembered
+		 *
+		 * @return std::size_t Entries across all shards
+		 */
+		std::size_t Size() const;
+
+		/**
+		 * @brief Gets the bytes held by the entries
+		 *
+		 * @return std::size_t Bytes across all shards
+		 */
+		std::size_t Bytes() const;
+
+	private:
+		struct Entry
+		{
+			std::string key; ///< Key of the message
+			std::string result; ///< Result it produced
+		};
+
+		struct Shard
+		{
+			mutable std::mutex lock; ///< Guards the rest of the shard
+			std::list<Entry> order; ///< Entries, most recently used first
+			std::unordered_map<std::string, std::list<Entry>::iterator> index; ///< Key to its place in @c order
+			std::size_t bytes = 0; ///< Bytes held by @c order
+		};
+
+		static std::size_t _cost(const Entry& _entry);
+		Shard& _shardFor(const std::string& _key);
+
+		std::unique_ptr<Shard[]> _shards; ///< The shards themselves
+		std::size_t _shardCount; ///< Number of shards
+		std::size_t _entriesPerShard; ///< Entry bound of each shard
+		std::size_t _bytesPerShard; ///< Byte bound of each shard
+		std::atomic<std::uint64_t> _hits{0}; ///< Lookups that found their key
+		std::atomic<std::uint64_t> _misses{0}; ///< Lookups that did not
+	};
+}
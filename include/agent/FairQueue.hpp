@@ -0,0 +1,95 @@
+#pragma once
+
+#include "WorkItem.hpp"
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+namespace agent
+{
+	/**
+	 * @brief Queue of work items split into weighted classes
+	 *
+	 * Items are served deficit-round-robin: each class in turn may take up
+	 * to its weight in items before the next class gets a go, and items
+	 * within a class keep their order. An empty class is skipped and loses
+	 * its turn, so capacity it is not using goes to the others; with weights
+	 * 4 and 1 and both classes busy, four of every five items come from the
+	 * first class.
+	 *
+	 * Not thread-safe; the owner locks around it.
+	 */
+	class FairQueue
+	{
+	public:
+		/**
+		 * @brief Sets the share of a class
+		 *
+		 * Classes not given a weight have weight 1.
+		 *
+		 * @param _class Class to set
+		 * @param _weight Items the class may take per round; at least 1
+		 */
+		void SetWeight(std::size_t _class, unsigned int _weight);
+
+		/**
+		 * @brief Gets the share of a class
+		 *
+		 * @param _class Class to look up
+		 * @return unsigned int Items the class may take per round
+		 */
+		unsigned int Weight(std::size_t _class) const;
+
+		/**
+		 * @brief Adds an item at the back of its class
+		 *
+		 * @param _item Item to add; @c WorkItem::queueClass picks the class
+		 */
+		void Push(WorkItem&& _item);
+
+		/**
+		 * @brief Takes the next item due
+		 *
+		 * @param _item Set to the item taken
+		 * @return true If there was an item
+		 */
+		bool Pop(WorkItem& _item);
+
+		/**
+		 * @brief Whether there are no items at all
+		 *
+		 * @return true If every class is empty
+		 */
+		bool Empty() const;
+
+		/**
+		 * @brief Gets the number of items waiting
+		 *
+		 * @return std::size_t Items across all classes
+		 */
+		std::size_t Size() const;
+
+		/**
+		 * @brief Gets the number of items waiting in one class
+		 *
+		 * @param _class Class to count
+		 * @return std::size_t Items in that class
+		 */
+		std::size_t Size(std::size_t _class) const;
+
+	private:
+		struct Class
+		{
+			std::deque<WorkItem> items; ///< Waiting items, oldest first
+			unsigned int weight = 1; ///< Items per round
+			unsigned int deficit = 0; ///< Items left in the current turn
+		};
+
+		Class& _at(std::size_t _class);
+
+		std::deque<Class> _classes; ///< Classes by number; a deque since items cannot be copied
+		std::size_t _current = 0; ///< Class whose turn it is
+		std::size_t _size = 0; ///< Items across all classes
+	};
+}
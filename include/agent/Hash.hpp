@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace agent
+{
+	/**
+	 * @brief Fast 64-bit hash of a block of bytes
+	 *
+	 * The XXH64 algorithm: the bulk of the input is consumed in 32-byte
+	 * stripes by four independent accumulators, which keeps the multiplier
+	 * units busy and lets the compiler vectorize the loop where the target
+	 * has 64-bit vector multiplies. Good enough to key caches on large
+	 * bodies without reading them more than once; not cryptographic.
+	 *
+	 * @param _data Bytes to hash
+	 * @param _size Number of bytes at @c _data
+	 * @param _seed Seed, for independent hashes of the same bytes
+	 * @return std::uint64_t The hash
+	 */
+	std::uint64_t Hash64(const void* _data, std::size_t _size, std::uint64_t _seed = 0);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+
+namespace agent
+{
+	/**
+	 * @brief Keeps time for AMQP heartbeats on one connection
+	 *
+	 * Tracks when traffic last went out and came in. We owe the broker a
+	 * frame at least every half interval, and treat it as gone once nothing
+	 * has arrived for two whole intervals. Any frame counts, not just
+	 * heartbeats. Times are passed in so the owner can sample the clock once
+	 * per pass of its loop.
+	 */
+	class HeartbeatMonitor
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Sets the negotiated interval and starts timing from @c _now
+		 *
+		 * @param __interval Negotiated interval; zero turns heartbeats off
+		 * @param _now Current time
+		 */
+		void Start(std::chrono::seconds __interval, Clock::time_point _now = Clock::now());
+
+		/**
+		 * @brief Stops timing, e.g. while the connection is down
+		 *
+		 */
+		void Stop();
+
+		/**
+		 * @brief Records that bytes arrived from the broker
+		 *
+		 * @param _now Current time
+		 */
+		void Received(Clock::time_point _now = Clock::now());
+
+		/**
+		 * @brief Records that bytes went out to the broker
+		 *
+		 * @param _now Current time
+		 */
+		void Sent(Clock::time_point _now = Clock::now());
+
+		/**
+		 * @brief Whether a heartbeat should be sent now
+		 *
+		 * @param _now Current time
+		 * @return true If nothing has gone out for half the interval
+		 */
+		bool SendDue(Clock::time_point _now = Clock::now()) const;
+
+		/**
+		 * @brief Whether the broker should be given up on
+		 *
+		 * @param _now Current time
+		 * @return true If nothing has come in for twice the interval
+		 */
+		bool PeerDead(Clock::time_point _now = Clock::now()) const;
+
+		/**
+		 * @brief Gets the negotiated interval
+		 *
+		 * @return std::chrono::seconds The interval; zero when off
+		 */
+		std::chrono::seconds Interval() const;
+
+	private:
+		std::chrono::seconds _interval{0}; ///< Negotiated interval; zero when off
+		Clock::time_point _lastReceived; ///< When bytes last came in
+		Clock::time_point _lastSent; ///< When bytes last went out
+	};
+}
@@ -1,147 +1,256 @@
-#pragma once
-
-#include "Buffer.hpp"
-#include "IWorker.hpp"
-
-#include <amqpcpp.h>
-#include <spdlog/spdlog.h>
-#include <Poco/Net/StreamSocket.h>
-#include <Poco/Net/SocketAddress.h>
-
-#include <vector>
-#include <cstdint>
-#include <memory>
-
-namespace agent
-{
-	class IConnectionHandler : public AMQP::ConnectionHandler, public IWorker
-	{
-	public:
-		IConnectionHandler(unsigned int __id);
-
-		/**
-		 * @brief Construct a new IConnectionHandler object
-		 * 
-		 * @param __id Process ID (deprecated, I hope)
-		 * @param _host Host address to connect to
-		 * @param _port Port to connect to
-		 * @param _name Client name to report to the server
-		 * @param __product Name of the product software to report
-		 * @param __version Version of the product software to report
-		 * @param __copyright Copyright string to report
-		 * @param __information Additional information/website to report
-		 */
-		IConnectionHandler(unsigned int __id, const std::string& _host, std::uint16_t _port, const std::string& _name, const std::string& __product = "", const std::string& __version = "", const std::string& __copyright = "", const std::string& __information = "");
-
-		/**
-		 * @brief Destroy the Connection Handler object
-		 * 
-		 * Not default because we need to shut off the @c AMQP::Connection close
-		 * the @c StreamSocket and delete the pointer to @c _connection
-		 */
-		~IConnectionHandler() = default;
-
-		/**
-		 * @brief Callback for the properties action from AMQP server
-		 * 
-		 * @param _connection The connection object, @c AMQP::Connection 
-		 * @param _server Server information table
-		 * @param _client Client information table
-		 */
-		void onProperties(AMQP::Connection* _connection, const AMQP::Table& _server, AMQP::Table& _client) override;
-
-		/**
-		 * @brief Callback for negotiating the heartbeat interval
-		 * 
-		 * @param _connection The connection object, @c AMQP::Connection
-		 * @param _interval Requested heartbeat interval
-		 * @return uint16_t Negotiated heartbeat interval
-		 */
-		uint16_t onNegotiate(AMQP::Connection* _connection, uint16_t _interval) override;
-
-		/**
-		 * @brief Callback which acts to send data when present
-		 * 
-		 * @param _connection The connection object, @c AMQP::Connection
-		 * @param _data Pointer to the bytes to send
-		 * @param _size Number of bytes to send
-		 */
-		void onData(AMQP::Connection* _connection, const char* _data, size_t _size) override;
-
-		/**
-		 * @brief Callback which handles case when heartbeat is received
-		 * 
-		 * @param _connection The connection object, @c AMQP::Connection
-		 */
-		void onHeartbeat(AMQP::Connection* _connection) override;
-
-		/**
-		 * @brief Callback for error case
-		 * 
-		 * @param _connection The connection object, @c AMQP::Connection
-		 * @param _message Error message
-		 */
-		void onError(AMQP::Connection* _connection, const char* _message) override;
-
-		/**
-		 * @brief Callback which fires when connection is ready
-		 * 
-		 * @param _connection The connection object, @c AMQP::Connection
-		 */
-		void onReady(AMQP::Connection* _connection) override;
-
-		/**
-		 * @brief Callback for closure of the connection
-		 * 
-		 * @param _connection The connection object, @c AMQP::Connection
-		 */
-		void onClosed(AMQP::Connection* _connection) override;
-
-		/**
-		 * @brief Overridden function which won't be called
-		 * 
-		 * @param _msg N/A
-		 * @param _size N/A
-		 * @return int N/A
-		 */
-		int ProcessMessage(const void* _msg, std::uint32_t _size, void* _result = nullptr, std::uint32_t* _rsize = nullptr);
-
-		/**
-		 * @brief Returns the underlying @c Poco::Net::StreamSocket
-		 * 
-		 * @return Poco::Net::StreamSocket& 
-		 */
-		Poco::Net::StreamSocket& socket();
-
-		/**
-		 * @brief Function which runs the loop
-		 * 
-		 */
-		void operator()() override;
-
-		/**
-		 * @brief Sets the quit state to kill the loop
-		 * 
-		 */
-		void quit();
-
-	protected:
-		std::shared_ptr<spdlog::logger> _logger;
-
-	private:
-		void _connectSocket(Poco::Net::SocketAddress _address);
-		std::string _client;
-		std::string _product;
-		std::string _version;
-		std::string _copyright;
-		std::string _information;
-		bool _connected;
-		Poco::Net::StreamSocket _socket;
-		Poco::Net::SocketAddress _address;
-		Buffer _inpbuffer;
-		Buffer _outbuffer;
-		std::vector<char> _tmpbuffer;
-		AMQP::Connection* _connection;
-		void _sendDataFromBuffer();
-	};
+#pragma once
+
+#include "Buffer.hpp"
+#include "BufferPool.hpp"
+#include "IWorker.hpp"
+#include "Backoff.hpp"
+#include "HeartbeatMonitor.hpp"
+#include "Metrics.hpp"
+
+#include <amqpcpp.h>
+#include <spdlog/spdlog.h>
+#include <Poco/Net/StreamSocket.h>
+#include <Poco/Net/SocketAddress.h>
+
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace agent
+{
+	class IConnectionHandler : public AMQP::ConnectionHandler, public IWorker
+	{
+	public:
+		IConnectionHandler(unsigned int __id);
+
+		/**
+		 * @brief Construct a new IConnectionHandler object
+		 * 
+		 * @param __id Process ID (deprecated, I hope)
+		 * @param _host Host address to connect to
+		 * @param _port Port to connect to
+		 * @param _name Client name to report to the server
+		 * @param __product Name of the product software to report
+		 * @param __version Version of the product software to report
+		 * @param __copyright Copyright string to report
+		 * @param __information Additional information/website to report
+		 * @param __segmentSize Size of the pooled segments backing the buffers
+		 * @param __bufferCapacity Maximum bytes held by each of the input and
+		 * output buffers
+		 * @param __poolIdleSize Maximum idle bytes the buffer pool keeps around
+		 */
+		IConnectionHandler(unsigned int __id, const std::string& _host, std::uint16_t _port, const std::string& _name, const std::string& __product = "", const std::string& __version = "", const std::string& __copyright = "", const std::string& __information = "", std::size_t __segmentSize = AGENT_CONN_SEGMENT_SIZE, std::size_t __bufferCapacity = AGENT_CONN_BUFFER_SIZE, std::size_t __poolIdleSize = AGENT_POOL_MAX_IDLE_SIZE);
+
+		/**
+		 * @brief Destroy the Connection Handler object
+		 * 
+		 * Not default because we need to shut off the @c AMQP::Connection close
+		 * the @c StreamSocket and delete the pointer to @c _connection
+		 */
+		~IConnectionHandler() = default;
+
+		/**
+		 * @brief Callback for the properties action from AMQP server
+		 * 
+		 * @param _connection The connection object, @c AMQP::Connection 
+		 * @param _server Server information table
+		 * @param _client Client information table
+		 */
+		void onProperties(AMQP::Connection* _connection, const AMQP::Table& _server, AMQP::Table& _client) override;
+
+		/**
+		 * @brief Callback for negotiating the heartbeat interval
+		 * 
+		 * @param _connection The connection object, @c AMQP::Connection
+		 * @param _interval Requested heartbeat interval
+		 * @return uint16_t Negotiated heartbeat interval
+		 */
+		uint16_t onNegotiate(AMQP::Connection* _connection, uint16_t _interval) override;
+
+		/**
+		 * @brief Callback which acts to send data when present
+		 * 
+		 * Queues the bytes for the IO loop to send. Bytes that do not fit in
+		 * the output buffer fail the connection, which is then reconnected.
+		 * 
+		 * @param _connection The connection object, @c AMQP::Connection
+		 * @param _data Pointer to the bytes to send
+		 * @param _size Number of bytes to send
+		 */
+		void onData(AMQP::Connection* _connection, const char* _data, size_t _size) override;
+
+		/**
+		 * @brief Callback which handles case when heartbeat is received
+		 * 
+		 * Only logs; our own heartbeats are sent by the IO loop on a timer.
+		 * 
+		 * @param _connection The connection object, @c AMQP::Connection
+		 */
+		void onHeartbeat(AMQP::Connection* _connection) override;
+
+		/**
+		 * @brief Callback for error case
+		 * 
+		 * @param _connection The connection object, @c AMQP::Connection
+		 * @param _message Error message
+		 */
+		void onError(AMQP::Connection* _connection, const char* _message) override;
+
+		/**
+		 * @brief Callback which fires when connection is ready
+		 * 
+		 * @param _connection The connection object, @c AMQP::Connection
+		 */
+		void onReady(AMQP::Connection* _connection) override;
+
+		/**
+		 * @brief Callback for closure of the connection
+		 * 
+		 * @param _connection The connection object, @c AMQP::Connection
+		 */
+		void onClosed(AMQP::Connection* _connection) override;
+
+		/**
+		 * @brief Overridden function which won't be called
+		 * 
+		 * @param _msg N/A
+		 * @param _size N/A
+		 * @return int N/A
+		 */
+		int ProcessMessage(const void* _msg, std::uint32_t _size, void* _result = nullptr, std::uint32_t* _rsize = nullptr);
+
+		/**
+		 * @brief Returns the underlying @c Poco::Net::StreamSocket
+		 * 
+		 * @return Poco::Net::StreamSocket& 
+		 */
+		Poco::Net::StreamSocket& socket();
+
+		/**
+		 * @brief Function which runs the loop
+		 * 
+		 */
+		void operator()() override;
+
+		/**
+		 * @brief Sets the quit state to kill the loop
+		 * 
+		 */
+		void quit();
+
+		/**
+		 * @brief Returns the pool backing this connection's buffers
+		 * 
+		 * @return std::shared_ptr<BufferPool> The connection's buffer pool
+		 */
+		std::shared_ptr<BufferPool> pool() const;
+
+		/**
+		 * @brief Runs a function on the IO thread
+		 * 
+		 * AMQP-CPP objects may only be used from the thread driving the
+		 * connection; other threads hand their work over through here. Tasks
+		 * posted while the connection is down run once it is back.
+		 * 
+		 * @param _task Function to run
+		 */
+		void Post(std::function<void()> _task);
+
+		/**
+		 * @brief Sets the delays used between reconnect attempts
+		 * 
+		 * @param _initial Ceiling of the first delay
+		 * @param _maximum Largest ceiling of any delay
+		 */
+		void SetReconnectBackoff(std::chrono::milliseconds _initial, std::chrono::milliseconds _maximum);
+
+	protected:
+		std::shared_ptr<spdlog::logger> _logger;
+
+		/**
+		 * @brief Opens a fresh connection to the broker on @c socket()
+		 * 
+		 * Overridden by secure handlers to layer TLS on the plain connection.
+		 */
+		virtual void _connectSocket();
+
+		/**
+		 * @brief Called from the IO loop when the peer has gone away
+		 * 
+		 * Schedules a reconnect unless we are shutting down.
+		 */
+		virtual void _onSocketClosed();
+
+		/**
+		 * @brief Called on the IO thread on every pass of the IO loop
+		 * 
+		 * For periodic work such as timeouts; runs at least every
+		 * @c AGENT_CONN_POLL_USEC while connected.
+		 */
+		virtual void _onPoll();
+
+		/**
+		 * @brief Called on the IO thread once the connection is lost
+		 * 
+		 * Subclasses drop their @c AMQP::Connection and anything tied to it.
+		 */
+		virtual void _onDisconnected();
+
+		/**
+		 * @brief Called on the IO thread once a new socket is connected
+		 * 
+		 * Subclasses create a new @c AMQP::Connection here and restore
+		 * their channels.
+		 */
+		virtual void _onReconnected();
+
+		/**
+		 * @brief Creates the connection's series: bytes in and out, frames parsed
+		 * 
+		 * @param _registry Registry to create them in
+		 */
+		void _registerMetrics(MetricsRegistry& _registry) override;
+
+	private:
+		struct ConnectionMetrics
+		{
+			Counter* bytesIn = nullptr;
+			Counter* bytesOut = nullptr;
+			Counter* frames = nullptr;
+		};
+
+		std::string _client;
+		std::string _product;
+		std::string _version;
+		std::string _copyright;
+		std::string _information;
+		bool _connected;
+		Poco::Net::StreamSocket _socket;
+		Poco::Net::SocketAddress _address;
+		std::shared_ptr<BufferPool> _pool;
+		Buffer _inpbuffer;
+		Buffer _outbuffer;
+		std::mutex _outbuffer_lock; ///< Mutex lock for @c _outbuffer
+		bool _readWantsWrite = false; ///< Last read needs the socket writable (TLS)
+		bool _writeWantsRead = false; ///< Last write needs the socket readable (TLS)
+		AMQP::Connection* _connection;
+		void _sendDataFromBuffer();
+		void _receiveIntoBuffer();
+		void _parseFromBuffer();
+		bool _pendingOutput();
+		void _reconnect();
+		void _runTasks();
+		void _checkHeartbeat();
+		Backoff _backoff; ///< Delays between reconnect attempts
+		HeartbeatMonitor _heartbeat; ///< Heartbeat timing; touched only on the IO thread
+		ConnectionMetrics _traffic; ///< Series in the registry, if any; updated on the IO thread
+		std::atomic<bool> _reconnectPending{false}; ///< Set when the connection has been lost
+		std::deque<std::function<void()>> _tasks; ///< Work posted to the IO thread
+		std::mutex _tasks_lock; ///< Mutex lock for @c _tasks
+	};
 }
\ No newline at end of file
@@ -1,68 +1,82 @@
-#pragma once
-
-#include "IConnectionHandler.hpp"
-#include "IConnectionHandlerSSL.hpp"
-
-#include <amqpcpp.h>
-#include <spdlog/spdlog.h>
-#include <Poco/Net/Net.h>
-#include <Poco/Net/NetSSL.h>
-#include <Poco/Net/Context.h>
-#include <Poco/Net/SecureStreamSocket.h>
-
-#include <string>
-#include <cstdint>
-#include <memory>
-
-class SSLInitializer
-{
-public:
-	SSLInitializer()
-	{
-		Poco::Net::initializeSSL();
-	}
-
-	~SSLInitializer()
-	{
-		Poco::Net::uninitializeSSL();
-	}
-};
-
-namespace agent
-{
-	class IConnectionHandlerSSL : public IConnectionHandler
-	{
-	public:
-	 	/**
-	 	 * @brief Construct a new IConnectionHandlerSSL object
-	 	 * 
-		 * @param __id Process ID (deprecated, I hope)
-		 * @param _host Host address to connect to
-		 * @param _port Port to connect to
-		 * @param _name Client name to report to the server
-	 	 * @param _privateKeyFile Client private key PEM file path
-	 	 * @param _certificateFile Client certificate PEM file path
-	 	 * @param _caLocation Certificate authority path
-		 * @param __product Name of the product software to report
-		 * @param __version Version of the product software to report
-		 * @param __copyright Copyright string to report
-		 * @param __information Additional information/website to report
-	 	 */
-		IConnectionHandlerSSL(unsigned int __id, const std::string& _host, std::uint16_t _port, const std::string& _name, const std::string& _privateKeyFile, const std::string& _certificateFile, const std::string& _caLocation, const std::string& __product = "", const std::string& __version = "", const std::string& __copyright = "", const std::string& __information = "");
-
-		/**
-		 * @brief Destroy the Connection Handler object
-		 * 
-		 * Not default because we need to shut off the @c AMQP::Connection close
-		 * the @c StreamSocket and delete the pointer to @c _connection
-		 */
-		~IConnectionHandlerSSL() = default;
-
-	protected:
-		std::shared_ptr<spdlog::logger> _logger;
-
-	private:
-		//Poco::Net::SecureStreamSocket _socket;
-		SSLInitializer _sslInitializer;
-	};
+#pragma once
+
+#include "IConnectionHandler.hpp"
+#include "IConnectionHandlerSSL.hpp"
+
+#include <amqpcpp.h>
+#include <spdlog/spdlog.h>
+#include <Poco/Net/Net.h>
+#include <Poco/Net/NetSSL.h>
+#include <Poco/Net/Context.h>
+#include <Poco/Net/SecureStreamSocket.h>
+#include <Poco/Net/Session.h>
+
+#include <string>
+#include <cstdint>
+#include <memory>
+
+class SSLInitializer
+{
+public:
+	SSLInitializer()
+	{
+		Poco::Net::initializeSSL();
+	}
+
+	~SSLInitializer()
+	{
+		Poco::Net::uninitializeSSL();
+	}
+};
+
+namespace agent
+{
+	class IConnectionHandlerSSL : public IConnectionHandler
+	{
+	public:
+	 	/**
+	 	 * @brief Construct a new IConnectionHandlerSSL object
+	 	 * 
+		 * @param __id Process ID (deprecated, I hope)
+		 * @param _host Host address to connect to
+		 * @param _port Port to connect to
+		 * @param _name Client name to report to the server
+	 	 * @param _privateKeyFile Client private key PEM file path
+	 	 * @param _certificateFile Client certificate PEM file path
+	 	 * @param _caLocation Certificate authority path
+		 * @param __product Name of the product software to report
+		 * @param __version Version of the product software to report
+		 * @param __copyright Copyright string to report
+		 * @param __information Additional information/website to report
+		 * @param __segmentSize Size of the pooled segments backing the buffers
+		 * @param __bufferCapacity Maximum bytes held by each of the input and
+		 * output buffers
+		 * @param __poolIdleSize Maximum idle bytes the buffer pool keeps around
+	 	 */
+		IConnectionHandlerSSL(unsigned int __id, const std::string& _host, std::uint16_t _port, const std::string& _name, const std::string& _privateKeyFile, const std::string& _certificateFile, const std::string& _caLocation, const std::string& __product = "", const std::string& __version = "", const std::string& __copyright = "", const std::string& __information = "", std::size_t __segmentSize = AGENT_CONN_SEGMENT_SIZE, std::size_t __bufferCapacity = AGENT_CONN_BUFFER_SIZE, std::size_t __poolIdleSize = AGENT_POOL_MAX_IDLE_SIZE);
+
+		/**
+		 * @brief Destroy the Connection Handler object
+		 * 
+		 * Not default because we need to shut off the @c AMQP::Connection close
+		 * the @c StreamSocket and delete the pointer to @c _connection
+		 */
+		~IConnectionHandlerSSL() = default;
+
+	protected:
+		/**
+		 * @brief Connects the plain socket and then performs the TLS handshake
+		 * 
+		 * Resumes the previous TLS session when the broker still has it.
+		 */
+		void _connectSocket() override;
+
+	private:
+		void _secureSocket();
+
+		//Poco::Net::SecureStreamSocket _socket;
+		SSLInitializer _sslInitializer;
+		Poco::Net::Context::Ptr _context; ///< Client TLS context, with session caching
+		Poco::Net::Session::Ptr _session; ///< Last negotiated session, offered on reconnect
+	};
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include <amqpcpp.h>
+
+namespace agent
+{
+	/**
+	 * @brief Interface for processing a message body while it is still arriving
+	 *
+	 * Implement this instead of (or as well as) @c IWorker::ProcessMessage
+	 * when a message is large enough that waiting for the whole body wastes
+	 * time, e.g. row-wise work on big images. For every delivery the calls
+	 * come in order: one @c OnBegin , any number of @c OnChunk , then one
+	 * @c OnEnd , all on the same thread. If the connection drops part way
+	 * through a body, the next call is the @c OnBegin of another message.
+	 */
+	class IStreamHandler
+	{
+	public:
+		virtual ~IStreamHandler() = default;
+
+		/**
+		 * @brief Called when a new message starts
+		 *
+		 * @param _size Total number of body bytes that will follow
+		 * @param _headers Application headers sent with the message
+		 */
+		virtual void OnBegin(std::uint64_t _size, const AMQP::Table& _headers) = 0;
+
+		/**
+		 * @brief Called for each piece of the body, in order
+		 *
+		 * @param _data Pointer to the bytes; only valid during the call
+		 * @param _size Number of bytes at @c _data
+		 */
+		virtual void OnChunk(const char* _data, std::size_t _size) = 0;
+
+		/**
+		 * @brief Called once the whole body has been delivered
+		 *
+		 * @return int Unique ID of the message processed
+		 */
+		virtual int OnEnd() = 0;
+	};
+}
@@ -1,158 +1,424 @@
-#pragma once
-
-#include <string>
-#include <atomic>
-#include <thread>
-#include <mutex>
-#include <vector>
-#include <deque>
-#include <cstdint>
-#include <memory>
-#include <utility>
-
-#include <spdlog/spdlog.h>
-
-namespace agent
-{
-	typedef enum {
-		WORKER_READY,
-		WORKER_RUNNING,
-		WORKER_QUIT
-	} WorkerState;
-
-	class IWorker
-	{
-	public:
-		/**
-		 * @brief Construct a new IWorker object
-		 * 
-		 * This is just an interface with the basic parts, so you'll want to
-		 * overload it.
-		 * 
-		 * @param __id The ID number for this worker
-		 */
-		IWorker(unsigned int __id);
-
-		/**
-		 * @brief Construct a new IWorker object
-		 * 
-		 * @param __id Desired worker ID
-		 * @param __name Desired worker name
-		 */
-		IWorker(unsigned int __id, std::string __name);
-
-		/**
-		 * @brief Destroy the IWorker object
-		 * 
-		 */
-		virtual ~IWorker();
-
-		/**
-		 * @brief Starts the worker thread itself
-		 * 
-		 * This function exists for the case that you might want to inherit @c
-		 * IWorker and do more setup of the object before starting the thread
-		 */
-		void Run(std::size_t _nthread = 1);
-
-		/**
-		 * @brief Stops all threads
-		 * 
-		 */
-		void Stop();
-
-		/**
-		 * @brief Get the ID of the worker
-		 * 
-		 * @return unsigned int ID of the worker
-		 */
-		unsigned int GetId() const;
-		
-		/**
-		 * @brief Get the name object
-		 * 
-		 * @return std::string The name, if set, of the worker object
-		 */
-		std::string GetName() const;
-
-		/**
-		 * @brief Set the name object
-		 * 
-		 * @param __name Desired name of the worker object
-		 */
-		void SetName(std::string __name);
-
-		/**
-		 * @brief Gets the state of the worker, a @c WorkerState
-		 * 
-		 * @return WorkerState State of the worker
-		 */
-		WorkerState GetState() const;
-
-		/**
-		 * @brief Set the quit state
-		 * 
-		 * Sets the @c _state to @c WORKER_QUIT to kill the thread.
-		 * 
-		 */
-		void SetQuit();
-
-		virtual void AddMessage(const void* _msg, std::uint32_t _size);
-
-		/**
-		 * @brief Pops the oldest available result off the return value stack
-		 *
-		 * Retrieves the result of a processed message recorded by the work
-		 * loop. Each entry pairs the unique ID returned by @c ProcessMessage
-		 * with a boolean indicating whether the message was processed
-		 * successfully (i.e. without throwing an exception).
-		 *
-		 * @param _result Output pair holding the message ID and its success flag
-		 * @return true If a result was available and written to @c _result
-		 * @return false If the return value stack was empty
-		 */
-		bool PopResult(std::pair<int, bool>& _result);
-
-		/**
-		 * @brief Returns the number of pending results on the return value stack
-		 *
-		 * @return std::size_t Count of results not yet popped
-		 */
-		std::size_t ResultsAvailable();
-
-		/**
-		 * @brief Process the given (serialized) message
-		 * 
-		 * This is where the work is done in the worker class.
-		 * 
-		 * @param _msg Serialized message (array of bytes, i.e. void*)
-		 * @param _size Number of bytes in the serialized message in @c _msg
-		 * @param _result Result data serving as a return from the procedure
-		 * @param _rsize Size of the result message (optional)
-		 * @return int Unique ID of the message processed
-		 */
-		virtual int ProcessMessage(const void* _msg, std::uint32_t _size, void* _result = nullptr, std::uint32_t* _rsize = nullptr) = 0;
-
-		/**
-		 * @brief Contains the main work loop
-		 * 
-		 * Contains the main work loop in which @c ProcessMessage is called
-		 * until @c _data is exhausted.
-		 * 
-		 */
-		virtual void operator()();
-
-	protected:
-		std::deque<std::pair<const void*, std::uint32_t>> _data; ///< Queue of messages
-		std::mutex _data_lock; ///< Mutex lock for the @c _data queue
-		std::deque<std::pair<int, bool>> _results; ///< Stack of processed message results (ID, success)
-		std::mutex _results_lock; ///< Mutex lock for the @c _results stack
-		std::vector<std::thread> _threads; ///< All of the threads running on the worker
-		std::shared_ptr<spdlog::logger> _logger = nullptr;
-
-	private:
-		unsigned int _id; ///< Unique ID of the worker
-		std::string _name = "IWorker"; ///< Name assigned to the worker
-		std::atomic<WorkerState> _state; ///< State of the worker; 0 -> Ready
-	};
-}
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <optional>
+#include <stdexcept>
+#include <functional>
+
+#include <spdlog/spdlog.h>
+
+#include "BufferPool.hpp"
+#include "WorkItem.hpp"
+#include "FairQueue.hpp"
+
+namespace agent
+{
+	class DedupCache;
+	class TileExecutor;
+	struct Tile;
+	class MetricsRegistry;
+	class Counter;
+	class Gauge;
+	class Histogram;
+	class LogSampler;
+	class Tracer;
+
+	namespace kernels
+	{
+		struct ImageView;
+	}
+
+	typedef enum {
+		WORKER_READY,
+		WORKER_RUNNING,
+		WORKER_QUIT
+	} WorkerState;
+
+	/**
+	 * @brief Thrown from @c ProcessMessage when retrying cannot help
+	 *
+	 * E.g. for a message of a type nobody handles; a consuming worker
+	 * dead-letters it at once instead of spending its retries on it.
+	 */
+	class PermanentFailure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	class IWorker
+	{
+	public:
+		/**
+		 * @brief Construct a new IWorker object
+		 * 
+		 * This is just an interface with the basic parts, so you'll want to
+		 * overload it.
+		 * 
+		 * @param __id The ID number for this worker
+		 */
+		IWorker(unsigned int __id);
+
+		/**
+		 * @brief Construct a new IWorker object
+		 * 
+		 * @param __id Desired worker ID
+		 * @param __name Desired worker name
+		 */
+		IWorker(unsigned int __id, std::string __name);
+
+		/**
+		 * @brief Destroy the IWorker object
+		 * 
+		 */
+		virtual ~IWorker();
+
+		/**
+		 * @brief Starts the worker thread itself
+		 * 
+		 * This function exists for the case that you might want to inherit @c
+		 * IWorker and do more setup of the object before starting the thread
+		 */
+		void Run(std::size_t _nthread = 1);
+
+		/**
+		 * @brief Stops all threads
+		 * 
+		 */
+		void Stop();
+
+		/**
+		 * @brief Get the ID of the worker
+		 * 
+		 * @return unsigned int ID of the worker
+		 */
+		unsigned int GetId() const;
+		
+		/**
+		 * @brief Get the name object
+		 * 
+		 * @return std::string The name, if set, of the worker object
+		 */
+		std::string GetName() const;
+
+		/**
+		 * @brief Set the name object
+		 * 
+		 * @param __name Desired name of the worker object
+		 */
+		void SetName(std::string __name);
+
+		/**
+		 * @brief Gets the state of the worker, a @c WorkerState
+		 * 
+		 * @return WorkerState State of the worker
+		 */
+		WorkerState GetState() const;
+
+		/**
+		 * @brief Set the quit state
+		 * 
+		 * Sets the @c _state to @c WORKER_QUIT to kill the thread.
+		 * 
+		 */
+		void SetQuit();
+
+		/**
+		 * @brief Adds a message to the queue without taking ownership
+		 * 
+		 * @param _msg Serialized message; must outlive its processing
+		 * @param _size Number of bytes in the serialized message
+		 */
+		virtual void AddMessage(const void* _msg, std::uint32_t _size);
+
+		/**
+		 * @brief Adds a message to the queue, taking ownership of its buffer
+		 * 
+		 * The buffer is returned to its pool once the message is processed.
+		 * 
+		 * @param _msg Pooled buffer holding the serialized message
+		 */
+		virtual void AddMessage(PooledBuffer&& _msg);
+
+		/**
+		 * @brief Adds a prepared work item to the queue
+		 * 
+		 * @param _item The item to enqueue
+		 */
+		virtual void AddMessage(WorkItem&& _item);
+
+		/**
+		 * @brief Sets the share of processing a class of messages gets
+		 * 
+		 * Messages are taken from their classes (@c WorkItem::queueClass )
+		 * deficit-round-robin, so with weights 4 and 1 a busy first class
+		 * gets four of every five messages processed, and either class can
+		 * use all of the threads while the other is idle.
+		 * 
+		 * @param _class Class to set
+		 * @param _weight Relative share; at least 1
+		 */
+		void SetQueueWeight(std::size_t _class, unsigned int _weight);
+
+		/**
+		 * @brief Reuses the results of byte-identical messages
+		 * 
+		 * Each body is hashed with @c Hash64 and, if a body with the same
+		 * hash and size has been processed, and a second hash with another
+		 * seed matches as well, its message ID and result are handed back
+		 * without calling @c ProcessMessage . Only worth it when
+		 * identical bodies are common and @c ProcessMessage is a pure
+		 * function of the body. Call at most once, before messages arrive.
+		 * 
+		 * @param _maxEntries Most results remembered at once
+		 * @param _maxBytes Most bytes of results remembered at once
+		 */
+		void EnableMemo(std::size_t _maxEntries = AGENT_MEMO_MAX_ENTRIES, std::size_t _maxBytes = AGENT_MEMO_MAX_BYTES);
+
+		/**
+		 * @brief Gets the cache of results by body hash
+		 * 
+		 * @return const DedupCache* The cache, or null unless @c EnableMemo was called
+		 */
+		const DedupCache* GetMemoCache() const;
+
+		/**
+		 * @brief Shares an executor for tiles with other workers
+		 * 
+		 * Every worker starts with one of its own, which its idle threads
+		 * help with. Call before @c Run .
+		 * 
+		 * @param _executor The executor to use
+		 */
+		void SetTileExecutor(std::shared_ptr<TileExecutor> _executor);
+
+		/**
+		 * @brief Gets the executor this worker's tiles run on
+		 * 
+		 * @return std::shared_ptr<TileExecutor> The executor
+		 */
+		std::shared_ptr<TileExecutor> GetTileExecutor();
+
+		/**
+		 * @brief Processes an image in tiles, in parallel
+		 * 
+		 * For use from @c ProcessMessage on large images: the image is split
+		 * into bands of rows about @c _tileBytes in size, and the threads of
+		 * this worker not busy with messages of their own (or those of a
+		 * shared executor) take bands alongside the calling thread. Returns
+		 * once every band is done.
+		 * 
+		 * @param _image The image
+		 * @param _kernel Called with each @c Tile , on any thread
+		 * @param _tileBytes Rough size of each tile
+		 */
+		void ForEachTile(const kernels::ImageView& _image, const std::function<void(const Tile&)>& _kernel, std::size_t _tileBytes = AGENT_TILE_BYTES);
+
+		/**
+		 * @brief Processes an image in tiles, in parallel, and combines their results
+		 * 
+		 * As the other @c ForEachTile , with the tile results folded
+		 * together top to bottom, so the outcome does not depend on which
+		 * thread finished first.
+		 * 
+		 * @tparam T Result type
+		 * @param _image The image
+		 * @param _init Value the results are folded into
+		 * @param _kernel Called with each @c Tile , on any thread; returns a @c T
+		 * @param _reduce Combines the result so far with that of the next tile
+		 * @param _tileBytes Rough size of each tile
+		 * @return T The combined result
+		 */
+		template <typename T, typename Kernel, typename Reduce>
+		T ForEachTile(const kernels::ImageView& _image, T _init, Kernel _kernel, Reduce _reduce, std::size_t _tileBytes = AGENT_TILE_BYTES)
+		{
+			std::vector<std::optional<T>> partials;
+			_runTiles(_image, _tileBytes, [&](std::size_t _tiles) { partials.resize(_tiles); }, [&](std::size_t _i, const Tile& _tile) { partials[_i].emplace(_kernel(_tile)); });
+
+			for (auto& partial : partials)
+				_init = _reduce(std::move(_init), std::move(*partial));
+			return _init;
+		}
+
+		/**
+		 * @brief Records this worker's metrics in a registry
+		 * 
+		 * Messages waiting and in flight, processed and failed, and how
+		 * long they waited and took to process, labelled with the worker's
+		 * name; a shared registry lets one @c MetricsServer serve several
+		 * workers. Call at most once, before messages arrive.
+		 * 
+		 * @param _registry Registry to record into
+		 */
+		void SetMetrics(std::shared_ptr<MetricsRegistry> _registry);
+
+		/**
+		 * @brief Gets the registry this worker records its metrics in
+		 * 
+		 * @return std::shared_ptr<MetricsRegistry> The registry, or null unless @c SetMetrics was called
+		 */
+		std::shared_ptr<MetricsRegistry> GetMetrics();
+
+		/**
+		 * @brief Records the stages of each message in a tracer
+		 * 
+		 * How long messages wait queued and take to process, by message;
+		 * messages without a trace ID get one here. Give the connection
+		 * feeding this worker the same tracer to follow them from the
+		 * socket to their ack. Call at most once, before messages arrive.
+		 * 
+		 * @param __tracer Tracer to record into
+		 */
+		void SetTracer(std::shared_ptr<Tracer> __tracer);
+
+		/**
+		 * @brief Gets the tracer this worker records into
+		 * 
+		 * @return std::shared_ptr<Tracer> The tracer, or null unless @c SetTracer was called
+		 */
+		std::shared_ptr<Tracer> GetTracer();
+
+		/**
+		 * @brief Sets how many processed messages there are to each one logged
+		 * 
+		 * Logging every message costs more than many messages do; with
+		 * sampling off, the counters of @c SetMetrics tell how many were
+		 * processed instead. Defaults to what @c ConfigureLogging said.
+		 * 
+		 * @param _every Messages logged: one in this many, 0 for none
+		 */
+		void SetLogSampling(std::uint32_t _every);
+
+		/**
+		 * @brief Gets the number of messages waiting to be processed
+		 * 
+		 * @return std::size_t Messages queued across all classes
+		 */
+		std::size_t MessagesWaiting();
+
+		/**
+		 * @brief Pops the oldest available result off the return value stack
+		 *
+		 * Retrieves the result of a processed message recorded by the work
+		 * loop. Each entry pairs the unique ID returned by @c ProcessMessage
+		 * with a boolean indicating whether the message was processed
+		 * successfully (i.e. without throwing an exception).
+		 *
+		 * @param _result Output pair holding the message ID and its success flag
+		 * @return true If a result was available and written to @c _result
+		 * @return false If the return value stack was empty
+		 */
+		bool PopResult(std::pair<int, bool>& _result);
+
+		/**
+		 * @brief Returns the number of pending results on the return value stack
+		 *
+		 * @return std::size_t Count of results not yet popped
+		 */
+		std::size_t ResultsAvailable();
+
+		/**
+		 * @brief Process the given (serialized) message
+		 * 
+		 * This is where the work is done in the worker class.
+		 * 
+		 * @param _msg Serialized message (array of bytes, i.e. void*)
+		 * @param _size Number of bytes in the serialized message in @c _msg
+		 * @param _result Result data serving as a return from the procedure
+		 * @param _rsize Size of the result message (optional); when called
+		 * with a @c WorkItem::result it is 0 on entry and must be set to the
+		 * bytes written, at most @c ResultCapacity()
+		 * @return int Unique ID of the message processed
+		 */
+		virtual int ProcessMessage(const void* _msg, std::uint32_t _size, void* _result = nullptr, std::uint32_t* _rsize = nullptr) = 0;
+
+		/**
+		 * @brief Gets the room at @c _result for the message being processed
+		 * 
+		 * For use from @c ProcessMessage , on the thread calling it.
+		 * 
+		 * @return std::uint32_t Bytes that may be written at @c _result ; 0 if there is no result buffer
+		 */
+		static std::uint32_t ResultCapacity();
+
+		/**
+		 * @brief Gets a key identifying the given (serialized) message
+		 * 
+		 * Used to recognise duplicates of a message that came without an
+		 * AMQP message ID, when the "dedup" config sets "bodyKeys"; the
+		 * key is then scoped by the queue the message came from. It must
+		 * tell apart every two messages that are not duplicates, so not a
+		 * field that has a default. Called on the IO thread, so keep it
+		 * cheap.
+		 * 
+		 * @param _msg Serialized message (array of bytes, i.e. void*)
+		 * @param _size Number of bytes in the serialized message in @c _msg
+		 * @return std::string Key of the message; empty (the default) if it has none
+		 */
+		virtual std::string MessageKey(const void* _msg, std::uint32_t _size) const;
+
+		/**
+		 * @brief Contains the main work loop
+		 * 
+		 * Contains the main work loop in which @c ProcessMessage is called
+		 * until @c _data is exhausted.
+		 * 
+		 */
+		virtual void operator()();
+
+	protected:
+		FairQueue _data; ///< Queue of messages, by class
+		std::mutex _data_lock; ///< Mutex lock for the @c _data queue
+		std::deque<std::pair<int, bool>> _results; ///< Stack of processed message results (ID, success)
+		std::mutex _results_lock; ///< Mutex lock for the @c _results stack
+		std::vector<std::thread> _threads; ///< All of the threads running on the worker
+		std::shared_ptr<spdlog::logger> _logger = nullptr;
+		std::unique_ptr<LogSampler> _logSampler; ///< Picks the per-message lines logged
+		std::shared_ptr<Tracer> _tracer; ///< Where the stages of messages are recorded, if anywhere
+
+		/**
+		 * @brief Creates the series this object records into
+		 * 
+		 * Called from @c SetMetrics with @c _data_lock held; subclasses which
+		 * do no processing of their own record something else instead.
+		 * 
+		 * @param _registry Registry to create them in
+		 */
+		virtual void _registerMetrics(MetricsRegistry& _registry);
+
+	private:
+		struct WorkerMetrics
+		{
+			Gauge* waiting = nullptr;
+			Gauge* inFlight = nullptr;
+			Counter* processed = nullptr;
+			Counter* failed = nullptr;
+			Histogram* queueWait = nullptr;
+			Histogram* processing = nullptr;
+		};
+
+		void _runTiles(const kernels::ImageView& _image, std::size_t _tileBytes, const std::function<void(std::size_t)>& _prepare, const std::function<void(std::size_t, const Tile&)>& _kernel);
+		static void _decode(WorkItem& _item);
+		static std::string _memoKey(const void* _msg, std::uint32_t _size);
+		bool _recall(const std::string& _entry, WorkItem& _item, int& _msgId) const;
+		static std::string _memoEntry(int _msgId, const WorkItem& _item);
+
+		std::unique_ptr<DedupCache> _memo; ///< Results by body hash, if memoizing
+		std::shared_ptr<TileExecutor> _tiles; ///< Where tiles run; idle threads help with it
+		std::shared_ptr<MetricsRegistry> _metrics; ///< Where metrics are recorded, if anywhere
+		std::unique_ptr<WorkerMetrics> _stats; ///< This worker's series in @c _metrics
+		unsigned int _id; ///< Unique ID of the worker
+		std::string _name = "IWorker"; ///< Name assigned to the worker
+		std::atomic<WorkerState> _state; ///< State of the worker; 0 -> Ready
+	};
+}
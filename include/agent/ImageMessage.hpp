@@ -0,0 +1,325 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <optional>
+
+#include <flatbuffers/flatbuffers.h>
+
+#include "Kernels.hpp"
+#include "PixelCodec.hpp"
+#include "BufferPool.hpp"
+#include "Message_generated.h"
+
+namespace agent
+{
+	/**
+	 * @brief Read-only run of samples inside a message
+	 *
+	 * @tparam T Sample type
+	 */
+	template <typename T>
+	struct Samples
+	{
+		const T* data = nullptr; ///< First sample
+		std::size_t size = 0; ///< Number of samples
+
+		const T* begin() const { return data; }
+		const T* end() const { return data + size; }
+		bool empty() const { return size == 0; }
+		const T& operator[](std::size_t _i) const { return data[_i]; }
+	};
+
+	/**
+	 * @brief Typed view of an image @c Messages::Message , without copies
+	 *
+	 * Fills in what older senders leave out: a message with only @c pixels
+	 * reads as packed 8-bit samples, with as many channels as fit. Samples
+	 * of the newer data fields are aligned to @c Alignment within the
+	 * buffer, and so in memory when the buffer is, as pooled ones are.
+	 */
+	class ImageMessage
+	{
+	public:
+		static constexpr std::size_t Alignment = 64; ///< Alignment of the data fields
+
+		/**
+		 * @brief Construct a new ImageMessage object
+		 *
+		 * @param __message The deserialized message; must outlive this view
+		 */
+		explicit ImageMessage(const Messages::Message* __message);
+
+		/**
+		 * @brief Verifies a serialized message and views it
+		 *
+		 * @param _msg Serialized message
+		 * @param _size Number of bytes at @c _msg
+		 * @return ImageMessage View of the message
+		 * @throw std::invalid_argument If the bytes are not a valid message
+		 */
+		static ImageMessage Of(const void* _msg, std::size_t _size);
+
+		/**
+		 * @brief Gets the message itself, for fields not covered here
+		 *
+		 * @return const Messages::Message* The message
+		 */
+		const Messages::Message* Raw() const;
+
+		std::uint32_t Id() const; ///< Gets the message ID
+		std::uint32_t Width() const; ///< Gets the pixels per row
+		std::uint32_t Height() const; ///< Gets the number of rows
+
+		/**
+		 * @brief Gets the pixel format
+		 *
+		 * @return Messages::PixelFormat The format; @c Unknown if not sent
+		 */
+		Messages::PixelFormat Format() const;
+
+		/**
+		 * @brief Gets the samples per pixel
+		 *
+		 * @return std::uint32_t As sent, else as the format implies, else as many as fit
+		 */
+		std::uint32_t Channels() const;
+
+		/**
+		 * @brief Gets the size of one sample
+		 *
+		 * @return std::size_t 1, 2 or 4 bytes
+		 */
+		std::size_t SampleBytes() const;
+
+		/**
+		 * @brief Gets the distance from one row to the next
+		 *
+		 * @return std::size_t Bytes per row, padding included
+		 */
+		std::size_t Stride() const;
+
+		/**
+		 * @brief Gets the samples of the whole image
+		 *
+		 * @c std::uint8_t reads @c data_u8 , or @c pixels from older senders;
+		 * @c std::uint16_t reads @c data_u16 and @c float reads @c data_f32 .
+		 *
+		 * @tparam T Sample type
+		 * @return Samples<T> The samples; empty if the message has none of this type
+		 */
+		template <typename T>
+		Samples<T> Data() const;
+
+		/**
+		 * @brief Gets the first sample of a row
+		 *
+		 * @tparam T Sample type
+		 * @param _y Row number
+		 * @return const T* The row, @c Stride() bytes after the one above
+		 */
+		template <typename T>
+		const T* Row(std::uint32_t _y) const
+		{
+			return reinterpret_cast<const T*>(reinterpret_cast<const std::uint8_t*>(Data<T>().data) + _y * Stride());
+		}
+
+		/**
+		 * @brief Views 8-bit samples for the kernels in Kernels.hpp
+		 *
+		 * @return kernels::ImageView The view; empty if there are no samples
+		 * @throw std::invalid_argument If the samples are coded or wider than 8 bits, rows are padded, or some are missing
+		 */
+		kernels::ImageView View() const;
+
+		/**
+		 * @brief Gets how the samples are coded
+		 *
+		 * @return Messages::PixelEncoding @c Raw unless they must be decoded before use
+		 */
+		Messages::PixelEncoding Encoding() const;
+
+		/**
+		 * @brief Gets the coded samples, for decoding in pieces
+		 *
+		 * @return kernels::CodedImage The coded image; empty if the samples are not coded
+		 * @throw std::invalid_argument If there is not an offset for every row
+		 */
+		kernels::CodedImage Coded() const;
+
+		/**
+		 * @brief Decodes a band of rows of coded samples
+		 *
+		 * Lets each tile of a coded image be decoded where it is processed,
+		 * e.g. in @c IWorker::ForEachTile , instead of all of it up front.
+		 *
+		 * @param _y First row wanted
+		 * @param _count Number of rows wanted
+		 * @param _out Room for @c _count rows of packed samples
+		 * @return kernels::ImageView The decoded rows
+		 * @throw std::invalid_argument If the samples are not coded, or are malformed
+		 */
+		kernels::ImageView Decode(std::uint32_t _y, std::uint32_t _count, std::uint8_t* _out) const;
+
+		/**
+		 * @brief Decodes the whole image into a pooled block
+		 *
+		 * @param _pool Pool to take the block from, e.g. one the worker keeps
+		 * @param _into Set to the block; the view is valid for as long as it is kept
+		 * @return kernels::ImageView The decoded image
+		 * @throw std::invalid_argument If the samples are not coded, or are malformed
+		 */
+		kernels::ImageView Decode(BufferPool& _pool, PooledBuffer& _into) const;
+
+		/**
+		 * @brief Whether the samples start on an @c Alignment boundary in memory
+		 *
+		 * @return true If aligned loads may be used on them
+		 */
+		bool Aligned() const;
+
+		/**
+		 * @brief Gets the region of interest
+		 *
+		 * @return std::optional<Messages::Region> The region, if one was sent
+		 */
+		std::optional<Messages::Region> Roi() const;
+
+		/**
+		 * @brief Gets the number of tiles the image was sent in
+		 *
+		 * @return std::size_t Tiles; 0 if it was sent whole
+		 */
+		std::size_t TileCount() const;
+
+		/**
+		 * @brief Gets one tile of the image
+		 *
+		 * @param _i Tile number
+		 * @return const Messages::ImageTile* The tile; its samples are read as the message's are
+		 */
+		const Messages::ImageTile* TileAt(std::size_t _i) const;
+
+		/**
+		 * @brief Gets when the image was captured
+		 *
+		 * @return std::optional<std::chrono::system_clock::time_point> The time, if sent
+		 */
+		std::optional<std::chrono::system_clock::time_point> Captured() const;
+
+	private:
+		const Messages::Message* _message; ///< The message viewed
+	};
+
+	/**
+	 * @brief Fields of a batch of image messages, one array per field
+	 *
+	 * Reading a field of a message goes through its root offset, table and
+	 * vtable, and with messages spread over many buffers every step can be
+	 * a cache miss. @c Extract reads a batch in one pass, prefetching the
+	 * messages a few ahead, so handlers can then run over contiguous
+	 * arrays instead, vectorized where it pays. Row @c i of every array is
+	 * the same message.
+	 *
+	 * Reuse one across batches: @c Clear keeps the arrays' memory.
+	 */
+	struct ImageColumns
+	{
+		std::vector<std::uint32_t> index; ///< Position of each message in the batch given
+		std::vector<std::uint32_t> ids; ///< As @c ImageMessage::Id
+		std::vector<std::uint32_t> widths; ///< As @c ImageMessage::Width
+		std::vector<std::uint32_t> heights; ///< As @c ImageMessage::Height
+		std::vector<std::uint32_t> channels; ///< As @c ImageMessage::Channels
+		std::vector<Samples<std::uint8_t>> pixels; ///< As @c ImageMessage::Data<std::uint8_t>
+		std::size_t rejected = 0; ///< Messages left out for failing verification
+
+		/**
+		 * @brief Reads the fields of a batch of messages onto the ends of the arrays
+		 *
+		 * The messages must outlive the pixel spans taken from them.
+		 *
+		 * @param _messages Serialized messages
+		 * @param _sizes Number of bytes in each message
+		 * @param _count Number of messages
+		 * @param _verify Whether to verify each message first, leaving out any that fail
+		 * @return std::size_t Number of rows added
+		 */
+		std::size_t Extract(const void* const* _messages, const std::uint32_t* _sizes, std::size_t _count, bool _verify = true);
+
+		/**
+		 * @brief Gets the number of rows
+		 *
+		 * @return std::size_t Messages read since the last @c Clear
+		 */
+		std::size_t Size() const { return ids.size(); }
+
+		/**
+		 * @brief Empties the arrays, keeping their memory
+		 *
+		 */
+		void Clear();
+	};
+
+	template <> Samples<std::uint8_t> ImageMessage::Data<std::uint8_t>() const;
+	template <> Samples<std::uint16_t> ImageMessage::Data<std::uint16_t>() const;
+	template <> Samples<float> ImageMessage::Data<float>() const;
+
+	/**
+	 * @brief Gets the samples per pixel of a format
+	 *
+	 * @param _format The format
+	 * @return std::uint32_t Channels; 0 for @c Unknown
+	 */
+	std::uint32_t FormatChannels(Messages::PixelFormat _format);
+
+	/**
+	 * @brief Gets the sample size of a format
+	 *
+	 * @param _format The format
+	 * @return std::size_t Bytes per sample; 0 for @c Unknown
+	 */
+	std::size_t FormatSampleBytes(Messages::PixelFormat _format);
+
+	/**
+	 * @brief Writes a vector of samples aligned for SIMD
+	 *
+	 * For the data fields of a message or tile when not using the
+	 * generated @c Create...Direct functions, which align them already.
+	 *
+	 * @tparam T Sample type
+	 * @param _builder Builder of the message
+	 * @param _data Samples to write
+	 * @param _count Number of samples
+	 * @return flatbuffers::Offset<flatbuffers::Vector<T>> The vector
+	 */
+	template <typename T>
+	flatbuffers::Offset<flatbuffers::Vector<T>> CreateAlignedVector(flatbuffers::FlatBufferBuilder& _builder, const T* _data, std::size_t _count)
+	{
+		_builder.ForceVectorAlignment(_count, sizeof(T), ImageMessage::Alignment);
+		return _builder.CreateVector(_data, _count);
+	}
+
+	/**
+	 * @brief Coded samples of an image, to add to a message
+	 *
+	 */
+	struct CodedSamples
+	{
+		flatbuffers::Offset<flatbuffers::Vector<std::uint8_t>> bytes; ///< For @c encoded
+		flatbuffers::Offset<flatbuffers::Vector<std::uint32_t>> rows; ///< For @c encoded_rows
+	};
+
+	/**
+	 * @brief Codes the samples of an image with @c kernels::EncodeDeltaRle
+	 *
+	 * Add both to the message with @c encoding set to @c DeltaRle , and its
+	 * @c format or @c channels , which the coded bytes do not imply.
+	 *
+	 * @param _builder Builder of the message
+	 * @param _image The image
+	 * @return CodedSamples The coded samples
+	 */
+	CodedSamples CreateCodedSamples(flatbuffers::FlatBufferBuilder& _builder, const kernels::ImageView& _image);
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+namespace agent
+{
+	/**
+	 * @brief Image kernels that work on message pixels in place
+	 *
+	 * Every kernel reads straight out of the received buffer through an
+	 * @c ImageView and writes, where it writes at all, to memory the caller
+	 * provides, such as a pooled buffer or the result buffer handed to
+	 * @c IWorker::ProcessMessage . Pixels are unsigned 8-bit samples with
+	 * the channels of each pixel next to each other.
+	 *
+	 * The inner loops come in SSE2, AVX2 and AVX-512 versions besides plain
+	 * C++; the best one this CPU supports is picked the first time a kernel
+	 * runs, and @c UseIsa can turn it down.
+	 */
+	namespace kernels
+	{
+		/**
+		 * @brief Instruction sets the kernels have versions for
+		 *
+		 */
+		enum class Isa
+		{
+			SCALAR, ///< Plain C++
+			SSE2, ///< 16 bytes at a time
+			AVX2, ///< 32 bytes at a time
+			AVX512 ///< 64 bytes at a time, with AVX-512BW
+		};
+
+		/**
+		 * @brief Gets the best instruction set this CPU supports
+		 *
+		 * @return Isa The instruction set
+		 */
+		Isa BestIsa();
+
+		/**
+		 * @brief Gets the instruction set the kernels are using
+		 *
+		 * @return Isa The instruction set
+		 */
+		Isa CurrentIsa();
+
+		/**
+		 * @brief Chooses the instruction set the kernels use, for every thread
+		 *
+		 * @param _isa The instruction set wanted
+		 * @return Isa The one chosen: @c _isa , or the best supported if lower
+		 */
+		Isa UseIsa(Isa _isa);
+
+		/**
+		 * @brief Gets the name of an instruction set, for logging
+		 *
+		 * @param _isa The instruction set
+		 * @return const char* Its name
+		 */
+		const char* IsaName(Isa _isa);
+
+		/**
+		 * @brief Non-owning view of the pixels of an image
+		 *
+		 */
+		struct ImageView
+		{
+			const std::uint8_t* pixels = nullptr; ///< First sample, top left
+			std::uint32_t width = 0; ///< Pixels per row
+			std::uint32_t height = 0; ///< Number of rows
+			std::uint32_t channels = 1; ///< Samples per pixel: 1 gray, 3 RGB, 4 RGBA
+
+			/**
+			 * @brief Gets the number of samples in the image
+			 *
+			 * @return std::size_t Width times height times channels
+			 */
+			std::size_t Size() const
+			{
+				return static_cast<std::size_t>(width) * height * channels;
+			}
+
+			/**
+			 * @brief Views the pixels of a deserialized message
+			 *
+			 * Works on @c Messages::Message and on any table of your own
+			 * with the same @c width , @c height and @c pixels fields. The
+			 * number of channels is however many samples each pixel has.
+			 *
+			 * @tparam Message Table type
+			 * @param _message The message
+			 * @return ImageView View into the message's buffer; empty if it has no pixels
+			 * @throw std::invalid_argument If the pixels do not fill width times height
+			 */
+			template <typename Message>
+			static ImageView Of(const Message& _message)
+			{
+				ImageView view;
+				const auto* pixels = _message.pixels();
+				if (pixels == nullptr || pixels->size() == 0)
+					return view;
+
+				const std::size_t area = static_cast<std::size_t>(_message.width()) * _message.height();
+				if (area == 0 || pixels->size() % area != 0)
+					throw std::invalid_argument("Pixels do not fill a width by height image");
+
+				view.pixels = reinterpret_cast<const std::uint8_t*>(pixels->data());
+				view.width = _message.width();
+				view.height = _message.height();
+				view.channels = static_cast<std::uint32_t>(pixels->size() / area);
+				return view;
+			}
+		};
+
+		/**
+		 * @brief Smallest and largest sample of an image
+		 *
+		 */
+		struct PixelRange
+		{
+			std::uint8_t min = 0; ///< Smallest sample
+			std::uint8_t max = 0; ///< Largest sample
+		};
+
+		/**
+		 * @brief Adds up every sample
+		 *
+		 * @param _image The image
+		 * @return std::uint64_t Sum over all channels
+		 */
+		std::uint64_t Sum(const ImageView& _image);
+
+		/**
+		 * @brief Averages every sample
+		 *
+		 * @param _image The image
+		 * @return double Mean over all channels; 0 for an empty image
+		 */
+		double Mean(const ImageView& _image);
+
+		/**
+		 * @brief Counts the samples of each value
+		 *
+		 * @param _image The image
+		 * @return std::array<std::uint64_t, 256> Count of each value, over all channels
+		 */
+		std::array<std::uint64_t, 256> Histogram(const ImageView& _image);
+
+		/**
+		 * @brief Finds the smallest and largest sample
+		 *
+		 * @param _image The image
+		 * @return PixelRange The range; both 0 for an empty image
+		 */
+		PixelRange MinMax(const ImageView& _image);
+
+		/**
+		 * @brief Sets samples above a level to 255 and the rest to 0
+		 *
+		 * @param _image The image
+		 * @param _level Highest value set to 0
+		 * @param _out Room for @c _image.Size() bytes; may be @c _image.pixels
+		 */
+		void Threshold(const ImageView& _image, std::uint8_t _level, std::uint8_t* _out);
+
+		/**
+		 * @brief Limits samples to a range
+		 *
+		 * @param _image The image
+		 * @param _min Smallest value kept
+		 * @param _max Largest value kept
+		 * @param _out Room for @c _image.Size() bytes; may be @c _image.pixels
+		 */
+		void Clamp(const ImageView& _image, std::uint8_t _min, std::uint8_t _max, std::uint8_t* _out);
+
+		/**
+		 * @brief Averages each sample with its neighbours in a square
+		 *
+		 * Separable, with edges extended; the cost grows with the radius,
+		 * so keep it small.
+		 *
+		 * @param _image The image
+		 * @param _radius Pixels either side to average over, at most 127
+		 * @param _out Room for @c _image.Size() bytes; not @c _image.pixels
+		 * @throw std::invalid_argument If the radius is over 127
+		 */
+		void BoxBlur(const ImageView& _image, std::uint32_t _radius, std::uint8_t* _out);
+
+		/**
+		 * @brief Smooths with a 5 by 5 binomial approximation of a Gaussian
+		 *
+		 * Weights 1 4 6 4 1 in each direction, sigma about 1, edges extended.
+		 *
+		 * @param _image The image
+		 * @param _out Room for @c _image.Size() bytes; not @c _image.pixels
+		 */
+		void GaussianBlur(const ImageView& _image, std::uint8_t* _out);
+
+		/**
+		 * @brief Halves the width and height by averaging blocks of 2 by 2 pixels
+		 *
+		 * An odd last row or column is dropped.
+		 *
+		 * @param _image The image
+		 * @param _out Room for (width / 2) * (height / 2) * channels bytes
+		 */
+		void Downsample(const ImageView& _image, std::uint8_t* _out);
+
+		/**
+		 * @brief Converts between gray, RGB and RGBA
+		 *
+		 * Gray from colour uses the BT.601 luma weights; added alpha is opaque.
+		 *
+		 * @param _image The image
+		 * @param _channels Channels wanted: 1, 3 or 4
+		 * @param _out Room for width * height * @c _channels bytes
+		 * @throw std::invalid_argument If either side is not gray, RGB or RGBA
+		 */
+		void Convert(const ImageView& _image, std::uint32_t _channels, std::uint8_t* _out);
+	}
+}
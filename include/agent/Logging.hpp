@@ -0,0 +1,128 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include <json/json.h>
+#include <spdlog/spdlog.h>
+
+namespace agent
+{
+	/**
+	 * @brief How the loggers of workers and connections write
+	 *
+	 * Synchronous loggers format and write each line on the thread
+	 * logging it, under the console's lock. Asynchronous ones only format
+	 * it and hand it to a queue, which background threads write out; when
+	 * the queue is full the oldest line is dropped, or, with @c block ,
+	 * the logging thread waits for room.
+	 */
+	struct LogPolicy
+	{
+		bool async = false; ///< Whether lines are written by background threads
+		std::size_t queueSize = AGENT_LOG_QUEUE_SIZE; ///< Lines the asynchronous queue holds
+		std::size_t threads = 1; ///< Background threads writing the queue out
+		bool block = false; ///< Whether a full queue makes loggers wait rather than drop its oldest line
+		std::uint32_t sampleEvery = AGENT_LOG_SAMPLE_EVERY; ///< Per-message lines logged: one in this many, 0 for none
+		std::string level = "info"; ///< Least severe level logged, e.g. @c debug or @c warn
+
+		/**
+		 * @brief Reads a policy from the @c logging section of a configuration
+		 *
+		 * @param _config The @c logging object; missing keys keep their defaults
+		 * @return LogPolicy The policy described
+		 */
+		static LogPolicy FromJson(const Json::Value& _config);
+	};
+
+	/**
+	 * @brief Sets how loggers created from now on write
+	 *
+	 * Process-wide; call once at startup, before any worker or connection
+	 * is created, since loggers already made keep their way of writing.
+	 * The level applies to existing loggers too.
+	 *
+	 * @param _policy The policy
+	 */
+	void ConfigureLogging(const LogPolicy& _policy);
+
+	/**
+	 * @brief Sets how loggers write from the @c logging section of a configuration
+	 *
+	 * Nothing else reads that section, so an application reading e.g.
+	 * @c client.json calls this first thing, before it creates any worker
+	 * or connection, as those make their loggers when constructed.
+	 *
+	 * @param _config The whole configuration; without a @c logging object the defaults apply
+	 */
+	void ConfigureLogging(const Json::Value& _config);
+
+	/**
+	 * @brief Gets the logger of a name, creating it the first time
+	 *
+	 * Created synchronous or asynchronous as @c ConfigureLogging last said,
+	 * writing to the console in colour.
+	 *
+	 * @param _name Name of the logger
+	 * @return std::shared_ptr<spdlog::logger> The logger
+	 */
+	std::shared_ptr<spdlog::logger> GetLogger(const std::string& _name);
+
+	/**
+	 * @brief Picks which of a stream of events get logged
+	 *
+	 * For lines logged once per message, which at tens of thousands of
+	 * messages a second cost more than the messages do:
+	 * @code
+	 * if (_sampler.Sample())
+	 *     _logger->info("Successfully processed message {}", msgId);
+	 * @endcode
+	 * With sampling off the counters of a @c MetricsRegistry say how many
+	 * there were instead.
+	 */
+	class LogSampler
+	{
+	public:
+		/**
+		 * @brief Construct a new LogSampler object, sampling as @c ConfigureLogging last said
+		 *
+		 */
+		LogSampler();
+
+		/**
+		 * @brief Construct a new LogSampler object
+		 *
+		 * @param __every Events logged: one in this many, 0 for none
+		 */
+		explicit LogSampler(std::uint32_t __every);
+
+		/**
+		 * @brief Counts an event, saying whether to log it
+		 *
+		 * @return true For the first event and every @c Every() th after it
+		 */
+		bool Sample();
+
+		/**
+		 * @brief Sets how many events there are to each one logged
+		 *
+		 * @param __every Events logged: one in this many, 0 for none
+		 */
+		void SetEvery(std::uint32_t __every);
+
+		/**
+		 * @brief Gets how many events there are to each one logged
+		 *
+		 * @return std::uint32_t One in this many is logged; 0 for none
+		 */
+		std::uint32_t Every() const;
+
+	private:
+		std::atomic<std::uint64_t> _events{0}; ///< Events counted
+		std::atomic<std::uint32_t> _every; ///< One in this many is logged; 0 for none
+	};
+}
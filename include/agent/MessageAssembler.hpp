@@ -0,0 +1,78 @@
+#pragma once
+
+#include "BufferPool.hpp"
+
+#include <memory>
+#include <cstdint>
+
+namespace agent
+{
+	/**
+	 * @brief Collects the body frames of one AMQP delivery into a pooled buffer
+	 *
+	 * Driven from the consumer's per-frame callbacks: @c Begin with the body
+	 * size announced in the content header, @c Append for every body frame,
+	 * and @c Finish once the delivery is complete. Each frame is copied
+	 * exactly once, straight from the connection's input buffer into a block
+	 * sized for the whole body, and the block is then handed on without
+	 * further copies.
+	 */
+	class MessageAssembler
+	{
+	public:
+		/**
+		 * @brief Construct a new MessageAssembler object
+		 *
+		 * @param _pool Pool to borrow message buffers from
+		 */
+		MessageAssembler(std::shared_ptr<BufferPool> _pool);
+
+		/**
+		 * @brief Starts a new message, discarding any unfinished one
+		 *
+		 * @param _size Total body size from the content header
+		 */
+		void Begin(std::uint64_t _size);
+
+		/**
+		 * @brief Appends one body frame
+		 *
+		 * @param _data Pointer to the frame payload
+		 * @param _size Number of bytes in the frame
+		 */
+		void Append(const char* _data, std::size_t _size);
+
+		/**
+		 * @brief Completes the message and hands over its buffer
+		 *
+		 * @return PooledBuffer Buffer holding exactly the bytes appended
+		 */
+		PooledBuffer Finish();
+
+		/**
+		 * @brief Drops any unfinished message
+		 *
+		 */
+		void Reset();
+
+		/**
+		 * @brief Whether a message has been started but not finished
+		 *
+		 * @return true If between @c Begin and @c Finish
+		 */
+		bool Active() const;
+
+		/**
+		 * @brief Gets the number of body bytes received so far
+		 *
+		 * @return std::size_t Bytes appended since @c Begin
+		 */
+		std::size_t Received() const;
+
+	private:
+		std::shared_ptr<BufferPool> _pool; ///< Where message buffers come from
+		PooledBuffer _current; ///< Buffer for the message being received
+		std::size_t _received = 0; ///< Bytes appended to @c _current
+		bool _active = false; ///< Set between @c Begin and @c Finish
+	};
+}
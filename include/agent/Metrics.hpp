@@ -0,0 +1,232 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <map>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+namespace agent
+{
+	/**
+	 * @brief Labels of a series, as name and value pairs, e.g. @c {{"worker", "Resizer"}}
+	 *
+	 */
+	using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+	/**
+	 * @brief A count that only goes up, e.g. of messages processed
+	 *
+	 * Each thread adds to a slot of its own, a cache line apart from the
+	 * others, so threads counting at once do not contend; the slots are
+	 * only summed when the value is read.
+	 */
+	class Counter
+	{
+	public:
+		/**
+		 * @brief Adds to the count
+		 *
+		 * @param _n Amount to add
+		 */
+		void Add(std::uint64_t _n = 1);
+
+		/**
+		 * @brief Gets the count
+		 *
+		 * @return std::uint64_t Sum of every thread's additions
+		 */
+		std::uint64_t Value() const;
+
+	private:
+		struct alignas(64) Slot
+		{
+			std::atomic<std::uint64_t> value{0};
+		};
+
+		std::array<Slot, AGENT_METRICS_SLOTS> _slots; ///< One per thread; threads beyond @c AGENT_METRICS_SLOTS share
+	};
+
+	/**
+	 * @brief A value that goes up and down, e.g. messages waiting
+	 *
+	 */
+	class Gauge
+	{
+	public:
+		/**
+		 * @brief Sets the value
+		 *
+		 * @param __value New value
+		 */
+		void Set(std::int64_t __value);
+
+		/**
+		 * @brief Adds to the value
+		 *
+		 * @param _n Amount to add; negative to subtract
+		 */
+		void Add(std::int64_t _n);
+
+		/**
+		 * @brief Gets the value
+		 *
+		 * @return std::int64_t The value
+		 */
+		std::int64_t Value() const;
+
+	private:
+		alignas(64) std::atomic<std::int64_t> _value{0}; ///< On a line of its own
+	};
+
+	/**
+	 * @brief Counts observations, e.g. latencies, into buckets
+	 *
+	 * Like @c Counter , each thread records into cells of its own: a count
+	 * per bucket, one for observations above the last bound and their sum.
+	 * Recording is a search of the bounds and two uncontended atomic
+	 * additions.
+	 */
+	class Histogram
+	{
+	public:
+		/**
+		 * @brief Construct a new Histogram object
+		 *
+		 * @param __bounds Upper bounds of the buckets, ascending
+		 * @throw std::invalid_argument If the bounds are not ascending
+		 */
+		explicit Histogram(std::vector<double> __bounds = LatencyBounds());
+
+		/**
+		 * @brief Records an observation
+		 *
+		 * @param _value The value observed
+		 */
+		void Observe(double _value);
+
+		/**
+		 * @brief Records a duration, in seconds
+		 *
+		 * @param _elapsed The duration observed
+		 */
+		void Observe(std::chrono::steady_clock::duration _elapsed);
+
+		/**
+		 * @brief Gets the upper bounds of the buckets
+		 *
+		 * @return const std::vector<double>& Bounds, ascending
+		 */
+		const std::vector<double>& Bounds() const;
+
+		/**
+		 * @brief Gets the number of observations in each bucket
+		 *
+		 * @return std::vector<std::uint64_t> One count per bound, of the observations up to it and above the bound before, then one of those above the last
+		 */
+		std::vector<std::uint64_t> Counts() const;
+
+		/**
+		 * @brief Gets the sum of the observations
+		 *
+		 * @return double The sum
+		 */
+		double Sum() const;
+
+		/**
+		 * @brief Gets bounds suiting latencies, from 50 us to 10 s
+		 *
+		 * @return std::vector<double> Bounds, in seconds
+		 */
+		static std::vector<double> LatencyBounds();
+
+	private:
+		struct alignas(64) Line
+		{
+			std::atomic<std::uint64_t> cells[8];
+		};
+
+		std::atomic<std::uint64_t>& _cell(std::size_t _slot, std::size_t _index) const;
+
+		std::vector<double> _bounds; ///< Upper bounds of the buckets
+		std::size_t _lines; ///< Cache lines per slot: the buckets, the overflow and the sum
+		std::unique_ptr<Line[]> _cells; ///< Every slot's cells, slot after slot
+	};
+
+	/**
+	 * @brief Named metrics of one or more workers and connections
+	 *
+	 * Metrics are looked up once, by name and labels, and then updated
+	 * through the reference returned, which stays valid for as long as the
+	 * registry; only the lookup and @c Render take the registry's lock.
+	 * Workers and connections record into the one given to
+	 * @c IWorker::SetMetrics , which several may share, their series told
+	 * apart by their labels.
+	 */
+	class MetricsRegistry
+	{
+	public:
+		/**
+		 * @brief Gets a counter, creating it the first time
+		 *
+		 * @param _name Name, e.g. @c agent_messages_processed_total
+		 * @param _help Description of the metric
+		 * @param _labels Labels telling this series from the others of the name
+		 * @return Counter& The counter
+		 * @throw std::invalid_argument If the name is malformed or used for another type
+		 */
+		Counter& GetCounter(const std::string& _name, const std::string& _help, const MetricLabels& _labels = {});
+
+		/**
+		 * @brief Gets a gauge, creating it the first time
+		 *
+		 * @param _name Name, e.g. @c agent_messages_waiting
+		 * @param _help Description of the metric
+		 * @param _labels Labels telling this series from the others of the name
+		 * @return Gauge& The gauge
+		 * @throw std::invalid_argument If the name is malformed or used for another type
+		 */
+		Gauge& GetGauge(const std::string& _name, const std::string& _help, const MetricLabels& _labels = {});
+
+		/**
+		 * @brief Gets a histogram, creating it the first time
+		 *
+		 * @param _name Name, e.g. @c agent_processing_seconds
+		 * @param _help Description of the metric
+		 * @param _labels Labels telling this series from the others of the name
+		 * @param _bounds Upper bounds of the buckets, if it is created
+		 * @return Histogram& The histogram
+		 * @throw std::invalid_argument If the name is malformed or used for another type
+		 */
+		Histogram& GetHistogram(const std::string& _name, const std::string& _help, const MetricLabels& _labels = {}, const std::vector<double>& _bounds = Histogram::LatencyBounds());
+
+		/**
+		 * @brief Writes every metric out in the Prometheus text format
+		 *
+		 * @return std::string The exposition, version 0.0.4
+		 */
+		std::string Render() const;
+
+	private:
+		struct Family
+		{
+			std::string help;
+			std::string type;
+			std::map<std::string, std::unique_ptr<Counter>> counters; ///< By rendered labels
+			std::map<std::string, std::unique_ptr<Gauge>> gauges; ///< By rendered labels
+			std::map<std::string, std::unique_ptr<Histogram>> histograms; ///< By rendered labels
+		};
+
+		Family& _family(const std::string& _name, const std::string& _help, const char* _type);
+
+		std::map<std::string, Family> _families; ///< By name
+		mutable std::mutex _lock; ///< Mutex lock for @c _families
+	};
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include <Poco/Net/HTTPServer.h>
+
+#include "Metrics.hpp"
+#include "Tracer.hpp"
+
+namespace agent
+{
+	/**
+	 * @brief Serves a @c MetricsRegistry to Prometheus over HTTP
+	 *
+	 * Answers @c GET @c /metrics with the registry rendered in the text
+	 * format, from threads of its own; nothing is computed between
+	 * scrapes. Given a @c Tracer too, answers @c GET @c /trace with what it
+	 * has recorded, as Chrome trace JSON. Listens from construction until
+	 * destroyed.
+	 */
+	class MetricsServer
+	{
+	public:
+		/**
+		 * @brief Construct a new MetricsServer object and start listening
+		 *
+		 * @param __registry The metrics to serve
+		 * @param _address Address to listen on; the loopback one keeps the metrics local
+		 * @param _port Port to listen on; 0 for any free one
+		 * @param __tracer Traces to serve too, if any
+		 * @throw Poco::Exception If the address cannot be listened on
+		 */
+		MetricsServer(std::shared_ptr<const MetricsRegistry> __registry, const std::string& _address = "127.0.0.1", std::uint16_t _port = AGENT_METRICS_PORT, std::shared_ptr<const Tracer> __tracer = nullptr);
+
+		/**
+		 * @brief Destroy the MetricsServer object, waiting for scrapes in progress
+		 *
+		 */
+		~MetricsServer();
+
+		MetricsServer(const MetricsServer&) = delete;
+		MetricsServer& operator=(const MetricsServer&) = delete;
+
+		/**
+		 * @brief Gets the port listened on
+		 *
+		 * @return std::uint16_t The port, e.g. the one picked when asked for 0
+		 */
+		std::uint16_t Port() const;
+
+	private:
+		std::shared_ptr<const MetricsRegistry> _registry; ///< The metrics served
+		std::shared_ptr<const Tracer> _tracer; ///< The traces served, if any
+		std::unique_ptr<Poco::Net::HTTPServer> _server; ///< Listening, and answering scrapes
+	};
+}
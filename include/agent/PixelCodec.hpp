@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+#include "Kernels.hpp"
+
+namespace agent
+{
+	namespace kernels
+	{
+		/**
+		 * @brief An image coded with @c EncodeDeltaRle
+		 *
+		 * Each row is coded on its own and @c rows says where it starts, so
+		 * any band of rows, e.g. one tile, decodes without the rest.
+		 */
+		struct CodedImage
+		{
+			const std::uint8_t* bytes = nullptr; ///< The coded rows, top first
+			std::size_t size = 0; ///< Number of bytes at @c bytes
+			const std::uint32_t* rows = nullptr; ///< Offset of each row in @c bytes , @c height of them
+			std::uint32_t width = 0; ///< Pixels per row
+			std::uint32_t height = 0; ///< Number of rows
+			std::uint32_t channels = 1; ///< Samples per pixel: 1 gray, 3 RGB, 4 RGBA
+		};
+
+		/**
+		 * @brief Gets the most bytes @c EncodeDeltaRle can write for an image
+		 *
+		 * @param _image The image
+		 * @return std::size_t Slightly over @c _image.Size() , for images that do not compress
+		 */
+		std::size_t MaxDeltaRleSize(const ImageView& _image);
+
+		/**
+		 * @brief Codes an image losslessly for smooth gradients and sparse masks
+		 *
+		 * Every sample is replaced by its difference from the same channel
+		 * of the pixel to its left, which is zero or close to it across
+		 * flat areas and gradients, and the differences are run-length
+		 * coded: a control byte below 128 is followed by that many plus one
+		 * differences as they are, one of 128 or more by a difference
+		 * repeated that many less 125 times.
+		 *
+		 * @param _image The image
+		 * @param _out Room for @c MaxDeltaRleSize(_image) bytes
+		 * @param _rows Room for @c _image.height offsets, set to where each row starts in @c _out
+		 * @return std::size_t Number of bytes written
+		 * @throw std::invalid_argument If the image is not gray, RGB or RGBA
+		 */
+		std::size_t EncodeDeltaRle(const ImageView& _image, std::uint8_t* _out, std::uint32_t* _rows);
+
+		/**
+		 * @brief Decodes a band of rows of a coded image
+		 *
+		 * @param _image The coded image
+		 * @param _y First row wanted
+		 * @param _count Number of rows wanted
+		 * @param _out Room for @c _count rows of packed samples
+		 * @throw std::invalid_argument If the rows are out of range or the bytes malformed
+		 */
+		void DecodeDeltaRle(const CodedImage& _image, std::uint32_t _y, std::uint32_t _count, std::uint8_t* _out);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <amqpcpp.h>
+#include <json/json.h>
+
+namespace agent
+{
+	/**
+	 * @brief One queue a worker consumes from, and how it is bound
+	 *
+	 * Each binding gets its own channel on the worker's connection, so
+	 * prefetch, consumer and acks are per binding. Its messages are queued
+	 * on the worker in a class of their own, weighted by @c weight .
+	 */
+	struct QueueBinding
+	{
+		std::string queue = "Queue"; ///< The queue to pull messages from
+		std::string exchange = "Exchange"; ///< The exchange to bind it to
+		std::string key = "Queue"; ///< The optional key
+		int queueFlags = 0; ///< Flags determining queue behavior
+		int exchangeFlags = 0; ///< Flags determining exchange behavior
+		AMQP::ExchangeType exchangeType = AMQP::ExchangeType::fanout; ///< What kind of exchange this is
+		std::uint16_t prefetch = 4; ///< The number of messages to prefetch
+		unsigned int weight = 1; ///< Share of the worker's processing its messages get
+
+		/**
+		 * @brief Reads one binding from a configuration object
+		 *
+		 * Takes the same keys as the @c settings section of @c client.json .
+		 * Keys left out keep the defaults above, except @c key , which
+		 * defaults to the queue name.
+		 *
+		 * @param _config Object holding the binding's settings
+		 * @return QueueBinding The binding described
+		 * @throw std::invalid_argument If it is not an object, names an unknown flag or exchange type, or has a prefetch or weight out of range
+		 */
+		static QueueBinding FromJson(const Json::Value& _config);
+
+		/**
+		 * @brief Reads every binding in a worker's configuration
+		 *
+		 * Uses the @c bindings list when present and not empty, otherwise
+		 * the single binding in @c settings .
+		 *
+		 * @param _config The whole worker configuration
+		 * @return std::vector<QueueBinding> The bindings, in order
+		 * @throw std::invalid_argument If @c bindings is not a list, or any binding is malformed
+		 */
+		static std::vector<QueueBinding> ListFromJson(const Json::Value& _config);
+	};
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <string>
+#include <chrono>
+
+#include <json/json.h>
+
+namespace agent
+{
+	/**
+	 * @brief How often, and how far apart, a failed message is tried again
+	 *
+	 * A message whose processing threw is parked in a delay queue for the
+	 * attempt it failed on; the queue's TTL holds it there and its
+	 * dead-letter settings route it back to the work queue afterwards, so
+	 * waiting never occupies a worker thread. After @c maxAttempts failures
+	 * it goes to the dead-letter queue instead.
+	 */
+	struct RetryPolicy
+	{
+		unsigned int maxAttempts = AGENT_RETRY_MAX_ATTEMPTS; ///< Attempts before dead-lettering; 1 means no retries
+		std::chrono::milliseconds initialDelay{AGENT_RETRY_INITIAL_MSEC}; ///< Delay after the first failure
+		std::chrono::milliseconds maxDelay{AGENT_RETRY_MAX_MSEC}; ///< Longest delay between attempts
+		double multiplier = 2.0; ///< Growth of the delay per attempt
+
+		/**
+		 * @brief Gets the delay after a failed attempt
+		 *
+		 * @param _attempt The attempt that failed, from 1
+		 * @return std::chrono::milliseconds Time to wait before the next one
+		 */
+		std::chrono::milliseconds Delay(unsigned int _attempt) const;
+
+		/**
+		 * @brief Name of the delay queue for an attempt
+		 *
+		 * @param _queue Work queue the message came from
+		 * @param _attempt The attempt that failed, from 1
+		 * @return std::string Name of the delay queue
+		 */
+		static std::string DelayQueue(const std::string& _queue, unsigned int _attempt);
+
+		/**
+		 * @brief Name of the dead-letter queue
+		 *
+		 * @param _queue Work queue the message came from
+		 * @return std::string Name of the dead-letter queue
+		 */
+		static std::string DeadLetterQueue(const std::string& _queue);
+
+		/**
+		 * @brief Reads a policy from the @c retry section of a configuration
+		 *
+		 * @param _config The @c retry object; missing keys keep their defaults
+		 * @return RetryPolicy The policy described
+		 */
+		static RetryPolicy FromJson(const Json::Value& _config);
+	};
+}
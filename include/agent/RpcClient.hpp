@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace agent
+{
+	/**
+	 * @brief Matches replies to outstanding RPC calls
+	 *
+	 * Each call is registered with a callback and a deadline and gets a
+	 * unique correlation ID to send with the request; the reply carrying
+	 * that ID resolves it, and calls past their deadline are failed by
+	 * @c Expire . Any number of calls can be outstanding on the one reply
+	 * consumer. Not thread-safe; the owner drives it from one thread.
+	 */
+	class RpcClient
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Receives the outcome of a call
+		 *
+		 * Gets whether a reply arrived in time, and was not a failure
+		 * reported by the server, and if so its body; the bytes are only
+		 * valid during the call.
+		 */
+		using Callback = std::function<void(bool, const char*, std::size_t)>;
+
+		/**
+		 * @brief Construct a new RpcClient object
+		 *
+		 */
+		RpcClient();
+
+		/**
+		 * @brief Registers a call about to be made
+		 *
+		 * @param _callback Told the outcome, exactly once
+		 * @param _timeout How long to wait for the reply
+		 * @param _now Current time
+		 * @return std::string Correlation ID to send with the request
+		 */
+		std::string Register(Callback _callback, std::chrono::milliseconds _timeout, Clock::time_point _now = Clock::now());
+
+		/**
+		 * @brief Hands a reply to the call it belongs to
+		 *
+		 * @param _correlationId Correlation ID of the reply
+		 * @param _data Reply body
+		 * @param _size Bytes in the reply body
+		 * @param _succeeded Whether the server processed the request, rather than gave up on it
+		 * @return true If the reply matched an outstanding call
+		 */
+		bool Resolve(const std::string& _correlationId, const char* _data, std::size_t _size, bool _succeeded = true);
+
+		/**
+		 * @brief Fails every call past its deadline
+		 *
+		 * @param _now Current time
+		 * @return std::size_t Number of calls failed
+		 */
+		std::size_t Expire(Clock::time_point _now = Clock::now());
+
+		/**
+		 * @brief Gets the number of calls still waiting for a reply
+		 *
+		 * @return std::size_t Outstanding calls
+		 */
+		std::size_t Outstanding() const;
+
+	private:
+		struct Call
+		{
+			Callback callback; ///< Told the outcome
+			Clock::time_point deadline; ///< When to give up
+		};
+
+		std::string _prefix; ///< Random per client, so IDs never clash across clients
+		std::uint64_t _next = 0; ///< Counter making IDs unique within this client
+		std::unordered_map<std::string, Call> _calls; ///< Outstanding calls by correlation ID
+	};
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "IWorker.hpp"
+#include "IStreamHandler.hpp"
+#include "BufferPool.hpp"
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+#include <amqpcpp.h>
+
+namespace agent
+{
+	/**
+	 * @brief Feeds streamed message bodies to an @c IStreamHandler off the IO thread
+	 *
+	 * The connection's IO thread calls @c Begin , @c Chunk and @c End as
+	 * frames arrive; this worker's own thread replays them in order on the
+	 * handler, so processing of one part of a body overlaps with the receipt
+	 * of the next. Outcomes are recorded on the results stack just as
+	 * @c IWorker does for whole messages.
+	 *
+	 * Run it with exactly one thread; more would reorder the chunks.
+	 */
+	class StreamDispatcher : public IWorker
+	{
+	public:
+		/**
+		 * @brief Construct a new StreamDispatcher object
+		 *
+		 * @param __id ID to assign to the dispatcher
+		 * @param __name Name to assign the dispatcher (also its logger)
+		 * @param _handler Handler which processes the streamed bodies
+		 */
+		StreamDispatcher(unsigned int __id, std::string __name, IStreamHandler* _handler);
+
+		/**
+		 * @brief Destroy the StreamDispatcher object, stopping its thread
+		 *
+		 */
+		~StreamDispatcher();
+
+		/**
+		 * @brief Queues the start of a message
+		 *
+		 * @param _size Total number of body bytes
+		 * @param _headers Application headers of the message
+		 */
+		void Begin(std::uint64_t _size, const AMQP::Table& _headers);
+
+		/**
+		 * @brief Queues one piece of the body
+		 *
+		 * @param _chunk Pooled buffer holding the bytes
+		 */
+		void Chunk(PooledBuffer&& _chunk);
+
+		/**
+		 * @brief Function called once the handler is done with a message
+		 *
+		 * Runs on the dispatcher's thread with the ID @c OnEnd returned and
+		 * whether the message succeeded; -1 and false if it failed.
+		 */
+		using Completion = std::function<void(int, bool)>;
+
+		/**
+		 * @brief Queues the end of the current message
+		 *
+		 * @param _onDone Called once @c OnEnd has returned, or the message
+		 * has failed; may be empty
+		 */
+		void End(Completion _onDone = nullptr);
+
+		/**
+		 * @brief Queues the abandonment of the current message
+		 *
+		 * Used when the connection drops mid-delivery: the handler gets no
+		 * @c OnEnd for it, a failure is recorded, and the next message starts
+		 * with a fresh @c OnBegin .
+		 */
+		void Abort();
+
+		/**
+		 * @brief Overridden function which won't be called
+		 *
+		 * @param _msg N/A
+		 * @param _size N/A
+		 * @return int N/A
+		 */
+		int ProcessMessage(const void* _msg, std::uint32_t _size, void* _result = nullptr, std::uint32_t* _rsize = nullptr) override;
+
+		/**
+		 * @brief Replays queued events on the handler until told to quit
+		 *
+		 */
+		void operator()() override;
+
+	private:
+		struct Event
+		{
+			enum Kind { BEGIN, CHUNK, END, ABORT } kind; ///< What happened
+			std::uint64_t size = 0; ///< Body size for @c BEGIN
+			AMQP::Table headers; ///< Headers for @c BEGIN
+			PooledBuffer chunk; ///< Bytes for @c CHUNK
+			Completion onDone; ///< Callback for @c END , if any
+		};
+
+		void _push(Event&& _event);
+
+		IStreamHandler* _handler; ///< Handler receiving the events
+		std::deque<Event> _events; ///< Events waiting to be replayed
+		std::mutex _events_lock; ///< Mutex lock for @c _events
+		std::condition_variable _events_ready; ///< Signalled when an event is queued
+	};
+}
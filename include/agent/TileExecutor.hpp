@@ -0,0 +1,109 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include "Kernels.hpp"
+
+namespace agent
+{
+	/**
+	 * @brief One piece of an image split up for processing in parallel
+	 *
+	 * Tiles are bands of whole rows, so each one is contiguous in the
+	 * message and the kernels in Kernels.hpp run on @c view unchanged.
+	 */
+	struct Tile
+	{
+		std::size_t index = 0; ///< Position among the image's tiles, top first
+		std::uint32_t y = 0; ///< First row of the band in the whole image
+		kernels::ImageView view; ///< The band's pixels
+	};
+
+	/**
+	 * @brief Spreads the tiles of one message over several threads
+	 *
+	 * @c Run publishes a job of numbered tasks and works on it itself;
+	 * any thread calling @c Help at the same time takes tasks from it too.
+	 * Every @c IWorker has one its idle threads help with, so one large
+	 * image can use all of the worker's threads while the queue is short.
+	 * An executor can also be shared between workers, and given threads of
+	 * its own to serve as a common pool.
+	 */
+	class TileExecutor
+	{
+	public:
+		/**
+		 * @brief Construct a new TileExecutor object
+		 *
+		 * @param __threads Threads of its own to help with every job; with
+		 * none, only the caller and threads calling @c Help do the work
+		 */
+		TileExecutor(std::size_t __threads = 0);
+
+		/**
+		 * @brief Destroy the TileExecutor object, stopping its threads
+		 *
+		 */
+		~TileExecutor();
+
+		/**
+		 * @brief Runs numbered tasks in parallel and waits for all of them
+		 *
+		 * @param _count Number of tasks
+		 * @param _task Called once with each number below @c _count , on any thread
+		 * @throw The first exception a task threw, once all of them are done
+		 */
+		void Run(std::size_t _count, const std::function<void(std::size_t)>& _task);
+
+		/**
+		 * @brief Works on other callers' tasks, if there are any
+		 *
+		 * @param _wait How long to wait for a job to turn up
+		 * @return true If any task was run
+		 */
+		bool Help(std::chrono::milliseconds _wait = std::chrono::milliseconds(0));
+
+		/**
+		 * @brief Splits an image into bands of whole rows
+		 *
+		 * @param _image The image
+		 * @param _tileBytes Rough size of each band; at least one row
+		 * @return std::vector<Tile> The bands, top first
+		 */
+		static std::vector<Tile> Split(const kernels::ImageView& _image, std::size_t _tileBytes = AGENT_TILE_BYTES);
+
+	private:
+		struct Job
+		{
+			const std::function<void(std::size_t)>* task; ///< The caller's task, valid until @c Run returns
+			std::size_t count; ///< Number of tasks
+			std::atomic<std::size_t> next{0}; ///< Next task number to hand out
+			std::atomic<std::size_t> done{0}; ///< Tasks finished
+			std::exception_ptr error; ///< First exception thrown by a task
+			std::mutex lock; ///< Mutex lock for @c error and @c finished
+			std::condition_variable finished; ///< Signalled when the last task is done
+		};
+
+		static bool _work(Job& _job);
+		void _retire(const std::shared_ptr<Job>& _job);
+
+		std::deque<std::shared_ptr<Job>> _jobs; ///< Jobs with tasks still to hand out
+		std::mutex _jobs_lock; ///< Mutex lock for @c _jobs
+		std::condition_variable _jobs_ready; ///< Signalled when a job is published
+		std::vector<std::thread> _threads; ///< Threads of our own, if any
+		std::atomic<bool> _quit{false}; ///< Tells our threads to stop
+	};
+}
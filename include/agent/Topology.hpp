@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include <amqpcpp.h>
+
+namespace agent
+{
+	/**
+	 * @brief Remembers what a worker declared on its channel
+	 *
+	 * Every declaration is applied to the given channel straight away and
+	 * recorded, so that after a reconnect @c Replay can set up an identical
+	 * new channel: exchanges, queues, bindings, QoS and then consumers, in
+	 * that order.
+	 */
+	class Topology
+	{
+	public:
+		/**
+		 * @brief Sets up a consumer on a fresh @c AMQP::DeferredConsumer
+		 *
+		 */
+		using ConsumerSetup = std::function<void(AMQP::DeferredConsumer&)>;
+
+		/**
+		 * @brief Declares an exchange
+		 *
+		 * @param _channel Channel to declare it on now
+		 * @param _name Name of the exchange
+		 * @param _type Type of the exchange
+		 * @param _flags Exchange flags
+		 * @param _arguments Optional exchange arguments
+		 */
+		void DeclareExchange(AMQP::Channel& _channel, const std::string& _name, AMQP::ExchangeType _type, int _flags, const AMQP::Table& _arguments = AMQP::Table());
+
+		/**
+		 * @brief Declares a queue
+		 *
+		 * @param _channel Channel to declare it on now
+		 * @param _name Name of the queue
+		 * @param _flags Queue flags
+		 * @param _arguments Optional queue arguments
+		 */
+		void DeclareQueue(AMQP::Channel& _channel, const std::string& _name, int _flags, const AMQP::Table& _arguments = AMQP::Table());
+
+		/**
+		 * @brief Binds a queue to an exchange
+		 *
+		 * @param _channel Channel to bind on now
+		 * @param _exchange Name of the exchange
+		 * @param _queue Name of the queue
+		 * @param _key Routing key of the binding
+		 * @param _arguments Optional binding arguments
+		 */
+		void BindQueue(AMQP::Channel& _channel, const std::string& _exchange, const std::string& _queue, const std::string& _key, const AMQP::Table& _arguments = AMQP::Table());
+
+		/**
+		 * @brief Sets the prefetch count
+		 *
+		 * @param _channel Channel to set it on now
+		 * @param __prefetch Number of unacked messages the broker may send
+		 */
+		void SetQos(AMQP::Channel& _channel, std::uint16_t __prefetch);
+
+		/**
+		 * @brief Starts consuming from a queue
+		 *
+		 * @param _channel Channel to consume on now
+		 * @param _queue Name of the queue
+		 * @param _tag Consumer tag
+		 * @param _flags Consume flags
+		 * @param _setup Installs the callbacks; called again on every replay
+		 */
+		void Consume(AMQP::Channel& _channel, const std::string& _queue, const std::string& _tag, int _flags, ConsumerSetup _setup);
+
+		/**
+		 * @brief Applies everything recorded so far to a new channel
+		 *
+		 * @param _channel The channel to set up
+		 */
+		void Replay(AMQP::Channel& _channel) const;
+
+	private:
+		struct Exchange
+		{
+			std::string name;
+			AMQP::ExchangeType type;
+			int flags;
+			AMQP::Table arguments;
+		};
+
+		struct Queue
+		{
+			std::string name;
+			int flags;
+			AMQP::Table arguments;
+		};
+
+		struct Binding
+		{
+			std::string exchange;
+			std::string queue;
+			std::string key;
+			AMQP::Table arguments;
+		};
+
+		struct Consumer
+		{
+			std::string queue;
+			std::string tag;
+			int flags;
+			ConsumerSetup setup;
+		};
+
+		std::vector<Exchange> _exchanges; ///< Declared exchanges
+		std::vector<Queue> _queues; ///< Declared queues
+		std::vector<Binding> _bindings; ///< Queue bindings
+		std::vector<Consumer> _consumers; ///< Active consumers
+		std::uint16_t _prefetch = 0; ///< Prefetch count; 0 if never set
+	};
+}
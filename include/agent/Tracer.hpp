@@ -0,0 +1,124 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstdint>
+
+namespace agent
+{
+	/**
+	 * @brief Records where the time of each message goes, for Chrome's trace viewer
+	 *
+	 * Connections and workers given the same tracer with
+	 * @c IWorker::SetTracer record the stages of each message, under an ID
+	 * the tracer hands out when the message arrives:
+	 * - @c transit , from publication to arrival, when the publisher stamped it;
+	 * - @c message , from the first frame of the delivery to its ack;
+	 * - @c queued , from being queued in a worker to being taken off it;
+	 * - @c process , the processing itself, on the thread that did it;
+	 * - @c settle , from the end of processing to the ack going out.
+	 * The IO thread also records each @c receive from the socket and each
+	 * @c parse of the frames received. One read or parse can hold parts of
+	 * many messages, so these are recorded under ID 0, tied to none: they
+	 * show on the IO thread's track, next to the @c message spans they
+	 * began or completed, but not on the tracks of those messages.
+	 *
+	 * Each thread records into a ring of its own, lock-free, and the
+	 * oldest events are overwritten once it is full. @c ChromeTrace writes
+	 * what the rings hold at the time in the JSON that chrome://tracing
+	 * and Perfetto open.
+	 */
+	class Tracer
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		/**
+		 * @brief Construct a new Tracer object
+		 *
+		 * @param __capacity Events each thread's ring holds
+		 */
+		explicit Tracer(std::size_t __capacity = AGENT_TRACE_RING_SIZE);
+
+		/**
+		 * @brief Destroy the Tracer object
+		 *
+		 */
+		~Tracer();
+
+		Tracer(const Tracer&) = delete;
+		Tracer& operator=(const Tracer&) = delete;
+
+		/**
+		 * @brief Hands out the ID of a newly arrived message
+		 *
+		 * @return std::uint64_t The ID; never 0, which marks messages not traced
+		 */
+		std::uint64_t NextId();
+
+		/**
+		 * @brief Records a stage which began and ended on the calling thread
+		 *
+		 * @param _name Name of the stage; must outlive the tracer, e.g. a literal
+		 * @param _id ID of the message, or 0 for work not tied to one
+		 * @param _begin When it began
+		 * @param _end When it ended
+		 */
+		void Span(const char* _name, std::uint64_t _id, Clock::time_point _begin, Clock::time_point _end);
+
+		/**
+		 * @brief Records the beginning of a stage of a message
+		 *
+		 * The stage may end on another thread.
+		 *
+		 * @param _name Name of the stage; must outlive the tracer, e.g. a literal
+		 * @param _id ID of the message
+		 * @param _at When it began
+		 */
+		void Begin(const char* _name, std::uint64_t _id, Clock::time_point _at);
+
+		/**
+		 * @brief Records the end of a stage of a message
+		 *
+		 * @param _name Name of the stage, as given to @c Begin
+		 * @param _id ID of the message
+		 * @param _at When it ended
+		 */
+		void End(const char* _name, std::uint64_t _id, Clock::time_point _at);
+
+		/**
+		 * @brief Writes the events recorded as Chrome trace JSON
+		 *
+		 * @return std::string The trace, in the JSON object format
+		 */
+		std::string ChromeTrace() const;
+
+		/**
+		 * @brief Writes the events recorded to a file, as Chrome trace JSON
+		 *
+		 * @param _path File to write
+		 * @return true If the file was written
+		 */
+		bool Dump(const std::string& _path) const;
+
+	private:
+		struct Ring;
+
+		Ring& _ring();
+		void _record(const char* _name, char _phase, std::uint64_t _id, Clock::time_point _at, Clock::duration _duration);
+
+		const std::uint64_t _serial; ///< Tells this tracer's rings from other tracers'
+		const std::size_t _capacity; ///< Events each ring holds
+		const Clock::time_point _epoch; ///< Time 0 of the trace
+		std::atomic<std::uint64_t> _ids{0}; ///< Last message ID handed out
+		std::map<std::thread::id, std::unique_ptr<Ring>> _rings; ///< One per thread that recorded anything
+		mutable std::mutex _rings_lock; ///< Mutex lock for @c _rings ; not for the rings themselves
+	};
+}
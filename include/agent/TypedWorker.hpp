@@ -0,0 +1,178 @@
+#pragma once
+
+#include <agent/agent.hpp>
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <utility>
+
+#include <flatbuffers/flatbuffers.h>
+
+#include "IWorker.hpp"
+#include "Message_generated.h"
+
+namespace agent
+{
+	/**
+	 * @brief Tells @c TypedWorker which file identifier marks a root type
+	 *
+	 * Specialize for each root type of your own schemas, e.g.
+	 * @code
+	 * template <> struct RootTraits<my::Order>
+	 * {
+	 *     static const char* Identifier() { return my::OrderIdentifier(); }
+	 * };
+	 * @endcode
+	 *
+	 * @tparam Root Generated root table type
+	 */
+	template <typename Root>
+	struct RootTraits;
+
+	template <>
+	struct RootTraits<Messages::Message>
+	{
+		static const char* Identifier() { return Messages::MessageIdentifier(); }
+	};
+
+	/**
+	 * @brief Handler for one root type of a @c TypedWorker
+	 *
+	 * @tparam Root Generated root table type
+	 */
+	template <typename Root>
+	class TypedHandler
+	{
+	public:
+		virtual ~TypedHandler() = default;
+
+		/**
+		 * @brief Process a message of this type
+		 *
+		 * @param _root The message, read in place
+		 * @param _size Number of bytes in the serialized message
+		 * @param _result As for @c IWorker::ProcessMessage
+		 * @param _rsize As for @c IWorker::ProcessMessage
+		 * @return int Unique ID of the message processed
+		 */
+		virtual int Handle(const Root* _root, std::uint32_t _size, void* _result, std::uint32_t* _rsize) = 0;
+	};
+
+	/**
+	 * @brief Worker for queues carrying messages of several schemas
+	 *
+	 * Each message is routed by the file identifier in its first bytes to
+	 * the @c Handle overload for its root type, which gets a typed root
+	 * pointer; override one for every type listed. The routing is a chain
+	 * of four-byte compares fixed at compile time. Producers must stamp
+	 * the identifier, i.e. finish with the generated @c Finish...Buffer ,
+	 * and no two root types may share one.
+	 *
+	 * Messages are checked with a FlatBuffers @c Verifier before their
+	 * handler sees them: all of them by default, or every n-th when the
+	 * cost matters more than the protection. The rest only have their root
+	 * table and its vtable bounds-checked, not the fields they point at, so
+	 * only sample when every producer is trusted. Messages of unknown type
+	 * and messages failing either check throw @c PermanentFailure , so they
+	 * go straight to the dead-letter queue instead of being retried.
+	 *
+	 * @tparam Roots Generated root table types handled
+	 */
+	template <typename... Roots>
+	class TypedWorker : public IWorker, public TypedHandler<Roots>...
+	{
+		static_assert(sizeof...(Roots) > 0, "TypedWorker needs at least one root type");
+
+	public:
+		using TypedHandler<Roots>::Handle...;
+
+		/**
+		 * @brief Construct a new TypedWorker object
+		 *
+		 * @param __id Desired worker ID
+		 * @param __name Desired worker name
+		 */
+		TypedWorker(unsigned int __id, std::string __name)
+			: IWorker(__id, std::move(__name))
+		{}
+
+		/**
+		 * @brief Sets how often messages are verified
+		 *
+		 * @param _every Verify one message in this many; 1 for all, 0 for none
+		 */
+		void SetVerifyEvery(unsigned int _every)
+		{
+			_verifyEvery.store(_every);
+		}
+
+		/**
+		 * @brief Gets the number of messages dead-lettered for their type or layout
+		 *
+		 * @return std::uint64_t Messages of unknown type or failing verification
+		 */
+		std::uint64_t Rejected() const
+		{
+			return _rejected.load();
+		}
+
+		/**
+		 * @brief Routes a message to the handler for its type
+		 *
+		 * @throw PermanentFailure If the type is unknown or the message is malformed
+		 */
+		int ProcessMessage(const void* _msg, std::uint32_t _size, void* _result = nullptr, std::uint32_t* _rsize = nullptr) final
+		{
+			// Root offset, then the identifier
+			if (_size < sizeof(flatbuffers::uoffset_t) + flatbuffers::kFileIdentifierLength)
+				_reject("Message too short to carry a type");
+
+			const unsigned int every = _verifyEvery.load();
+			const bool verify = every > 0 && _verifyCount.fetch_add(1) % every == 0;
+
+			int msgId = -1;
+			if (!(_route<Roots>(_msg, _size, _result, _rsize, verify, msgId) || ...))
+			{
+				const char* identifier = static_cast<const char*>(_msg) + sizeof(flatbuffers::uoffset_t);
+				_reject("Message of unknown type '" + std::string(identifier, flatbuffers::kFileIdentifierLength) + "'");
+			}
+			return msgId;
+		}
+
+	private:
+		template <typename Root>
+		bool _route(const void* _msg, std::uint32_t _size, void* _result, std::uint32_t* _rsize, bool _verify, int& _msgId)
+		{
+			if (!flatbuffers::BufferHasIdentifier(_msg, RootTraits<Root>::Identifier()))
+				return false;
+
+			flatbuffers::Verifier verifier(static_cast<const std::uint8_t*>(_msg), _size);
+			if (_verify)
+			{
+				if (!verifier.VerifyBuffer<Root>(RootTraits<Root>::Identifier()))
+					_reject("Message of type '" + std::string(RootTraits<Root>::Identifier()) + "' failed verification");
+			}
+			else
+			{
+				// Not sampled: the handler still gets a root table inside the buffer
+				const flatbuffers::uoffset_t root = flatbuffers::ReadScalar<flatbuffers::uoffset_t>(_msg);
+				if (root > _size - sizeof(flatbuffers::soffset_t) || !verifier.VerifyTableStart(static_cast<const std::uint8_t*>(_msg) + root))
+					_reject("Message of type '" + std::string(RootTraits<Root>::Identifier()) + "' has its root table out of bounds");
+			}
+
+			_msgId = static_cast<TypedHandler<Root>*>(this)->Handle(flatbuffers::GetRoot<Root>(_msg), _size, _result, _rsize);
+			return true;
+		}
+
+		[[noreturn]] void _reject(const std::string& _why)
+		{
+			++_rejected;
+			throw PermanentFailure(_why);
+		}
+
+		std::atomic<unsigned int> _verifyEvery{AGENT_VERIFY_EVERY}; ///< Verify one message in this many
+		std::atomic<std::uint64_t> _verifyCount{0}; ///< Messages seen, for sampling
+		std::atomic<std::uint64_t> _rejected{0}; ///< Messages dead-lettered for their type or layout
+	};
+}
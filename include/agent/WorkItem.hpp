@@ -0,0 +1,69 @@
+#pragma once
+
+#include "BufferPool.hpp"
+
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <functional>
+
+namespace agent
+{
+	class Codec;
+
+	/**
+	 * @brief A single message waiting in an @c IWorker queue
+	 *
+	 * The message bytes are either borrowed (the caller guarantees they
+	 * outlive processing, as with the original @c AddMessage ) or owned
+	 * through @c buffer , in which case they go back to their pool once the
+	 * item has been processed and destroyed, or through @c mapping , which
+	 * keeps memory mapped from elsewhere valid for as long.
+	 */
+	struct WorkItem
+	{
+		/**
+		 * @brief Called once the item has been processed
+		 *
+		 * Gets the item itself (its bytes are still valid during the call,
+		 * and its @c result may be moved out), the ID returned by
+		 * @c ProcessMessage and whether it succeeded.
+		 */
+		using Completion = std::function<void(WorkItem&, int, bool)>;
+
+		WorkItem() = default;
+
+		/**
+		 * @brief Construct a WorkItem which borrows its bytes
+		 *
+		 * @param _data Pointer to the serialized message
+		 * @param _size Number of bytes in the message
+		 */
+		WorkItem(const void* _data, std::uint32_t _size)
+			: data(_data), size(_size)
+		{}
+
+		/**
+		 * @brief Construct a WorkItem which owns its bytes
+		 *
+		 * @param _buffer Pooled buffer holding the serialized message
+		 */
+		WorkItem(PooledBuffer&& _buffer)
+			: data(_buffer.Data()), size(static_cast<std::uint32_t>(_buffer.Size())), buffer(std::move(_buffer))
+		{}
+
+		const void* data = nullptr; ///< Start of the serialized message
+		std::uint32_t size = 0; ///< Number of bytes in the message
+		PooledBuffer buffer; ///< Owner of @c data when not borrowed
+		std::shared_ptr<const void> mapping; ///< Owner of @c data when it is mapped in, e.g. a claim check
+		std::size_t queueClass = 0; ///< Weighted class the item is scheduled in
+		Completion onDone; ///< Told the outcome, e.g. to ack the message; optional
+		PooledBuffer result; ///< Room for @c ProcessMessage to write a result into; optional
+		std::shared_ptr<const Codec> codec; ///< What @c data is compressed with, until the worker decodes it into @c decoded ; optional
+		PooledBuffer decoded; ///< Room for the decompressed message, sized to it exactly
+		bool deadLetter = false; ///< Set when it failed in a way retrying cannot fix
+		std::chrono::steady_clock::time_point queued; ///< When it was queued, for the time spent waiting
+		std::uint64_t traceId = 0; ///< ID its stages are traced under; 0 until a @c Tracer gives it one
+	};
+}
@@ -1,18 +1,18 @@
-#pragma once
-
-#include "agent/agent_config.hpp"
-
-namespace agent {
-
-/** @brief A very interesting function!
- *
- * This function is of course just a self-explanatory placeholder,
- * but surprisingly often, things aren't this easy. You should
- * therefore *really* document your C++ code with Doxygen!
- *
- * @param x The number to increase
- * @returns the successor of x
- */
-int add_one(int x);
-
-} // namespace agent
+#pragma once
+
+#include "agent/agent_config.hpp"
+
+namespace agent {
+
+/** @brief A very interesting function!
+ *
+ * This function is of course just a self-explanatory placeholder,
+ * but surprisingly often, things aren't this easy. You should
+ * therefore *really* document your C++ code with Doxygen!
+ *
+ * @param x The number to increase
+ * @returns the successor of x
+ */
+int add_one(int x);
+
+} // namespace agent
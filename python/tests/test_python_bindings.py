@@ -1,5 +1,5 @@
-import agent
-
-
-def test_agent():
-    assert agent.add_one(1) == 2
+import agent
+
+
+def test_agent():
+    assert agent.add_one(1) == 2
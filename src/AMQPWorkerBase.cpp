@@ -0,0 +1,1114 @@
+#include "agent/AMQPWorkerBase.hpp"
+#include "agent/IConnectionHandler.hpp"
+#include "agent/IConnectionHandlerSSL.hpp"
+#include "agent/IWorker.hpp"
+#include "agent/SymbolMaps.hpp"
+#include "agent/BufferPool.hpp"
+#include "agent/MessageAssembler.hpp"
+#include "agent/IStreamHandler.hpp"
+#include "agent/StreamDispatcher.hpp"
+#include "agent/ConfirmTracker.hpp"
+#include "agent/ChannelPool.hpp"
+#include "agent/QueueBinding.hpp"
+#include "agent/WorkItem.hpp"
+#include "agent/RetryPolicy.hpp"
+#include "agent/RpcClient.hpp"
+#include "agent/DedupCache.hpp"
+#include "agent/ChunkAssembler.hpp"
+#include "agent/ClaimStore.hpp"
+#include "agent/Codec.hpp"
+#include "agent/BuilderPool.hpp"
+#include "agent/Metrics.hpp"
+#include "agent/MetricsServer.hpp"
+#include "agent/Tracer.hpp"
+#include "agent/Logging.hpp"
+
+#include <set>
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include <amqpcpp.h>
+#include <flatbuffers/flatbuffers.h>
+#include <json/json.h>
+#include <Poco/Exception.h>
+#include <spdlog/spdlog.h>
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_configure(const Json::Value &_config)
+{
+    // Retries and dead-lettering of messages that fail processing
+    _retry = RetryPolicy::FromJson(_config["retry"]);
+
+    // Room for the result of a request that wants a reply
+    _resultSize = _config["rpc"].get("resultSize", Json::Value::UInt64(AGENT_RPC_RESULT_SIZE)).asUInt64();
+
+    // Reusing the results of byte-identical bodies
+    const Json::Value &memo = _config["memo"];
+    if (memo.get("enabled", false).asBool())
+    {
+        _worker->EnableMemo(
+            memo.get("maxEntries", Json::Value::UInt64(AGENT_MEMO_MAX_ENTRIES)).asUInt64(),
+            memo.get("maxBytes", Json::Value::UInt64(AGENT_MEMO_MAX_BYTES)).asUInt64());
+    }
+
+    // Remembering processed messages, to skip their duplicates
+    const Json::Value &dedup = _config["dedup"];
+    if (dedup.get("enabled", false).asBool())
+    {
+        _dedup = std::make_unique<DedupCache>(
+            dedup.get("maxEntries", Json::Value::UInt64(AGENT_DEDUP_MAX_ENTRIES)).asUInt64(),
+            dedup.get("maxBytes", Json::Value::UInt64(AGENT_DEDUP_MAX_BYTES)).asUInt64(),
+            dedup.get("shards", Json::Value::UInt64(AGENT_DEDUP_SHARDS)).asUInt64());
+        _bodyKeys = dedup.get("bodyKeys", false).asBool();
+    }
+
+    // Delays between reconnect attempts
+    SetReconnectBackoff(
+        std::chrono::milliseconds(_config["reconnect"].get("initialDelay", AGENT_RECONNECT_MIN_MSEC).asUInt()),
+        std::chrono::milliseconds(_config["reconnect"].get("maxDelay", AGENT_RECONNECT_MAX_MSEC).asUInt()));
+
+    // Bodies above the threshold go out, and come in, as chunks
+    const Json::Value &chunking = _config["chunking"];
+    _chunkThreshold = chunking.get("threshold", Json::Value::UInt64(AGENT_CHUNK_THRESHOLD)).asUInt64();
+    _chunkTimeout = std::chrono::milliseconds(chunking.get("timeout", AGENT_CHUNK_TIMEOUT_MSEC).asUInt());
+    _splitter = std::make_unique<ChunkSplitter>(chunking.get("chunkSize", Json::Value::UInt64(AGENT_CHUNK_SIZE)).asUInt64());
+    _chunks = std::make_unique<ChunkAssembler>(_messagePool, chunking.get("maxPending", Json::Value::UInt64(AGENT_CHUNK_MAX_PENDING)).asUInt64());
+
+    // Which bodies are compressed on their way out
+    _compression = CompressionPolicy::FromJson(_config["compression"]);
+
+    // Large bodies to and from this host can bypass the broker
+    const Json::Value &claimCheck = _config["claimCheck"];
+    if (claimCheck.get("enabled", false).asBool())
+    {
+        _claimStore = std::make_unique<ClaimStore>(
+            claimCheck.get("directory", AGENT_CLAIM_DIRECTORY).asString(),
+            std::chrono::seconds(claimCheck.get("maxAge", AGENT_CLAIM_MAX_AGE_SEC).asUInt()));
+        _claimThreshold = claimCheck.get("threshold", Json::Value::UInt64(AGENT_CLAIM_THRESHOLD)).asUInt64();
+        _claimCount = claimCheck.get("claims", 1).asUInt();
+    }
+
+    // Where each message's time goes, for chrome://tracing or Perfetto
+    const Json::Value &tracing = _config["tracing"];
+    std::shared_ptr<Tracer> tracer;
+    if (tracing.get("enabled", false).asBool())
+    {
+        tracer = std::make_shared<Tracer>(tracing.get("ringSize", Json::Value::UInt64(AGENT_TRACE_RING_SIZE)).asUInt64());
+        SetTracer(tracer);
+        _worker->SetTracer(tracer);
+    }
+    _stampPublished = tracing.get("stampPublished", false).asBool();
+
+    // Counters and latencies of the connection and the worker, for Prometheus
+    const Json::Value &metrics = _config["metrics"];
+    if (metrics.get("enabled", false).asBool())
+    {
+        auto registry = std::make_shared<MetricsRegistry>();
+        SetMetrics(registry);
+        _worker->SetMetrics(registry);
+        try
+        {
+            _metricsServer = std::make_unique<MetricsServer>(
+                registry,
+                metrics.get("address", "127.0.0.1").asString(),
+                static_cast<std::uint16_t>(metrics.get("port", AGENT_METRICS_PORT).asUInt()),
+                tracer);
+            _logger->info("Serving metrics on port {}", _metricsServer->Port());
+        }
+        catch (const Poco::Exception &e)
+        {
+            _logger->error("Could not serve metrics: {}", e.displayText());
+        }
+    }
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_start()
+{
+    // Bodies above the threshold go out, and come in, as chunks
+    if (!_splitter)
+        _splitter = std::make_unique<ChunkSplitter>();
+    if (!_chunks)
+        _chunks = std::make_unique<ChunkAssembler>(_messagePool);
+
+    // One channel for publishing, then one per binding with its own QoS,
+    // consumer and acks; each binding's messages are their own class on _worker
+    _channels.Add(_connection.get());
+    for (std::size_t i = 0; i < _bindings.size(); ++i)
+    {
+        _channels.Add(_connection.get());
+        _deliveries.push_back(std::make_unique<Delivery>(_messagePool));
+        _worker->SetQueueWeight(i, _bindings[i].weight);
+    }
+
+    // A request the broker will not take is failed now, not at its timeout
+    _channels.At(_publishChannel).OnRefused([this](Publication &&publication) {
+        if (publication.replyTo == "amq.rabbitmq.reply-to")
+            _rpc.Resolve(publication.correlationId, "", 0, false);
+    });
+
+    // Declare the queues and exchanges and bind them
+    InitializeQueue();
+
+    // Set the worker callbacks
+    SetConsumerCallbacks();
+
+    // Start the threads
+    try
+    {
+        Run();
+    }
+    catch (const std::exception &e)
+    {
+        _logger->error("Exception caught: {}", e.what());
+    }
+    catch (...)
+    {
+        _logger->error("Anonymous exception caught");
+    }
+}
+
+template <class Handler>
+agent::AMQPWorkerBase<Handler>::~AMQPWorkerBase()
+{
+    _channels.Close();
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::InitializeQueue()
+{
+    // Recorded by each channel so that a reconnect can declare it all again
+    for (std::size_t i = 0; i < _bindings.size(); ++i)
+    {
+        const auto &binding = _bindings[i];
+        auto &channel = _channels.At(_bindingChannel(i));
+        channel.DeclareQueue(binding.queue, binding.queueFlags);
+        channel.DeclareExchange(binding.exchange, binding.exchangeType, binding.exchangeFlags);
+        channel.BindQueue(binding.exchange, binding.queue, binding.key);
+        channel.SetQos(binding.prefetch);
+
+        // Failed messages wait out their delay in one queue per attempt and
+        // then dead-letter back to the work queue; the last failure is kept
+        for (unsigned int attempt = 1; attempt < _retry.maxAttempts; ++attempt)
+        {
+            AMQP::Table arguments;
+            arguments["x-message-ttl"] = static_cast<std::int32_t>(_retry.Delay(attempt).count());
+            arguments["x-dead-letter-exchange"] = "";
+            arguments["x-dead-letter-routing-key"] = binding.queue;
+            channel.DeclareQueue(RetryPolicy::DelayQueue(binding.queue, attempt), AMQP::durable, arguments);
+        }
+        channel.DeclareQueue(RetryPolicy::DeadLetterQueue(binding.queue), AMQP::durable);
+    }
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::SetConsumerCallbacks()
+{
+    /**
+     * Bodies are collected frame by frame rather than through onReceived, so
+     * AMQP-CPP never builds its own copy of the message; each frame goes
+     * straight from the input buffer into a pooled buffer sized from the
+     * content header, which is then handed to the worker to own. With a
+     * stream handler set, the frames go to it one by one instead
+     */
+    for (std::size_t i = 0; i < _bindings.size(); ++i)
+    {
+        // Deliveries on different channels interleave frame by frame, so
+        // each binding collects its bodies separately
+        Delivery *delivery = _deliveries[i].get();
+        const std::size_t channel = _bindingChannel(i);
+
+        _channels.At(channel).Consume(_bindings[i].queue, _bindings[i].key, 0, [this, delivery, channel, i](AMQP::DeferredConsumer &consumer) {
+            _consumeWith(consumer, delivery, channel, i);
+        });
+    }
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_consumeWith(AMQP::DeferredConsumer &_consumer, Delivery *_delivery, std::size_t _channel, std::size_t _binding)
+{
+    _consumer.onSize(
+        [this, _delivery](uint64_t size) {
+            // Traced from here, the first frame of the delivery, to its ack
+            _delivery->traceId = _tracer ? _tracer->NextId() : 0;
+            if (_delivery->traceId != 0)
+            {
+                _delivery->arrived = std::chrono::steady_clock::now();
+                _tracer->Begin("message", _delivery->traceId, _delivery->arrived);
+            }
+
+            _delivery->bodySize = size;
+            _delivery->attempt = 1;
+            _delivery->chunk = ChunkInfo();
+            _delivery->chunkTarget = nullptr;
+            _delivery->chunkReceived = 0;
+            _delivery->streaming = _delivery->streamTarget.load();
+            if (_delivery->streaming == nullptr)
+                _delivery->assembler.Begin(size);
+        }
+    ).onHeaders(
+        [this, _delivery](const AMQP::MetaData &metaData) {
+            // Retries carry the number of the attempt they are on
+            _delivery->replyTo = metaData.hasReplyTo() ? metaData.replyTo() : "";
+            _delivery->correlationId = metaData.hasCorrelationID() ? metaData.correlationID() : "";
+            _delivery->messageId = metaData.hasMessageID() ? metaData.messageID() : "";
+            _delivery->claimCheck = metaData.headers().contains("x-claim-check");
+            _delivery->contentEncoding = metaData.hasContentEncoding() ? metaData.contentEncoding() : "";
+            _delivery->decodedSize = metaData.headers().contains("x-decoded-size") ? static_cast<std::uint64_t>(static_cast<std::int64_t>(metaData.headers().get("x-decoded-size"))) : 0;
+
+            const AMQP::Table &headers = metaData.headers();
+            if (headers.contains("x-attempt"))
+                _delivery->attempt = static_cast<unsigned int>(std::max<std::int32_t>(static_cast<std::int32_t>(headers.get("x-attempt")), 1));
+            if (headers.contains("x-published-at") && (_tracer || _transitLatency != nullptr))
+                _observeTransit(*_delivery, static_cast<std::int64_t>(headers.get("x-published-at")));
+
+            if (_delivery->streaming != nullptr)
+            {
+                _delivery->streaming->Begin(_delivery->bodySize, metaData.headers());
+                return;
+            }
+
+            // A chunk is written straight to its place in the whole message
+            _delivery->chunk = ChunkInfo::FromHeaders(headers);
+            if (_delivery->chunk.Valid())
+            {
+                _delivery->chunk.size = _delivery->bodySize;
+                _delivery->chunkTarget = _chunks->Begin(_delivery->chunk);
+                _delivery->chunkQueued = headers.contains("x-chunk-queue");
+                _delivery->chunkLasting = headers.contains("x-chunk-lasting");
+                _delivery->assembler.Reset();
+            }
+        }
+    ).onData(
+        [this, _delivery](const char *data, size_t size) {
+            if (_delivery->chunk.Valid())
+            {
+                if (_delivery->chunkTarget != nullptr && _delivery->chunkReceived + size <= _delivery->chunk.size)
+                    std::memcpy(_delivery->chunkTarget + _delivery->chunkReceived, data, size);
+                _delivery->chunkReceived += size;
+                return;
+            }
+
+            if (_delivery->streaming == nullptr)
+            {
+                _delivery->assembler.Append(data, size);
+                return;
+            }
+
+            // The frame lives in our input buffer; it needs its own copy
+            auto chunk = _messagePool->Acquire(size);
+            std::memcpy(chunk.Data(), data, size);
+            _delivery->streaming->Chunk(std::move(chunk));
+        }
+    ).onComplete(
+        [this, _delivery, _channel, _binding](uint64_t tag, bool redelivered) {
+            if (_logSampler->Sample())
+                _logger->info("[onComplete] Received message {} on channel {}", tag, _channel);
+            _delivery->unsettled.insert(tag);
+            if (_delivery->streaming != nullptr)
+            {
+                // Settled once the handler is done with it; streamed bodies
+                // are not kept, so a failed one is rejected, not retried
+                const std::uint64_t generation = _generation;
+                const std::uint64_t traceId = _delivery->traceId;
+                _delivery->streaming->End([this, _binding, tag, generation, traceId](int msgId, bool success) {
+                    Post([this, _binding, tag, generation, traceId, success]() {
+                        if (generation != _generation)
+                            _logger->debug("Dropping settlement of message {} from an earlier connection", tag);
+                        else if (success)
+                            _ack(_binding, {tag});
+                        else
+                            _reject(_binding, {tag});
+                        _endTrace(traceId);
+                    });
+                });
+            }
+            else
+            {
+                // A chunk's ack is held until its whole message is settled;
+                // the message goes on with the chunk that completes it
+                PooledBuffer body;
+                std::vector<std::uint64_t> tags{tag};
+                if (_delivery->chunk.Valid() && !_takeChunk(_binding, tag, *_delivery, body, tags))
+                {
+                    _endTrace(_delivery->traceId);
+                    return;
+                }
+
+                // Acked (or retried) only once processing is over
+                WorkItem item(body ? std::move(body) : _delivery->assembler.Finish());
+
+                // A claim check is swapped for the payload it points at, mapped in place
+                std::shared_ptr<Claim> claim;
+                if (_delivery->claimCheck)
+                {
+                    std::string why;
+                    claim = _openClaim(item, why);
+                    if (!claim)
+                    {
+                        _deadLetter(_binding, tags, *_delivery, item, nullptr, why);
+                        _endTrace(_delivery->traceId);
+                        return;
+                    }
+                    item = WorkItem(claim->Data(), static_cast<std::uint32_t>(claim->Size()));
+                    item.mapping = claim;
+                }
+
+                // A compressed body is decompressed by the worker, into room made here
+                std::string why;
+                if (!_delivery->contentEncoding.empty() && !_prepareDecode(item, _delivery->contentEncoding, _delivery->decodedSize, why))
+                {
+                    _deadLetter(_binding, tags, *_delivery, item, claim, why);
+                    _endTrace(_delivery->traceId);
+                    _delivery->streaming = nullptr;
+                    return;
+                }
+                item.queueClass = _binding;
+                item.traceId = _delivery->traceId;
+
+                // Duplicates of a message already done are settled from the cache
+                std::string key;
+                if (_dedup)
+                {
+                    // Keys from the body are opt-in, scoped by queue, and
+                    // can only be taken once it is decompressed
+                    if (!_delivery->messageId.empty())
+                        key = _delivery->messageId;
+                    else if (_bodyKeys && !item.codec)
+                    {
+                        key = _worker->MessageKey(item.data, item.size);
+                        if (!key.empty())
+                            key.insert(0, _bindings[_binding].queue + '/');
+                    }
+                    if (!key.empty() && _skipDuplicate(_binding, tags, key, redelivered, _delivery->replyTo, _delivery->correlationId))
+                    {
+                        _endTrace(_delivery->traceId);
+                        if (claim)
+                            claim->Release();
+                        _delivery->streaming = nullptr;
+                        return;
+                    }
+                }
+
+                item.onDone = _settler(_binding, tags, _delivery->attempt, _delivery->replyTo, _delivery->correlationId, key, claim);
+
+                // A request gets a buffer for ProcessMessage to write its reply into
+                if (!_delivery->replyTo.empty() && _resultSize > 0)
+                    item.result = _messagePool->Acquire(_resultSize);
+                _worker->AddMessage(std::move(item));
+            }
+            _delivery->streaming = nullptr;
+        }
+    ).onError(
+        [this](const char *message) {
+            _logger->error("[onError] {}", message);
+        }
+    );
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::SetStreamHandler(IStreamHandler* _handler, std::size_t _binding)
+{
+    if (_binding >= _deliveries.size())
+    {
+        _logger->error("No binding {} to stream; ignoring", _binding);
+        return;
+    }
+
+    Delivery &delivery = *_deliveries[_binding];
+    if (delivery.stream != nullptr)
+    {
+        _logger->error("Stream handler already set for binding {}; ignoring", _binding);
+        return;
+    }
+
+    // Start the dispatcher before the IO thread can see it
+    delivery.stream = std::make_unique<StreamDispatcher>(GetId(), GetName() + "Stream" + std::to_string(_binding), _handler);
+    delivery.stream->Run(1);
+    delivery.streamTarget.store(delivery.stream.get());
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::AddMessage(const void *_msg, std::uint32_t _size, std::string _exchange, std::string _key)
+{
+    // Copy now; the caller's buffer is free to go once we return
+    auto publication = std::make_shared<Publication>();
+    publication->exchange = std::move(_exchange);
+    publication->key = std::move(_key);
+    _publish(publication, static_cast<const char *>(_msg), _size);
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::AddMessage(flatbuffers::DetachedBuffer &&_msg, std::string _exchange, std::string _key)
+{
+    // No copy; the publication keeps the builder's memory until confirmed
+    auto message = std::make_shared<flatbuffers::DetachedBuffer>(std::move(_msg));
+    auto publication = std::make_shared<Publication>();
+    publication->exchange = std::move(_exchange);
+    publication->key = std::move(_key);
+    publication->view = std::string_view(reinterpret_cast<const char *>(message->data()), message->size());
+    publication->mapping = std::move(message);
+    _publish(publication, publication->view.data(), publication->view.size());
+}
+
+template <class Handler>
+agent::BuilderPool &agent::AMQPWorkerBase<Handler>::Builders()
+{
+    return _builders;
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_publish(const std::shared_ptr<Publication> &_publication, const char *_data, std::size_t _size)
+{
+    // Wall-clock time, so a consumer on another host can tell how long it took
+    if (_stampPublished)
+        _publication->headers["x-published-at"] = static_cast<std::int64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+    // A large body for a consumer on this host goes through a segment instead
+    if (_claimStore && _size > _claimThreshold)
+    {
+        ClaimHandle handle;
+        if (_claimStore->Put(_data, _size, handle, _claimCount))
+        {
+            _publication->mapping.reset();
+            _publication->body = handle.Encode();
+            _publication->headers["x-claim-check"] = true;
+            Post([this, _publication]() {
+                _channels.At(_publishChannel).Publish(std::move(*_publication));
+            });
+            return;
+        }
+        _logger->warn("Could not write a claim-check segment in {}; sending the body itself", _claimStore->Directory());
+    }
+
+    // Compressed here, on the caller's thread, so the IO thread only sends
+    const bool compressed = _compress(*_publication, _data, _size);
+    const char *data = compressed ? _publication->Data() : _data;
+    const std::size_t size = compressed ? _publication->Size() : _size;
+
+    // A large body is copied straight into its chunks
+    if (_chunkThreshold > 0 && size > _chunkThreshold)
+    {
+        auto chunks = std::make_shared<std::vector<Publication>>(_split(*_publication, data, size));
+        Post([this, chunks]() {
+            _publishChunks(_channels.At(_publishChannel), std::move(*chunks));
+        });
+        return;
+    }
+
+    if (compressed)
+        _publication->mapping.reset();
+    else if (!_publication->mapping)
+        _publication->body.assign(data, size);
+    Post([this, _publication]() {
+        _channels.At(_publishChannel).Publish(std::move(*_publication));
+    });
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::Call(const void *_msg, std::uint32_t _size, std::string _exchange, std::string _key, RpcClient::Callback _callback, std::chrono::milliseconds _timeout)
+{
+    auto request = std::make_shared<Publication>();
+    request->exchange = std::move(_exchange);
+    request->key = std::move(_key);
+    request->body.assign(static_cast<const char *>(_msg), _size);
+
+    Post([this, request, _callback = std::move(_callback), _timeout]() mutable {
+        _startReplyConsumer();
+        request->correlationId = _rpc.Register(std::move(_callback), _timeout);
+        request->replyTo = "amq.rabbitmq.reply-to";
+        _channels.At(_publishChannel).Publish(std::move(*request));
+    });
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_onDisconnected()
+{
+    // Nothing handed to _worker is acked before it is done, so the broker
+    // requeues it all, along with the deliveries in progress, and sends it
+    // again; what _worker finishes meanwhile is settled on a dead channel
+    // and dropped by _settle
+    for (auto &delivery : _deliveries)
+    {
+        if (delivery->streaming != nullptr)
+            delivery->streaming->Abort();
+        delivery->streaming = nullptr;
+        delivery->assembler.Reset();
+        delivery->unsettled.clear();
+        delivery->spentQueues.clear();
+    }
+
+    // Held chunks are requeued along with everything else unacked, so their
+    // messages start over
+    _heldChunks.clear();
+    _chunks->Expire(std::chrono::milliseconds(-1));
+
+    // Delivery tags from here back are meaningless on the new channels
+    ++_generation;
+
+    _channels.Drop();
+    _connection.reset();
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_onReconnected()
+{
+    // Each channel restores its declarations and consumers and republishes
+    // whatever it never had confirmed
+    _connection = std::make_unique<AMQP::Connection>(this, _creds, _vhost);
+    _channels.Open(_connection.get());
+}
+
+template <class Handler>
+agent::WorkItem::Completion agent::AMQPWorkerBase<Handler>::_settler(std::size_t _binding, std::vector<std::uint64_t> _tags, unsigned int _attempt, std::string _replyTo, std::string _correlationId, std::string _key, std::shared_ptr<Claim> _claim)
+{
+    const std::uint64_t generation = _generation;
+    const auto received = std::chrono::steady_clock::now();
+    return [this, _binding, _tags, _attempt, generation, received, _replyTo, _correlationId, _key, _claim](WorkItem &item, int msgId, bool success) {
+        // Runs on a worker thread. A failed body is copied for its retry; a
+        // reply takes over the result buffer the handler wrote into
+        auto outcome = std::make_shared<Publication>();
+        const std::uint64_t traceId = _tracer ? item.traceId : 0;
+        if (traceId != 0)
+            _tracer->Begin("settle", traceId, std::chrono::steady_clock::now());
+
+        // A permanent failure skips the retries left and goes to the dead letters
+        const unsigned int attempt = item.deadLetter ? std::max(_attempt, _retry.maxAttempts) : _attempt;
+        if (!success && _claim)
+        {
+            // The payload stays where it is; only its claim check is retried
+            outcome->body = _claim->Handle().Encode();
+            outcome->headers["x-claim-check"] = true;
+        }
+        else if (!success && item.codec)
+        {
+            // Never decompressed; it goes back as it came
+            outcome->body.assign(static_cast<const char *>(item.data), item.size);
+            outcome->contentEncoding = item.codec->Name();
+            outcome->headers["x-decoded-size"] = static_cast<std::int64_t>(item.decoded.Size());
+        }
+        else if (!success && !_compress(*outcome, static_cast<const char *>(item.data), item.size))
+        {
+            outcome->body.assign(static_cast<const char *>(item.data), item.size);
+        }
+
+        // A failed request keeps its reply address through its retries
+        if (!success)
+        {
+            outcome->replyTo = _replyTo;
+            outcome->correlationId = _correlationId;
+        }
+
+        if (success && !_key.empty())
+        {
+            // Recorded before the ack goes out, so a redelivery after a lost
+            // ack is already known
+            _dedup->Insert(_key, item.result ? std::string(item.result.Data(), item.result.Size()) : std::string());
+        }
+
+        if (success && !_replyTo.empty())
+        {
+            outcome->key = _replyTo;
+            outcome->correlationId = _correlationId;
+            outcome->buffer = std::move(item.result);
+        }
+
+        // A claim-checked payload is let go once its message is acked, not
+        // before, in case the ack is lost and the message comes again
+        Post([this, _binding, _tags, attempt, generation, received, traceId, success, outcome, _claim]() {
+            const bool settled = _settle(_binding, _tags, attempt, generation, success, std::move(*outcome));
+            const auto acked = std::chrono::steady_clock::now();
+
+            // Ended either way, or the trace viewer leaves them open forever
+            if (traceId != 0)
+            {
+                _tracer->End("settle", traceId, acked);
+                _tracer->End("message", traceId, acked);
+            }
+            if (!settled)
+                return;
+            if (_ackLatency != nullptr)
+                _ackLatency->Observe(acked - received);
+            if (success && _claim)
+                _claim->Release();
+        });
+    };
+}
+
+template <class Handler>
+bool agent::AMQPWorkerBase<Handler>::_settle(std::size_t _binding, const std::vector<std::uint64_t> &_tags, unsigned int _attempt, std::uint64_t __generation, bool _success, Publication &&_outcome)
+{
+    // The tag belongs to a channel that is gone; the broker has requeued the
+    // message and will deliver it again
+    if (__generation != _generation)
+    {
+        _logger->debug("Dropping settlement of message {} from an earlier connection", _tags.back());
+        return false;
+    }
+
+    // Retries, dead letters and replies all go on the same channel as the
+    // ack, ahead of it, so they are out before the original goes
+    ManagedChannel &channel = _channels.At(_bindingChannel(_binding));
+    if (!_success)
+    {
+        const std::string &queue = _bindings[_binding].queue;
+        if (_attempt < _retry.maxAttempts)
+        {
+            _outcome.key = RetryPolicy::DelayQueue(queue, _attempt);
+            _outcome.headers["x-attempt"] = static_cast<std::int32_t>(_attempt + 1);
+            _logger->warn("Message {} failed attempt {}; retrying in {} ms", _tags.back(), _attempt, _retry.Delay(_attempt).count());
+        }
+        else
+        {
+            _outcome.key = RetryPolicy::DeadLetterQueue(queue);
+            _outcome.headers["x-attempt"] = static_cast<std::int32_t>(_attempt);
+            _logger->error("Message {} failed attempt {} of {}; dead-lettering", _tags.back(), _attempt, _retry.maxAttempts);
+
+            // A caller waiting on it is told now rather than left to time out
+            if (!_outcome.replyTo.empty())
+            {
+                Publication failure;
+                failure.key = _outcome.replyTo;
+                failure.correlationId = _outcome.correlationId;
+                failure.headers["x-error"] = "Failed after " + std::to_string(_attempt) + " attempt(s)";
+                channel.Publish(std::move(failure));
+            }
+        }
+
+        // A message that came in chunks goes back the same way, its chunks
+        // kept for as long as it waits
+        if (_chunkThreshold > 0 && _outcome.Size() > _chunkThreshold)
+        {
+            const auto wait = _attempt < _retry.maxAttempts ? _retry.Delay(_attempt) : std::chrono::milliseconds::max();
+            _publishChunks(channel, _split(_outcome, _outcome.Data(), _outcome.Size()), wait);
+        }
+        else
+        {
+            channel.Publish(std::move(_outcome));
+        }
+    }
+    else if (!_outcome.key.empty())
+    {
+        // Replies go through the default exchange straight to the caller's queue
+        channel.Publish(std::move(_outcome));
+    }
+
+    _ack(_binding, _tags);
+
+    return true;
+}
+
+template <class Handler>
+bool agent::AMQPWorkerBase<Handler>::_skipDuplicate(std::size_t _binding, const std::vector<std::uint64_t> &_tags, const std::string &_key, bool _redelivered, const std::string &_replyTo, const std::string &_correlationId)
+{
+    Publication reply;
+    if (!_dedup->Find(_key, reply.body))
+        return false;
+
+    _logger->info("Message {} ({}{}) already processed; acking", _tags.back(), _key, _redelivered ? ", redelivered" : "");
+
+    // A repeated request gets the reply it got the first time
+    ManagedChannel &channel = _channels.At(_bindingChannel(_binding));
+    if (!_replyTo.empty())
+    {
+        reply.key = _replyTo;
+        reply.correlationId = _correlationId;
+        channel.Publish(std::move(reply));
+    }
+    _ack(_binding, _tags);
+
+    return true;
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_startReplyConsumer()
+{
+    if (_replyConsumer)
+        return;
+    _replyConsumer = true;
+
+    // Direct reply-to: a pseudo-queue on the channel we publish requests on,
+    // which must be consumed without acks; one consumer serves every call
+    _channels.At(_publishChannel).Consume("amq.rabbitmq.reply-to", "", AMQP::noack, [this](AMQP::DeferredConsumer &consumer) {
+        consumer.onReceived(
+            [this](const AMQP::Message &message, uint64_t tag, bool redelivered) {
+                // A request that failed for good comes back with why instead of a reply
+                const bool failed = message.headers().contains("x-error");
+                if (!_rpc.Resolve(message.correlationID(), message.body(), message.bodySize(), !failed))
+                    _logger->warn("Reply {} matches no outstanding call", message.correlationID());
+            }
+        );
+    });
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_registerMetrics(MetricsRegistry &_registry)
+{
+    Handler::_registerMetrics(_registry);
+    _ackLatency = &_registry.GetHistogram("agent_ack_latency_seconds", "Time from a message's delivery to its ack", {{"connection", GetName()}});
+    _transitLatency = &_registry.GetHistogram("agent_transit_seconds", "Time from a message's publication to its delivery, for messages stamped when published", {{"connection", GetName()}});
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_observeTransit(const Delivery &_delivery, std::int64_t _publishedAt)
+{
+    // The stamp is wall-clock time from the publisher's host, so clocks out
+    // of step can put it in the future; that counts as no time at all
+    const auto published = std::chrono::system_clock::time_point(std::chrono::microseconds(_publishedAt));
+    const auto transit = std::max(std::chrono::system_clock::now() - published, std::chrono::system_clock::duration::zero());
+    if (_transitLatency != nullptr)
+        _transitLatency->Observe(std::chrono::duration_cast<std::chrono::steady_clock::duration>(transit));
+
+    // Drawn as leading up to the delivery, in the steady time of the rest of the trace
+    if (_delivery.traceId != 0)
+    {
+        _tracer->Begin("transit", _delivery.traceId, _delivery.arrived - std::chrono::duration_cast<std::chrono::steady_clock::duration>(transit));
+        _tracer->End("transit", _delivery.traceId, _delivery.arrived);
+    }
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_endTrace(std::uint64_t _traceId)
+{
+    if (_traceId != 0)
+        _tracer->End("message", _traceId, std::chrono::steady_clock::now());
+}
+
+template <class Handler>
+const agent::DedupCache *agent::AMQPWorkerBase<Handler>::GetDedupCache() const
+{
+    return _dedup.get();
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_onPoll()
+{
+    if (_rpc.Outstanding() > 0)
+        _rpc.Expire();
+
+    _channels.Retry(ConfirmTracker::Clock::now());
+
+    // Old segments nobody has a claim on, e.g. left by a consumer that died
+    // removing them, are removed in time
+    if (_claimStore && std::chrono::steady_clock::now() - _claimsCollected > std::chrono::minutes(1))
+    {
+        _claimsCollected = std::chrono::steady_clock::now();
+        const std::size_t removed = _claimStore->Collect();
+        if (removed > 0)
+            _logger->warn("Removed {} abandoned claim-check segment(s)", removed);
+    }
+
+    std::vector<std::string> expired;
+    if (_chunks->Pending() > 0 && _chunks->Expire(_chunkTimeout, ChunkAssembler::Clock::now(), &expired) > 0)
+    {
+        _logger->error("Abandoned {} chunked message(s) whose chunks stopped coming; rejecting them", expired.size());
+        for (const std::string &id : expired)
+            _dropChunks(id);
+    }
+}
+
+template <class Handler>
+bool agent::AMQPWorkerBase<Handler>::_takeChunk(std::size_t _binding, std::uint64_t _tag, Delivery &_delivery, PooledBuffer &_body, std::vector<std::uint64_t> &_tags)
+{
+    const ChunkInfo chunk = std::move(_delivery.chunk);
+    _delivery.chunk = ChunkInfo();
+
+    // Acked with the rest of its message, or rejected with it
+    HeldChunks &held = _heldChunks[chunk.id];
+    held.binding = _binding;
+    held.tags.push_back(_tag);
+
+    if (_delivery.chunkTarget == nullptr)
+    {
+        _logger->error("Chunk {} of {} of message {} does not fit it, or too much is pending; rejecting the message", chunk.seq, chunk.total, chunk.id);
+        _chunks->Drop(chunk.id);
+        _dropChunks(chunk.id);
+        return false;
+    }
+    if (_delivery.chunkReceived != chunk.size)
+    {
+        _logger->error("Chunk {} of message {} has {} bytes, not {}; rejecting the message", chunk.seq, chunk.id, _delivery.chunkReceived, chunk.size);
+        _chunks->Drop(chunk.id);
+        _dropChunks(chunk.id);
+        return false;
+    }
+
+    // The rest wait in the message's own queue, for this consumer alone. It
+    // has no prefetch limit, as the chunks are held unacked until all are in
+    if (_delivery.chunkQueued && held.queue.empty())
+    {
+        held.queue = chunk.Queue();
+        held.lasting = _delivery.chunkLasting;
+        const std::size_t channel = _bindingChannel(_binding);
+        AMQP::Channel &amqp = _channels.At(channel).Channel();
+        amqp.setQos(0);
+        _consumeWith(amqp.consume(held.queue, held.queue, AMQP::exclusive), _deliveries[_binding].get(), channel, _binding);
+        amqp.setQos(_bindings[_binding].prefetch);
+    }
+
+    if (!_chunks->Complete(chunk, _body))
+        return false;
+
+    _tags = std::move(held.tags);
+    if (!held.queue.empty())
+        _channels.At(_bindingChannel(_binding)).Channel().cancel(held.queue);
+    if (held.lasting)
+        _delivery.spentQueues[_tag] = held.queue;
+    _heldChunks.erase(chunk.id);
+    return true;
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_dropChunks(const std::string &_id)
+{
+    auto it = _heldChunks.find(_id);
+    if (it == _heldChunks.end())
+        return;
+
+    // Rejected rather than acked, so a queue with a dead-letter exchange keeps them
+    _reject(it->second.binding, it->second.tags);
+    if (!it->second.queue.empty())
+        _channels.At(_bindingChannel(it->second.binding)).Channel().cancel(it->second.queue);
+    if (it->second.lasting)
+        _channels.At(_bindingChannel(it->second.binding)).Channel().removeQueue(it->second.queue);
+    _heldChunks.erase(it);
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_ack(std::size_t _binding, std::vector<std::uint64_t> _tags)
+{
+    std::set<std::uint64_t> &unsettled = _deliveries[_binding]->unsettled;
+    AMQP::Channel &channel = _channels.At(_bindingChannel(_binding)).Channel();
+    std::sort(_tags.begin(), _tags.end());
+
+    // The chunks of a message go in one multiple-ack on the last of them,
+    // unless another delivery before it is still being worked on
+    const bool alone = _tags.size() > 1
+        && std::all_of(_tags.begin(), _tags.end(), [&unsettled](std::uint64_t _tag) { return unsettled.count(_tag) > 0; })
+        && static_cast<std::size_t>(std::distance(unsettled.begin(), unsettled.upper_bound(_tags.back()))) == _tags.size();
+    if (alone)
+    {
+        channel.ack(_tags.back(), AMQP::multiple);
+    }
+    else
+    {
+        for (std::uint64_t tag : _tags)
+            channel.ack(tag);
+    }
+
+    for (std::uint64_t tag : _tags)
+        unsettled.erase(tag);
+    _removeSpent(_binding, _tags);
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_reject(std::size_t _binding, const std::vector<std::uint64_t> &_tags)
+{
+    std::set<std::uint64_t> &unsettled = _deliveries[_binding]->unsettled;
+    AMQP::Channel &channel = _channels.At(_bindingChannel(_binding)).Channel();
+    for (std::uint64_t tag : _tags)
+    {
+        channel.reject(tag);
+        unsettled.erase(tag);
+    }
+    _removeSpent(_binding, _tags);
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_removeSpent(std::size_t _binding, const std::vector<std::uint64_t> &_tags)
+{
+    // Only once settled, or the chunks in it would go before their acks
+    std::map<std::uint64_t, std::string> &spent = _deliveries[_binding]->spentQueues;
+    for (std::uint64_t tag : _tags)
+    {
+        auto it = spent.find(tag);
+        if (it == spent.end())
+            continue;
+        _channels.At(_bindingChannel(_binding)).Channel().removeQueue(it->second);
+        spent.erase(it);
+    }
+}
+
+template <class Handler>
+std::shared_ptr<agent::Claim> agent::AMQPWorkerBase<Handler>::_openClaim(const WorkItem &_item, std::string &_why)
+{
+    ClaimHandle handle;
+    if (!ClaimHandle::Decode(_item.data, _item.size, handle))
+    {
+        _why = "is a malformed claim check";
+        return nullptr;
+    }
+    if (!_claimStore)
+    {
+        _why = "is a claim check for segment " + handle.segment + ", but claim checks are not enabled";
+        return nullptr;
+    }
+
+    auto claim = _claimStore->Open(handle);
+    if (!claim)
+        _why = "is a claim check for segment " + handle.segment + ", which is gone from " + _claimStore->Directory();
+    return claim;
+}
+
+template <class Handler>
+bool agent::AMQPWorkerBase<Handler>::_compress(Publication &_publication, const char *_data, std::size_t _size)
+{
+    const CompressionPolicy::Rule &rule = _compression.For(_publication.exchange);
+    if (rule.codec.empty() || _size < rule.threshold)
+        return false;
+
+    auto codec = _codecs.Find(rule.codec);
+    if (!codec)
+    {
+        _logger->warn("Unknown codec {} for exchange {}; sending the body as it is", rule.codec, _publication.exchange);
+        return false;
+    }
+
+    // Only worth it if it comes out smaller
+    auto out = _messagePool->Acquire(_size);
+    if (!codec->Encode(_data, _size, out, rule.level))
+        return false;
+
+    _publication.buffer = std::move(out);
+    _publication.contentEncoding = codec->Name();
+    _publication.headers["x-decoded-size"] = static_cast<std::int64_t>(_size);
+    return true;
+}
+
+template <class Handler>
+bool agent::AMQPWorkerBase<Handler>::_prepareDecode(WorkItem &_item, const std::string &_encoding, std::uint64_t _decodedSize, std::string &_why)
+{
+    if (_encoding == "identity")
+        return true;
+
+    _item.codec = _codecs.Find(_encoding);
+    if (!_item.codec)
+    {
+        _why = "is encoded with unknown codec " + _encoding;
+        return false;
+    }
+    if (_decodedSize == 0 && _item.size > 0)
+    {
+        _why = "is encoded with " + _encoding + " but does not say how large it is";
+        return false;
+    }
+    if (_decodedSize > _compression.maxDecodedSize)
+    {
+        _why = "claims to decode to " + std::to_string(_decodedSize) + " bytes, over the limit of " + std::to_string(_compression.maxDecodedSize);
+        return false;
+    }
+
+    _item.decoded = _messagePool->Acquire(static_cast<std::size_t>(_decodedSize));
+    return true;
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_deadLetter(std::size_t _binding, const std::vector<std::uint64_t> &_tags, const Delivery &_delivery, const WorkItem &_item, const std::shared_ptr<Claim> &_claim, const std::string &_why)
+{
+    // Retrying cannot help, so it goes to the dead letters as it came
+    _logger->error("Message {} {}; dead-lettering", _tags.back(), _why);
+    ManagedChannel &channel = _channels.At(_bindingChannel(_binding));
+
+    // A caller waiting on it is told now rather than left to time out
+    if (!_delivery.replyTo.empty())
+    {
+        Publication failure;
+        failure.key = _delivery.replyTo;
+        failure.correlationId = _delivery.correlationId;
+        failure.headers["x-error"] = _why;
+        channel.Publish(std::move(failure));
+    }
+
+    Publication message;
+    message.key = RetryPolicy::DeadLetterQueue(_bindings[_binding].queue);
+    message.replyTo = _delivery.replyTo;
+    message.correlationId = _delivery.correlationId;
+    message.contentEncoding = _delivery.contentEncoding;
+    message.headers["x-attempt"] = static_cast<std::int32_t>(_delivery.attempt);
+    message.headers["x-error"] = _why;
+    if (_delivery.decodedSize > 0)
+        message.headers["x-decoded-size"] = static_cast<std::int64_t>(_delivery.decodedSize);
+    if (_delivery.claimCheck)
+        message.headers["x-claim-check"] = true;
+
+    // A claim-checked payload stays where it is; only its claim check goes
+    if (_claim)
+        message.body = _claim->Handle().Encode();
+    else
+        message.body.assign(static_cast<const char *>(_item.data), _item.size);
+
+    if (_chunkThreshold > 0 && message.Size() > _chunkThreshold)
+        _publishChunks(channel, _split(message, message.Data(), message.Size()), std::chrono::milliseconds::max());
+    else
+        channel.Publish(std::move(message));
+
+    _ack(_binding, _tags);
+}
+
+template <class Handler>
+agent::CodecRegistry &agent::AMQPWorkerBase<Handler>::Codecs()
+{
+    return _codecs;
+}
+
+template <class Handler>
+std::vector<agent::Publication> agent::AMQPWorkerBase<Handler>::_split(const Publication &_whole, const char *_data, std::size_t _size)
+{
+    // Each chunk carries the whole message's headers and properties, so
+    // whichever chunk completes it brings them along
+    std::vector<Publication> chunks;
+    for (const ChunkInfo &info : _splitter->Split(_size))
+    {
+        Publication chunk;
+        chunk.exchange = _whole.exchange;
+        chunk.key = _whole.key;
+        chunk.headers = _whole.headers;
+        chunk.correlationId = _whole.correlationId;
+        chunk.replyTo = _whole.replyTo;
+        chunk.contentEncoding = _whole.contentEncoding;
+        info.ToHeaders(chunk.headers);
+
+        chunk.buffer = _messagePool->Acquire(static_cast<std::size_t>(info.size));
+        std::memcpy(chunk.buffer.Data(), _data + info.offset, static_cast<std::size_t>(info.size));
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+template <class Handler>
+void agent::AMQPWorkerBase<Handler>::_publishChunks(ManagedChannel &_channel, std::vector<Publication> &&__chunks, std::chrono::milliseconds _wait)
+{
+    // All but the first go to a queue of the message's own, which the
+    // consumer given the first then reads, rather than being spread over
+    // every consumer of the work queue. The queue outlives the longest the
+    // first chunk waits to be consumed; one waiting in the dead letters may
+    // wait forever, so its queue never expires and is deleted by its consumer
+    if (__chunks.size() > 1 && _channel.IsOpen())
+    {
+        const std::chrono::milliseconds expires = _wait == std::chrono::milliseconds::max()
+            ? std::chrono::milliseconds(0)
+            : _wait + std::max(2 * _chunkTimeout, std::chrono::milliseconds(1000));
+        const AMQP::Table arguments = ChunkSplitter::Route(__chunks, expires);
+        _channel.Channel().declareQueue(__chunks.back().key, AMQP::durable, arguments);
+    }
+
+    for (auto &chunk : __chunks)
+        _channel.Publish(std::move(chunk));
+}
+
+template <class Handler>
+std::size_t agent::AMQPWorkerBase<Handler>::_bindingChannel(std::size_t _binding) const
+{
+    return _publishChannel + 1 + _binding;
+}
+
+template class agent::AMQPWorkerBase<agent::IConnectionHandler>;
+template class agent::AMQPWorkerBase<agent::IConnectionHandlerSSL>;
@@ -0,0 +1,35 @@
+#include "agent/Backoff.hpp"
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+agent::Backoff::Backoff(std::chrono::milliseconds __initial, std::chrono::milliseconds __maximum)
+    : _initial(std::max(__initial, std::chrono::milliseconds(1))),
+      _maximum(std::max(__maximum, __initial)),
+      _rng(std::random_device{}())
+{
+}
+
+std::chrono::milliseconds agent::Backoff::Next()
+{
+    // Double the ceiling per attempt, stopping before it can overflow
+    auto ceiling = _initial;
+    for (unsigned int i = 0; i < _attempts && ceiling < _maximum; ++i)
+        ceiling *= 2;
+    ceiling = std::min(ceiling, _maximum);
+    ++_attempts;
+
+    std::uniform_int_distribution<long long> jitter(0, ceiling.count() / 2);
+    return std::chrono::milliseconds(ceiling.count() - ceiling.count() / 2 + jitter(_rng));
+}
+
+void agent::Backoff::Reset()
+{
+    _attempts = 0;
+}
+
+unsigned int agent::Backoff::Attempts() const
+{
+    return _attempts;
+}
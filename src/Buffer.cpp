@@ -1,63 +1,161 @@
-#include "agent/Buffer.hpp"
-
-#include <cstdint>
-#include <cstring>
-#include <cassert>
-#include <vector>
-
-agent::Buffer::Buffer(std::size_t _size)
-    : _data(_size), _used(0)
-{}
-
-std::size_t agent::Buffer::Write(const char* _input, std::size_t _size)
-{
-    // If the bytes used same as the size, write nothing
-    if (_used == _data.size())
-        return 0;
-    
-    // Number bytes that would be left over after a write
-    std::size_t numBytes = _size + _used;
-    std::size_t written = 0;
-    
-    // If new potential total number bytes < _data's size then write all _size
-    if (numBytes < _data.size())
-        written =  _size;
-    else
-        written = _data.size() - _used; // Else can only write as many
-    
-    // Copy new data into place after current data
-    std::memcpy(_data.data(), _input, written);
-    _used += written;
-
-    // Return number of bytes written
-    return written;
-}
-
-std::size_t agent::Buffer::Available() const
-{
-    return _used;
-}
-
-const char* agent::Buffer::Data() const
-{
-    return _data.data();
-}
-
-void agent::Buffer::Drain()
-{
-    _used = 0;
-}
-
-void agent::Buffer::Shift(std::size_t _count)
-{
-   assert(_count < _used);
-
-   // Get the number that will be left after shift
-   std::size_t newused = _used - _count;
-
-   // Move _count : _count + newused to front
-   std::memmove(_data.data(), _data.data() + _count, newused);
-
-   // Set _used to the new value
-   _used = newused;
-}
\ No newline at end of file
+#include "agent/Buffer.hpp"
+#include "agent/BufferPool.hpp"
+
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+agent::Buffer::Buffer(std::size_t _size, std::shared_ptr<BufferPool> __pool)
+    : _pool(__pool != nullptr ? __pool : std::make_shared<BufferPool>()),
+      _capacity(_size),
+      _used(0)
+{}
+
+std::size_t agent::Buffer::Write(const char* _input, std::size_t _size)
+{
+    std::size_t written = 0;
+
+    // Fill the tail segment, borrowing new ones until done or at capacity
+    while (written < _size)
+    {
+        std::size_t room = 0;
+        char* tail = Reserve(room);
+        if (room == 0)
+            break;
+
+        const std::size_t count = std::min(room, _size - written);
+        std::memcpy(tail, _input + written, count);
+        Commit(count);
+        written += count;
+    }
+
+    // Return number of bytes written
+    return written;
+}
+
+char* agent::Buffer::Reserve(std::size_t& _size)
+{
+    _size = 0;
+    if (_used >= _capacity)
+        return nullptr;
+
+    // Start a new segment if there is none or the last one is full
+    if (_segments.empty() || _segments.back().end == _segments.back().block.Capacity())
+    {
+        auto block = _pool->Acquire(_pool->SegmentSize());
+        _segments.push_back(Segment{std::move(block), 0, 0});
+    }
+
+    Segment& tail = _segments.back();
+    _size = std::min(tail.block.Capacity() - tail.end, _capacity - _used);
+
+    return tail.block.Data() + tail.end;
+}
+
+void agent::Buffer::Commit(std::size_t _size)
+{
+    assert(!_segments.empty());
+    assert(_segments.back().end + _size <= _segments.back().block.Capacity());
+
+    _segments.back().end += _size;
+    _used += _size;
+}
+
+std::size_t agent::Buffer::Available() const
+{
+    return _used;
+}
+
+std::size_t agent::Buffer::Capacity() const
+{
+    return _capacity;
+}
+
+std::size_t agent::Buffer::Writable() const
+{
+    return _used < _capacity ? _capacity - _used : 0;
+}
+
+const char* agent::Buffer::Data() const
+{
+    if (_segments.empty())
+        return nullptr;
+
+    return _segments.front().block.Data() + _segments.front().begin;
+}
+
+std::size_t agent::Buffer::Contiguous() const
+{
+    if (_segments.empty())
+        return 0;
+
+    return _segments.front().end - _segments.front().begin;
+}
+
+bool agent::Buffer::Linearize(std::size_t _size)
+{
+    if (_size > _used)
+        return false;
+    if (Contiguous() >= _size)
+        return true;
+
+    // Gather the first _size bytes into one block large enough for them
+    auto block = _pool->Acquire(_size);
+    std::size_t copied = 0;
+    while (copied < _size)
+    {
+        Segment& front = _segments.front();
+        const std::size_t count = std::min(front.end - front.begin, _size - copied);
+        std::memcpy(block.Data() + copied, front.block.Data() + front.begin, count);
+        copied += count;
+        front.begin += count;
+
+        // Fully copied segments go back to the pool right away
+        if (front.begin == front.end)
+            _segments.pop_front();
+    }
+
+    _segments.push_front(Segment{std::move(block), 0, _size});
+
+    return true;
+}
+
+void agent::Buffer::Drain()
+{
+    _segments.clear();
+    _used = 0;
+}
+
+void agent::Buffer::Shift(std::size_t _count)
+{
+    assert(_count <= _used);
+    _count = std::min(_count, _used);
+
+    // Walk the segments front to back, releasing the ones fully consumed
+    std::size_t remaining = _count;
+    while (remaining > 0)
+    {
+        Segment& front = _segments.front();
+        const std::size_t count = std::min(front.end - front.begin, remaining);
+        front.begin += count;
+        remaining -= count;
+
+        if (front.begin == front.end)
+            _segments.pop_front();
+    }
+
+    // Set _used to the new value
+    _used -= _count;
+
+    // Nothing left to read; let the last segment go too
+    if (_used == 0)
+        _segments.clear();
+}
+
+std::size_t agent::Buffer::Segments() const
+{
+    return _segments.size();
+}
@@ -0,0 +1,199 @@
+#include "agent/BufferPool.hpp"
+
+#include <new>
+#include <map>
+#include <mutex>
+#include <string>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <utility>
+
+agent::PooledBuffer::PooledBuffer(std::shared_ptr<BufferPool> _pool, char* _block, std::size_t _capacity)
+    : _pool(std::move(_pool)), _data(_block), _size(_capacity), _capacity(_capacity)
+{}
+
+agent::PooledBuffer::PooledBuffer(PooledBuffer&& _other) noexcept
+    : _pool(std::move(_other._pool)),
+      _data(std::exchange(_other._data, nullptr)),
+      _size(std::exchange(_other._size, 0)),
+      _capacity(std::exchange(_other._capacity, 0))
+{}
+
+agent::PooledBuffer& agent::PooledBuffer::operator=(PooledBuffer&& _other) noexcept
+{
+    if (this != &_other)
+    {
+        Reset();
+        _pool = std::move(_other._pool);
+        _data = std::exchange(_other._data, nullptr);
+        _size = std::exchange(_other._size, 0);
+        _capacity = std::exchange(_other._capacity, 0);
+    }
+    return *this;
+}
+
+agent::PooledBuffer::~PooledBuffer()
+{
+    Reset();
+}
+
+char* agent::PooledBuffer::Data()
+{
+    return _data;
+}
+
+const char* agent::PooledBuffer::Data() const
+{
+    return _data;
+}
+
+std::size_t agent::PooledBuffer::Size() const
+{
+    return _size;
+}
+
+std::size_t agent::PooledBuffer::Capacity() const
+{
+    return _capacity;
+}
+
+void agent::PooledBuffer::Resize(std::size_t _newSize)
+{
+    _size = _newSize < _capacity ? _newSize : _capacity;
+}
+
+void agent::PooledBuffer::Reset()
+{
+    // Hand the block back if we have one; without a pool it was never shared
+    if (_data != nullptr)
+    {
+        if (_pool != nullptr)
+            _pool->Release(_data, _capacity);
+        else
+            BufferPool::Free(_data);
+    }
+
+    _pool.reset();
+    _data = nullptr;
+    _size = 0;
+    _capacity = 0;
+}
+
+agent::PooledBuffer::operator bool() const
+{
+    return _data != nullptr;
+}
+
+agent::BufferPool::BufferPool(std::size_t __segmentSize, std::size_t __maxIdleBytes)
+    : _segmentSize(__segmentSize > 0 ? __segmentSize : 1),
+      _maxIdleBytes(__maxIdleBytes)
+{}
+
+agent::BufferPool::~BufferPool()
+{
+    Trim(0);
+}
+
+agent::PooledBuffer agent::BufferPool::Acquire(std::size_t _size)
+{
+    const std::size_t capacity = _classSize(_size);
+    char* block = nullptr;
+
+    // Reuse an idle block of the same class if there is one
+    _lock.lock();
+    auto found = _free.find(capacity);
+    if (found != _free.end() && !found->second.empty())
+    {
+        block = found->second.back();
+        found->second.pop_back();
+        _idleBytes -= capacity;
+    }
+    _lock.unlock();
+
+    // Otherwise go to the allocator
+    if (block == nullptr)
+        block = new (std::align_val_t(Alignment)) char[capacity]();
+
+    PooledBuffer buffer(shared_from_this(), block, capacity);
+    buffer.Resize(_size);
+
+    return buffer;
+}
+
+void agent::BufferPool::Release(char* _block, std::size_t _capacity)
+{
+    if (_block == nullptr)
+        return;
+
+    // Keep the block only if we're under the idle cap
+    _lock.lock();
+    const bool keep = _idleBytes + _capacity <= _maxIdleBytes;
+    if (keep)
+    {
+        _free[_capacity].push_back(_block);
+        _idleBytes += _capacity;
+    }
+    _lock.unlock();
+
+    if (!keep)
+        Free(_block);
+}
+
+std::size_t agent::BufferPool::Trim(std::size_t _keepBytes)
+{
+    std::vector<char*> doomed;
+    std::size_t freed = 0;
+
+    // Drop the largest classes first; they cost the most to hold on to
+    _lock.lock();
+    for (auto cls = _free.rbegin(); cls != _free.rend() && _idleBytes > _keepBytes; ++cls)
+    {
+        while (!cls->second.empty() && _idleBytes > _keepBytes)
+        {
+            doomed.push_back(cls->second.back());
+            cls->second.pop_back();
+            _idleBytes -= cls->first;
+            freed += cls->first;
+        }
+    }
+    _lock.unlock();
+
+    for (auto block : doomed)
+        Free(block);
+
+    return freed;
+}
+
+void agent::BufferPool::Free(char* _block)
+{
+    ::operator delete[](_block, std::align_val_t(Alignment));
+}
+
+std::size_t agent::BufferPool::SegmentSize() const
+{
+    return _segmentSize;
+}
+
+std::size_t agent::BufferPool::IdleBytes() const
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _idleBytes;
+}
+
+std::size_t agent::BufferPool::_classSize(std::size_t _size) const
+{
+    // Double the segment size until the request fits; sizes come off the
+    // wire, so one no class can hold must not wrap the doubling around
+    std::size_t capacity = _segmentSize;
+    while (capacity < _size)
+    {
+        if (capacity > std::numeric_limits<std::size_t>::max() / 2)
+            throw std::length_error("Cannot pool a block of " + std::to_string(_size) + " bytes");
+        capacity <<= 1;
+    }
+
+    return capacity;
+}
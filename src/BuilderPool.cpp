@@ -0,0 +1,124 @@
+#include "agent/BuilderPool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+#include <flatbuffers/flatbuffers.h>
+
+namespace
+{
+    // The builder a thread keeps between messages, and the pool it is from
+    struct ThreadBuilder
+    {
+        std::uint64_t owner = 0;
+        std::unique_ptr<flatbuffers::FlatBufferBuilder> builder;
+    };
+
+    thread_local ThreadBuilder threadBuilder;
+
+    std::atomic<std::uint64_t> serials{0};
+
+    std::unique_ptr<flatbuffers::FlatBufferBuilder> makeBuilder(const std::shared_ptr<agent::BufferPool> &_pool, std::size_t _initialSize)
+    {
+        // The builder owns its allocator, and hands it on with a released message
+        return std::make_unique<flatbuffers::FlatBufferBuilder>(_initialSize, new agent::PoolAllocator(_pool), true);
+    }
+}
+
+agent::PoolAllocator::PoolAllocator(std::shared_ptr<BufferPool> __pool)
+    : _pool(std::move(__pool))
+{}
+
+std::uint8_t* agent::PoolAllocator::allocate(std::size_t _size)
+{
+    PooledBuffer block = _pool->Acquire(_size);
+    auto data = reinterpret_cast<std::uint8_t *>(block.Data());
+    _blocks.push_back(std::move(block));
+    return data;
+}
+
+void agent::PoolAllocator::deallocate(std::uint8_t* _p, std::size_t)
+{
+    auto found = std::find_if(_blocks.begin(), _blocks.end(), [_p](const PooledBuffer &block) {
+        return reinterpret_cast<const std::uint8_t *>(block.Data()) == _p;
+    });
+    if (found != _blocks.end())
+        _blocks.erase(found);
+}
+
+agent::BuilderLease::BuilderLease(std::uint64_t __owner, std::unique_ptr<flatbuffers::FlatBufferBuilder> __builder, std::shared_ptr<BufferPool> __pool, std::size_t __initialSize, std::size_t __keepBytes)
+    : _owner(__owner), _builder(std::move(__builder)), _pool(std::move(__pool)), _initialSize(__initialSize), _keepBytes(__keepBytes)
+{}
+
+agent::BuilderLease& agent::BuilderLease::operator=(BuilderLease&& _other) noexcept
+{
+    if (this != &_other)
+    {
+        _return();
+        _owner = _other._owner;
+        _builder = std::move(_other._builder);
+        _pool = std::move(_other._pool);
+        _initialSize = _other._initialSize;
+        _keepBytes = _other._keepBytes;
+    }
+    return *this;
+}
+
+agent::BuilderLease::~BuilderLease()
+{
+    _return();
+}
+
+flatbuffers::DetachedBuffer agent::BuilderLease::Release()
+{
+    flatbuffers::DetachedBuffer message = _builder->Release();
+
+    // The allocator went with the message; start over with one of our own
+    _builder = makeBuilder(_pool, _initialSize);
+    return message;
+}
+
+// Hands the builder back to the thread, unless it grew too large to keep; the
+// thread's builder for another pool gives way, one of the same pool does not
+void agent::BuilderLease::_return()
+{
+    if (_builder == nullptr)
+        return;
+
+    const bool vacant = threadBuilder.builder == nullptr || threadBuilder.owner != _owner;
+    if (_builder->GetSize() <= _keepBytes && vacant)
+    {
+        _builder->Clear();
+        threadBuilder.owner = _owner;
+        threadBuilder.builder = std::move(_builder);
+    }
+    _builder.reset();
+}
+
+agent::BuilderPool::BuilderPool(std::shared_ptr<BufferPool> __pool, std::size_t __initialSize, std::size_t __keepBytes)
+    : _serial(++serials),
+      _pool(__pool != nullptr ? std::move(__pool) : std::make_shared<BufferPool>()),
+      _initialSize(__initialSize > 0 ? __initialSize : 1),
+      _keepBytes(__keepBytes)
+{}
+
+agent::BuilderLease agent::BuilderPool::Acquire()
+{
+    std::unique_ptr<flatbuffers::FlatBufferBuilder> builder;
+    if (threadBuilder.builder != nullptr && threadBuilder.owner == _serial)
+        builder = std::move(threadBuilder.builder);
+    else
+        builder = makeBuilder(_pool, _initialSize);
+
+    return BuilderLease(_serial, std::move(builder), _pool, _initialSize, _keepBytes);
+}
+
+std::shared_ptr<agent::BufferPool> agent::BuilderPool::Pool() const
+{
+    return _pool;
+}
@@ -0,0 +1,202 @@
+#include "agent/ChannelPool.hpp"
+#include "agent/Topology.hpp"
+#include "agent/ConfirmTracker.hpp"
+#include "agent/Logging.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+#include <amqpcpp.h>
+#include <spdlog/spdlog.h>
+
+agent::ManagedChannel::ManagedChannel(std::shared_ptr<spdlog::logger> __logger, unsigned int __maxAttempts)
+    : _logger(std::move(__logger)), _maxAttempts(std::max(__maxAttempts, 1u))
+{
+}
+
+void agent::ManagedChannel::Open(AMQP::Connection* _connection)
+{
+    _channel = std::make_unique<AMQP::Channel>(_connection);
+
+    // Keep every publish until the broker confirms it; refused ones go out
+    // again once the broker has had time to recover
+    _channel->confirmSelect().onAck(
+        [this](uint64_t tag, bool multiple) {
+            _confirms.Ack(tag, multiple);
+            _backoff.Reset();
+        }
+    ).onNack(
+        [this](uint64_t tag, bool multiple, bool requeue) {
+            _refuse(_confirms.Nack(tag, multiple));
+        }
+    );
+    _channel->onError(
+        [this](const char* message) {
+            _logger->error("[Channel] {}", message);
+        }
+    );
+
+    _topology.Replay(*_channel);
+
+    // Whatever the old channel never confirmed goes out again on this one
+    auto pending = _confirms.Reset();
+    if (!pending.empty())
+        _logger->warn("Republishing {} unconfirmed message(s)", pending.size());
+    for (auto& publication : pending)
+        Publish(std::move(publication));
+}
+
+void agent::ManagedChannel::Drop()
+{
+    _channel.reset();
+}
+
+void agent::ManagedChannel::Close()
+{
+    if (_channel != nullptr)
+        _channel->close();
+}
+
+bool agent::ManagedChannel::IsOpen() const
+{
+    return _channel != nullptr;
+}
+
+AMQP::Channel& agent::ManagedChannel::Channel()
+{
+    return *_channel;
+}
+
+void agent::ManagedChannel::DeclareExchange(const std::string& _name, AMQP::ExchangeType _type, int _flags, const AMQP::Table& _arguments)
+{
+    _topology.DeclareExchange(*_channel, _name, _type, _flags, _arguments);
+}
+
+void agent::ManagedChannel::DeclareQueue(const std::string& _name, int _flags, const AMQP::Table& _arguments)
+{
+    _topology.DeclareQueue(*_channel, _name, _flags, _arguments);
+}
+
+void agent::ManagedChannel::BindQueue(const std::string& _exchange, const std::string& _queue, const std::string& _key, const AMQP::Table& _arguments)
+{
+    _topology.BindQueue(*_channel, _exchange, _queue, _key, _arguments);
+}
+
+void agent::ManagedChannel::SetQos(std::uint16_t _prefetch)
+{
+    _topology.SetQos(*_channel, _prefetch);
+}
+
+void agent::ManagedChannel::Consume(const std::string& _queue, const std::string& _tag, int _flags, Topology::ConsumerSetup _setup)
+{
+    _topology.Consume(*_channel, _queue, _tag, _flags, std::move(_setup));
+}
+
+void agent::ManagedChannel::Publish(Publication&& _publication)
+{
+    AMQP::Envelope envelope(_publication.Data(), _publication.Size());
+    if (_publication.headers.size() > 0)
+        envelope.setHeaders(_publication.headers);
+    if (!_publication.correlationId.empty())
+        envelope.setCorrelationID(_publication.correlationId);
+    if (!_publication.replyTo.empty())
+        envelope.setReplyTo(_publication.replyTo);
+    if (!_publication.contentEncoding.empty())
+        envelope.setContentEncoding(_publication.contentEncoding);
+
+    if (_channel != nullptr && _channel->publish(_publication.exchange, _publication.key, envelope))
+        _confirms.Sent(std::move(_publication));
+    else
+        _confirms.Hold(std::move(_publication));
+}
+
+std::size_t agent::ManagedChannel::Unconfirmed() const
+{
+    return _confirms.Pending();
+}
+
+void agent::ManagedChannel::Retry(ConfirmTracker::Clock::time_point _now)
+{
+    for (auto& publication : _confirms.Due(_now))
+        Publish(std::move(publication));
+}
+
+void agent::ManagedChannel::OnRefused(RefusedHandler _handler)
+{
+    _onRefused = std::move(_handler);
+}
+
+void agent::ManagedChannel::_refuse(std::vector<Publication>&& _refused)
+{
+    const auto delay = _backoff.Next();
+    const auto retryAt = ConfirmTracker::Clock::now() + delay;
+
+    std::size_t retried = 0;
+    for (auto& publication : _refused)
+    {
+        if (++publication.refusals < _maxAttempts)
+        {
+            _confirms.Refused(std::move(publication), retryAt);
+            ++retried;
+            continue;
+        }
+
+        _logger->error("[onNack] Broker refused a message to '{}' with key '{}' {} time(s); giving up", publication.exchange, publication.key, publication.refusals);
+        if (_onRefused)
+            _onRefused(std::move(publication));
+    }
+
+    if (retried > 0)
+        _logger->warn("[onNack] Broker refused {} message(s); publishing again in {} ms", retried, delay.count());
+}
+
+agent::ChannelPool::ChannelPool(const std::string& __name)
+{
+    _logger = GetLogger(__name);
+}
+
+std::size_t agent::ChannelPool::Add(AMQP::Connection* _connection)
+{
+    _channels.push_back(std::make_unique<ManagedChannel>(_logger));
+    if (_connection != nullptr)
+        _channels.back()->Open(_connection);
+    return _channels.size() - 1;
+}
+
+agent::ManagedChannel& agent::ChannelPool::At(std::size_t _index)
+{
+    return *_channels.at(_index);
+}
+
+std::size_t agent::ChannelPool::Size() const
+{
+    return _channels.size();
+}
+
+void agent::ChannelPool::Open(AMQP::Connection* _connection)
+{
+    for (auto& channel : _channels)
+        channel->Open(_connection);
+}
+
+void agent::ChannelPool::Drop()
+{
+    for (auto& channel : _channels)
+        channel->Drop();
+}
+
+void agent::ChannelPool::Close()
+{
+    for (auto& channel : _channels)
+        channel->Close();
+}
+
+void agent::ChannelPool::Retry(ConfirmTracker::Clock::time_point _now)
+{
+    for (auto& channel : _channels)
+        channel->Retry(_now);
+}
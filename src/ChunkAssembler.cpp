@@ -0,0 +1,196 @@
+#include "agent/ChunkAssembler.hpp"
+#include "agent/BufferPool.hpp"
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <limits>
+#include <algorithm>
+
+#include <amqpcpp.h>
+
+agent::ChunkInfo agent::ChunkInfo::FromHeaders(const AMQP::Table& _headers)
+{
+    ChunkInfo chunk;
+    if (!_headers.contains("x-chunk-id"))
+        return chunk;
+
+    chunk.id = static_cast<const std::string&>(_headers.get("x-chunk-id"));
+    chunk.seq = static_cast<std::uint32_t>(static_cast<std::int64_t>(_headers.get("x-chunk-seq")));
+    chunk.total = static_cast<std::uint32_t>(static_cast<std::int64_t>(_headers.get("x-chunk-total")));
+    chunk.offset = static_cast<std::uint64_t>(static_cast<std::int64_t>(_headers.get("x-chunk-offset")));
+    chunk.bytes = static_cast<std::uint64_t>(static_cast<std::int64_t>(_headers.get("x-chunk-bytes")));
+    return chunk;
+}
+
+std::string agent::ChunkInfo::Queue() const
+{
+    return "agent.chunks." + id;
+}
+
+void agent::ChunkInfo::ToHeaders(AMQP::Table& _headers) const
+{
+    _headers["x-chunk-id"] = id;
+    _headers["x-chunk-seq"] = static_cast<std::int64_t>(seq);
+    _headers["x-chunk-total"] = static_cast<std::int64_t>(total);
+    _headers["x-chunk-offset"] = static_cast<std::int64_t>(offset);
+    _headers["x-chunk-bytes"] = static_cast<std::int64_t>(bytes);
+}
+
+agent::ChunkSplitter::ChunkSplitter(std::uint64_t __chunkSize)
+    : _chunkSize(std::max<std::uint64_t>(__chunkSize, 1))
+{
+    std::random_device device;
+    const std::uint64_t seed = (static_cast<std::uint64_t>(device()) << 32) | device();
+
+    static const char digits[] = "0123456789abcdef";
+    for (int shift = 60; shift >= 0; shift -= 4)
+        _prefix += digits[(seed >> shift) & 0xf];
+    _prefix += '-';
+}
+
+std::vector<agent::ChunkInfo> agent::ChunkSplitter::Split(std::uint64_t _bytes)
+{
+    const std::string id = _prefix + std::to_string(++_next);
+    const std::uint64_t total = std::max<std::uint64_t>((_bytes + _chunkSize - 1) / _chunkSize, 1);
+
+    std::vector<ChunkInfo> chunks;
+    chunks.reserve(total);
+    for (std::uint64_t seq = 0; seq < total; ++seq)
+    {
+        ChunkInfo chunk;
+        chunk.id = id;
+        chunk.seq = static_cast<std::uint32_t>(seq);
+        chunk.total = static_cast<std::uint32_t>(total);
+        chunk.offset = seq * _chunkSize;
+        chunk.size = std::min(_chunkSize, _bytes - chunk.offset);
+        chunk.bytes = _bytes;
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+AMQP::Table agent::ChunkSplitter::Route(std::vector<Publication>& _chunks, std::chrono::milliseconds _expires)
+{
+    AMQP::Table arguments;
+    if (_chunks.size() < 2)
+        return arguments;
+
+    const std::string queue = ChunkInfo::FromHeaders(_chunks.front().headers).Queue();
+    if (_expires.count() > 0)
+        arguments["x-expires"] = static_cast<std::int32_t>(std::min<std::int64_t>(_expires.count(), std::numeric_limits<std::int32_t>::max()));
+    else
+        _chunks.front().headers["x-chunk-lasting"] = true;
+
+    _chunks.front().headers["x-chunk-queue"] = queue;
+    for (std::size_t i = 1; i < _chunks.size(); ++i)
+    {
+        _chunks[i].exchange.clear();
+        _chunks[i].key = queue;
+    }
+    return arguments;
+}
+
+agent::ChunkAssembler::ChunkAssembler(std::shared_ptr<BufferPool> __pool, std::uint64_t __maxBytes)
+    : _pool(std::move(__pool)),
+      _maxBytes(__maxBytes)
+{}
+
+char* agent::ChunkAssembler::Begin(const ChunkInfo& _chunk, Clock::time_point _now)
+{
+    if (_chunk.seq >= _chunk.total || _chunk.offset > _chunk.bytes || _chunk.size > _chunk.bytes - _chunk.offset)
+        return nullptr;
+
+    // Every chunk holds a byte or more, bar the one chunk of an empty
+    // message; any more chunks than that is a header not to size anything by
+    if (_chunk.total > std::max<std::uint64_t>(_chunk.bytes, 1))
+        return nullptr;
+
+    auto it = _partials.find(_chunk.id);
+    if (it == _partials.end())
+    {
+        if (_pendingBytes + _chunk.bytes > _maxBytes)
+            return nullptr;
+
+        // The first chunk to arrive sizes the buffer for the whole message
+        Partial partial;
+        partial.buffer = _pool->Acquire(static_cast<std::size_t>(_chunk.bytes));
+        partial.received.assign(_chunk.total, false);
+        partial.remaining = _chunk.total;
+        it = _partials.emplace(_chunk.id, std::move(partial)).first;
+        _pendingBytes += _chunk.bytes;
+    }
+    else if (it->second.received.size() != _chunk.total || it->second.buffer.Size() != _chunk.bytes)
+    {
+        return nullptr;
+    }
+
+    it->second.touched = _now;
+    return it->second.buffer.Data() + _chunk.offset;
+}
+
+bool agent::ChunkAssembler::Complete(const ChunkInfo& _chunk, PooledBuffer& _message)
+{
+    auto it = _partials.find(_chunk.id);
+    if (it == _partials.end())
+        return false;
+
+    Partial& partial = it->second;
+    if (!partial.received[_chunk.seq])
+    {
+        partial.received[_chunk.seq] = true;
+        --partial.remaining;
+    }
+    if (partial.remaining > 0)
+        return false;
+
+    _message = std::move(partial.buffer);
+    _pendingBytes -= _message.Size();
+    _partials.erase(it);
+
+    return true;
+}
+
+void agent::ChunkAssembler::Drop(const std::string& _id)
+{
+    auto it = _partials.find(_id);
+    if (it == _partials.end())
+        return;
+
+    _pendingBytes -= it->second.buffer.Size();
+    _partials.erase(it);
+}
+
+std::size_t agent::ChunkAssembler::Expire(std::chrono::milliseconds _maxAge, Clock::time_point _now, std::vector<std::string>* _expired)
+{
+    std::size_t expired = 0;
+    for (auto it = _partials.begin(); it != _partials.end();)
+    {
+        if (_now - it->second.touched > _maxAge)
+        {
+            if (_expired != nullptr)
+                _expired->push_back(it->first);
+            _pendingBytes -= it->second.buffer.Size();
+            it = _partials.erase(it);
+            ++expired;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return expired;
+}
+
+std::size_t agent::ChunkAssembler::Pending() const
+{
+    return _partials.size();
+}
+
+std::uint64_t agent::ChunkAssembler::PendingBytes() const
+{
+    return _pendingBytes;
+}
@@ -0,0 +1,33 @@
+#include "agent/ClaimStore.hpp"
+#include "ClaimCheck_generated.h"
+
+#include <string>
+#include <cstdint>
+
+#include <flatbuffers/flatbuffers.h>
+
+std::string agent::ClaimHandle::Encode() const
+{
+    flatbuffers::FlatBufferBuilder builder(64 + segment.size());
+    auto name = builder.CreateString(segment);
+    Messages::FinishClaimCheckBuffer(builder, Messages::CreateClaimCheck(builder, name, offset, length, generation));
+
+    return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()), builder.GetSize());
+}
+
+bool agent::ClaimHandle::Decode(const void* _data, std::size_t _size, ClaimHandle& _handle)
+{
+    flatbuffers::Verifier verifier(static_cast<const std::uint8_t*>(_data), _size);
+    if (!Messages::VerifyClaimCheckBuffer(verifier))
+        return false;
+
+    auto claim = Messages::GetClaimCheck(_data);
+    if (claim->segment() == nullptr)
+        return false;
+
+    _handle.segment = claim->segment()->str();
+    _handle.offset = claim->offset();
+    _handle.length = claim->length();
+    _handle.generation = claim->generation();
+    return true;
+}
@@ -0,0 +1,261 @@
+#include "agent/ClaimStore.hpp"
+
+#include <new>
+#include <ctime>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace
+{
+    /**
+     * Every segment starts with this header; the payload follows at
+     * headerSize. The claim count is updated in place by every process that
+     * maps the segment, so it must be lock-free
+     */
+    struct SegmentHeader
+    {
+        std::uint64_t magic;
+        std::uint64_t generation;
+        std::uint64_t length;
+        std::atomic<std::uint64_t> claims;
+    };
+
+    constexpr std::uint64_t segmentMagic = 0x6b63656863676761ULL; // "aggcheck"
+    constexpr std::size_t headerSize = 64;
+
+    static_assert(sizeof(SegmentHeader) <= headerSize, "Segment header outgrew its room");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Claim counts need lock-free atomics to be shared");
+
+    // Segments are named by their generation, which tells them from anything
+    // else in the directory
+    std::string segmentName(std::uint64_t _generation)
+    {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(_generation));
+        return name;
+    }
+
+    bool isSegmentName(const char* _name)
+    {
+        std::size_t length = 0;
+        for (; _name[length] != '\0'; ++length)
+        {
+            const char c = _name[length];
+            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                return false;
+        }
+        return length == 16;
+    }
+
+    // Like mkdir -p
+    bool makeDirectories(const std::string& _path)
+    {
+        for (std::size_t slash = _path.find('/', 1); ; slash = _path.find('/', slash + 1))
+        {
+            const std::string prefix = _path.substr(0, slash);
+            if (!prefix.empty() && mkdir(prefix.c_str(), 0700) != 0 && errno != EEXIST)
+                return false;
+            if (slash == std::string::npos)
+                break;
+        }
+
+        struct stat status;
+        return stat(_path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+    }
+
+    // Whether anyone still has a claim on a segment; one never finished
+    // being written has none
+    bool isClaimed(const std::string& _path)
+    {
+        const int fd = open(_path.c_str(), O_RDWR);
+        if (fd < 0)
+            return false;
+
+        struct stat status;
+        void* base = MAP_FAILED;
+        if (fstat(fd, &status) == 0 && static_cast<std::uint64_t>(status.st_size) >= headerSize)
+            base = mmap(nullptr, headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+            return false;
+
+        auto header = static_cast<const SegmentHeader*>(base);
+        const bool claimed = header->magic == segmentMagic && header->claims.load() > 0;
+        munmap(base, headerSize);
+        return claimed;
+    }
+}
+
+agent::Claim::Claim(std::string __path, char* __base, std::size_t __mapped, ClaimHandle __handle)
+    : _path(std::move(__path)),
+      _base(__base),
+      _mapped(__mapped),
+      _handle(std::move(__handle))
+{}
+
+agent::Claim::~Claim()
+{
+    munmap(_base, _mapped);
+}
+
+const char* agent::Claim::Data() const
+{
+    return _base + _handle.offset;
+}
+
+std::size_t agent::Claim::Size() const
+{
+    return static_cast<std::size_t>(_handle.length);
+}
+
+const agent::ClaimHandle& agent::Claim::Handle() const
+{
+    return _handle;
+}
+
+bool agent::Claim::Release()
+{
+    if (_released)
+        return false;
+    _released = true;
+
+    // Our mapping stays valid after the unlink, until we are destroyed
+    auto header = reinterpret_cast<SegmentHeader*>(_base);
+    if (header->claims.fetch_sub(1) != 1)
+        return false;
+
+    unlink(_path.c_str());
+    return true;
+}
+
+agent::ClaimStore::ClaimStore(std::string __directory, std::chrono::seconds __maxAge)
+    : _directory(std::move(__directory)),
+      _maxAge(__maxAge),
+      _random(std::random_device{}())
+{
+    if (!makeDirectories(_directory))
+        throw std::runtime_error("Cannot create claim-check directory " + _directory + ": " + std::strerror(errno));
+}
+
+bool agent::ClaimStore::Put(const void* _data, std::size_t _size, ClaimHandle& _handle, std::uint32_t _claims)
+{
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(_random_lock);
+        generation = _random();
+    }
+
+    const std::string segment = segmentName(generation);
+    const std::string path = _path(segment);
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return false;
+
+    // Written through a mapping; on a tmpfs that is the only copy made
+    const std::size_t mapped = headerSize + _size;
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(mapped)) == 0)
+        base = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        unlink(path.c_str());
+        return false;
+    }
+
+    auto header = new (base) SegmentHeader;
+    header->magic = segmentMagic;
+    header->generation = generation;
+    header->length = _size;
+    header->claims.store(_claims);
+    std::memcpy(static_cast<char*>(base) + headerSize, _data, _size);
+    munmap(base, mapped);
+
+    _handle.segment = segment;
+    _handle.offset = headerSize;
+    _handle.length = _size;
+    _handle.generation = generation;
+
+    return true;
+}
+
+std::shared_ptr<agent::Claim> agent::ClaimStore::Open(const ClaimHandle& _handle)
+{
+    // Handles come off the wire; only ever look inside our own directory
+    if (!isSegmentName(_handle.segment.c_str()))
+        return nullptr;
+
+    const std::string path = _path(_handle.segment);
+    const int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat status;
+    const bool fits = fstat(fd, &status) == 0
+        && static_cast<std::uint64_t>(status.st_size) >= headerSize
+        && _handle.offset >= headerSize
+        && _handle.offset <= static_cast<std::uint64_t>(status.st_size)
+        && _handle.length <= static_cast<std::uint64_t>(status.st_size) - _handle.offset;
+
+    void* base = MAP_FAILED;
+    if (fits)
+        base = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return nullptr;
+
+    auto claim = std::make_shared<Claim>(path, static_cast<char*>(base), static_cast<std::size_t>(status.st_size), _handle);
+    auto header = static_cast<const SegmentHeader*>(base);
+    if (header->magic != segmentMagic || header->generation != _handle.generation)
+        return nullptr;
+
+    return claim;
+}
+
+std::size_t agent::ClaimStore::Collect()
+{
+    DIR* directory = opendir(_directory.c_str());
+    if (directory == nullptr)
+        return 0;
+
+    const std::time_t cutoff = std::time(nullptr) - static_cast<std::time_t>(_maxAge.count());
+    std::size_t removed = 0;
+    while (const dirent* entry = readdir(directory))
+    {
+        if (!isSegmentName(entry->d_name))
+            continue;
+
+        const std::string path = _path(entry->d_name);
+        struct stat status;
+        if (stat(path.c_str(), &status) == 0 && status.st_mtime < cutoff && !isClaimed(path) && unlink(path.c_str()) == 0)
+            ++removed;
+    }
+    closedir(directory);
+
+    return removed;
+}
+
+const std::string& agent::ClaimStore::Directory() const
+{
+    return _directory;
+}
+
+std::string agent::ClaimStore::_path(const std::string& _segment) const
+{
+    return _directory + "/" + _segment;
+}
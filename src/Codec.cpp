@@ -0,0 +1,197 @@
+#include "agent/Codec.hpp"
+#include "agent/BufferPool.hpp"
+#include "agent/IWorker.hpp"
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+#include <json/json.h>
+#include <Poco/Exception.h>
+#include <Poco/MemoryStream.h>
+#include <Poco/DeflatingStream.h>
+#include <Poco/InflatingStream.h>
+
+#ifdef AGENT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef AGENT_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace
+{
+    /**
+     * zlib through Poco's streams, which read and write our buffers in
+     * place; running out of room in the output ends the attempt
+     */
+    class DeflateCodec : public agent::Codec
+    {
+    public:
+        const char* Name() const override
+        {
+            return "deflate";
+        }
+
+        bool Encode(const char* _data, std::size_t _size, agent::PooledBuffer& _out, int _level) const override
+        {
+            try
+            {
+                Poco::MemoryOutputStream sink(_out.Data(), static_cast<std::streamsize>(_out.Capacity()));
+                Poco::DeflatingOutputStream deflater(sink, Poco::DeflatingStreamBuf::STREAM_ZLIB, _level);
+                deflater.write(_data, static_cast<std::streamsize>(_size));
+                deflater.close();
+                if (!sink.good())
+                    return false;
+
+                _out.Resize(static_cast<std::size_t>(sink.charsWritten()));
+                return true;
+            }
+            catch (const Poco::Exception &)
+            {
+                return false;
+            }
+        }
+
+        void Decode(const char* _data, std::size_t _size, char* _out, std::size_t _outSize) const override
+        {
+            try
+            {
+                Poco::MemoryInputStream source(_data, static_cast<std::streamsize>(_size));
+                Poco::InflatingInputStream inflater(source, Poco::InflatingStreamBuf::STREAM_ZLIB);
+                inflater.read(_out, static_cast<std::streamsize>(_outSize));
+                if (static_cast<std::size_t>(inflater.gcount()) != _outSize || inflater.get() != std::char_traits<char>::eof())
+                    throw agent::PermanentFailure("Deflated body is not the size it claims");
+            }
+            catch (const Poco::Exception &e)
+            {
+                throw agent::PermanentFailure(std::string("Corrupt deflated body: ") + e.what());
+            }
+        }
+    };
+
+#ifdef AGENT_HAVE_ZSTD
+    class ZstdCodec : public agent::Codec
+    {
+    public:
+        const char* Name() const override
+        {
+            return "zstd";
+        }
+
+        bool Encode(const char* _data, std::size_t _size, agent::PooledBuffer& _out, int _level) const override
+        {
+            const std::size_t written = ZSTD_compress(_out.Data(), _out.Capacity(), _data, _size, _level);
+            if (ZSTD_isError(written))
+                return false;
+
+            _out.Resize(written);
+            return true;
+        }
+
+        void Decode(const char* _data, std::size_t _size, char* _out, std::size_t _outSize) const override
+        {
+            const std::size_t written = ZSTD_decompress(_out, _outSize, _data, _size);
+            if (ZSTD_isError(written))
+                throw agent::PermanentFailure(std::string("Corrupt zstd body: ") + ZSTD_getErrorName(written));
+            if (written != _outSize)
+                throw agent::PermanentFailure("zstd body is not the size it claims");
+        }
+    };
+#endif
+
+#ifdef AGENT_HAVE_LZ4
+    // LZ4 blocks; the level is its acceleration, where higher is faster
+    class Lz4Codec : public agent::Codec
+    {
+    public:
+        const char* Name() const override
+        {
+            return "lz4";
+        }
+
+        bool Encode(const char* _data, std::size_t _size, agent::PooledBuffer& _out, int _level) const override
+        {
+            const int written = LZ4_compress_fast(_data, _out.Data(), static_cast<int>(_size), static_cast<int>(_out.Capacity()), _level);
+            if (written <= 0)
+                return false;
+
+            _out.Resize(static_cast<std::size_t>(written));
+            return true;
+        }
+
+        void Decode(const char* _data, std::size_t _size, char* _out, std::size_t _outSize) const override
+        {
+            const int written = LZ4_decompress_safe(_data, _out, static_cast<int>(_size), static_cast<int>(_outSize));
+            if (written < 0 || static_cast<std::size_t>(written) != _outSize)
+                throw agent::PermanentFailure("Corrupt lz4 body");
+        }
+    };
+#endif
+}
+
+agent::CodecRegistry::CodecRegistry()
+{
+    Register(std::make_shared<DeflateCodec>());
+#ifdef AGENT_HAVE_ZSTD
+    Register(std::make_shared<ZstdCodec>());
+#endif
+#ifdef AGENT_HAVE_LZ4
+    Register(std::make_shared<Lz4Codec>());
+#endif
+}
+
+void agent::CodecRegistry::Register(std::shared_ptr<const Codec> _codec)
+{
+    std::lock_guard<std::mutex> lock(_codecs_lock);
+    _codecs[_codec->Name()] = std::move(_codec);
+}
+
+std::shared_ptr<const agent::Codec> agent::CodecRegistry::Find(const std::string& _name) const
+{
+    std::lock_guard<std::mutex> lock(_codecs_lock);
+    auto it = _codecs.find(_name);
+    return it != _codecs.end() ? it->second : nullptr;
+}
+
+std::vector<std::string> agent::CodecRegistry::Names() const
+{
+    std::lock_guard<std::mutex> lock(_codecs_lock);
+    std::vector<std::string> names;
+    for (const auto& codec : _codecs)
+        names.push_back(codec.first);
+    return names;
+}
+
+const agent::CompressionPolicy::Rule& agent::CompressionPolicy::For(const std::string& _exchange) const
+{
+    auto it = exchanges.find(_exchange);
+    return it != exchanges.end() ? it->second : defaults;
+}
+
+agent::CompressionPolicy agent::CompressionPolicy::FromJson(const Json::Value& _config)
+{
+    // Exchanges inherit whatever they do not set from the defaults
+    auto readRule = [](const Json::Value& _rule, const Rule& _base) {
+        Rule rule;
+        rule.codec = _rule.get("codec", _base.codec).asString();
+        rule.threshold = _rule.get("threshold", Json::Value::UInt64(_base.threshold)).asUInt64();
+        rule.level = _rule.get("level", _base.level).asInt();
+        return rule;
+    };
+
+    CompressionPolicy policy;
+    policy.defaults = readRule(_config, Rule());
+    policy.maxDecodedSize = _config.get("maxDecodedSize", Json::Value::UInt64(policy.maxDecodedSize)).asUInt64();
+
+    const Json::Value& exchanges = _config["exchanges"];
+    for (const auto& name : exchanges.getMemberNames())
+        policy.exchanges[name] = readRule(exchanges[name], policy.defaults);
+
+    return policy;
+}
@@ -0,0 +1,84 @@
+#include "agent/ConfirmTracker.hpp"
+
+#include <map>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+std::uint64_t agent::ConfirmTracker::Sent(Publication&& _publication)
+{
+    _unconfirmed.emplace(++_tag, std::move(_publication));
+    return _tag;
+}
+
+void agent::ConfirmTracker::Hold(Publication&& _publication)
+{
+    _held.push_back(std::move(_publication));
+}
+
+void agent::ConfirmTracker::Ack(std::uint64_t _tag, bool _multiple)
+{
+    _take(_tag, _multiple);
+}
+
+std::vector<agent::Publication> agent::ConfirmTracker::Nack(std::uint64_t _tag, bool _multiple)
+{
+    return _take(_tag, _multiple);
+}
+
+void agent::ConfirmTracker::Refused(Publication&& _publication, Clock::time_point _retryAt)
+{
+    _refused.emplace(_retryAt, std::move(_publication));
+}
+
+std::vector<agent::Publication> agent::ConfirmTracker::Due(Clock::time_point _now)
+{
+    std::vector<Publication> due;
+
+    auto last = _refused.upper_bound(_now);
+    for (auto it = _refused.begin(); it != last; ++it)
+        due.push_back(std::move(it->second));
+    _refused.erase(_refused.begin(), last);
+
+    return due;
+}
+
+std::vector<agent::Publication> agent::ConfirmTracker::Reset()
+{
+    std::vector<Publication> pending;
+    pending.reserve(Pending());
+
+    for (auto& entry : _unconfirmed)
+        pending.push_back(std::move(entry.second));
+    for (auto& publication : _held)
+        pending.push_back(std::move(publication));
+
+    _unconfirmed.clear();
+    _held.clear();
+    _tag = 0;
+
+    return pending;
+}
+
+std::size_t agent::ConfirmTracker::Pending() const
+{
+    return _unconfirmed.size() + _held.size() + _refused.size();
+}
+
+std::vector<agent::Publication> agent::ConfirmTracker::_take(std::uint64_t _tag, bool _multiple)
+{
+    std::vector<Publication> taken;
+
+    // Tags are handed out in order, so "multiple" is everything up to _tag
+    auto first = _multiple ? _unconfirmed.begin() : _unconfirmed.find(_tag);
+    auto last = _unconfirmed.upper_bound(_tag);
+    if (first == _unconfirmed.end())
+        return taken;
+
+    for (auto it = first; it != last; ++it)
+        taken.push_back(std::move(it->second));
+    _unconfirmed.erase(first, last);
+
+    return taken;
+}
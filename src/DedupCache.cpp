@@ -0,0 +1,118 @@
+#include "agent/DedupCache.hpp"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+agent::DedupCache::DedupCache(std::size_t _maxEntries, std::size_t _maxBytes, std::size_t _shards)
+    : _shards(new Shard[std::max<std::size_t>(_shards, 1)]),
+      _shardCount(std::max<std::size_t>(_shards, 1))
+{
+    _entriesPerShard = std::max<std::size_t>(_maxEntries / _shardCount, 1);
+    _bytesPerShard = std::max<std::size_t>(_maxBytes / _shardCount, 1);
+}
+
+bool agent::DedupCache::Find(const std::string& _key, std::string& _result)
+{
+    Shard& shard = _shardFor(_key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto it = shard.index.find(_key);
+    if (it == shard.index.end())
+    {
+        ++_misses;
+        return false;
+    }
+
+    // A duplicate now makes another likely soon; keep it longest
+    shard.order.splice(shard.order.begin(), shard.order, it->second);
+    _result = it->second->result;
+    ++_hits;
+
+    return true;
+}
+
+void agent::DedupCache::Insert(const std::string& _key, std::string _result)
+{
+    Entry entry{_key, std::move(_result)};
+    const std::size_t cost = _cost(entry);
+    if (cost > _bytesPerShard)
+        return;
+
+    Shard& shard = _shardFor(_key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto it = shard.index.find(_key);
+    if (it != shard.index.end())
+    {
+        shard.bytes -= _cost(*it->second);
+        shard.order.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    // Make room at the cold end
+    while (!shard.order.empty() && (shard.order.size() >= _entriesPerShard || shard.bytes + cost > _bytesPerShard))
+    {
+        shard.bytes -= _cost(shard.order.back());
+        shard.index.erase(shard.order.back().key);
+        shard.order.pop_back();
+    }
+
+    shard.order.push_front(std::move(entry));
+    shard.index.emplace(_key, shard.order.begin());
+    shard.bytes += cost;
+}
+
+std::uint64_t agent::DedupCache::Hits() const
+{
+    return _hits;
+}
+
+std::uint64_t agent::DedupCache::Misses() const
+{
+    return _misses;
+}
+
+double agent::DedupCache::HitRate() const
+{
+    const std::uint64_t hits = _hits;
+    const std::uint64_t lookups = hits + _misses;
+    return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+}
+
+std::size_t agent::DedupCache::Size() const
+{
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < _shardCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(_shards[i].lock);
+        size += _shards[i].order.size();
+    }
+    return size;
+}
+
+std::size_t agent::DedupCache::Bytes() const
+{
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < _shardCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(_shards[i].lock);
+        bytes += _shards[i].bytes;
+    }
+    return bytes;
+}
+
+// The key is held twice, in the entry and in the index
+std::size_t agent::DedupCache::_cost(const Entry& _entry)
+{
+    return sizeof(Entry) + 2 * _entry.key.size() + _entry.result.size();
+}
+
+agent::DedupCache::Shard& agent::DedupCache::_shardFor(const std::string& _key)
+{
+    return _shards[std::hash<std::string>{}(_key) % _shardCount];
+}
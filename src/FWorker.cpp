@@ -1,4 +1,5 @@
 #include "agent/FWorker.hpp"
+#include "agent/Logging.hpp"
 
 #include <string>
 #include <atomic>
@@ -13,7 +14,6 @@
 #include <exception>
 
 #include <spdlog/spdlog.h>
-#include <spdlog/sinks/stdout_color_sinks.h>
 
 agent::FWorker::FWorker(unsigned int __id, std::function<int(const void*, std::uint32_t, void*, std::uint32_t*)> _msgproc)
 {
@@ -21,9 +21,7 @@ agent::FWorker::FWorker(unsigned int __id, std::function<int(const void*, std::u
     _state.store(FWORKER_READY); ///< Sets the default to "ready"
 
     // Check if logger called GetName() exists, else create it
-    _logger = spdlog::get(_name);
-    if (_logger == nullptr)
-        _logger = spdlog::stdout_color_mt(_name);
+    _logger = GetLogger(_name);
 	_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%t] %v");
 
     ProcessMessage = _msgproc;
@@ -36,9 +34,7 @@ agent::FWorker::FWorker(unsigned int __id, std::string __name, std::function<int
     _state.store(FWORKER_READY);
 
     // Use the given name as name for _logger
-    _logger = spdlog::get(__name);
-    if (_logger == nullptr)
-        _logger = spdlog::stdout_color_mt(__name);
+    _logger = GetLogger(__name);
 	_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%t] %v");
 
     ProcessMessage = _msgproc;
@@ -184,7 +180,8 @@ void agent::FWorker::operator()()
                 std::uint32_t rsize;
                 msgId = ProcessMessage(message, size, result, &rsize);
                 success = true;
-                _logger->info("Successfully processed message {}", msgId);
+                if (_logSampler.Sample())
+                    _logger->info("Successfully processed message {}", msgId);
             }
             catch (const std::exception &e)
             {
@@ -0,0 +1,80 @@
+#include "agent/FairQueue.hpp"
+#include "agent/WorkItem.hpp"
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+void agent::FairQueue::SetWeight(std::size_t _class, unsigned int _weight)
+{
+    _at(_class).weight = std::max(_weight, 1u);
+}
+
+unsigned int agent::FairQueue::Weight(std::size_t _class) const
+{
+    return _class < _classes.size() ? _classes[_class].weight : 1;
+}
+
+void agent::FairQueue::Push(WorkItem&& _item)
+{
+    _at(_item.queueClass).items.push_back(std::move(_item));
+    ++_size;
+}
+
+bool agent::FairQueue::Pop(WorkItem& _item)
+{
+    if (_size == 0)
+        return false;
+
+    // Terminates: some class has an item, and we visit each in turn
+    while (true)
+    {
+        Class& current = _classes[_current];
+        if (current.items.empty())
+        {
+            // An idle class does not bank its turn
+            current.deficit = 0;
+            _current = (_current + 1) % _classes.size();
+            continue;
+        }
+
+        if (current.deficit == 0)
+            current.deficit = current.weight;
+
+        _item = std::move(current.items.front());
+        current.items.pop_front();
+        --current.deficit;
+        --_size;
+
+        if (current.deficit == 0 || current.items.empty())
+        {
+            current.deficit = 0;
+            _current = (_current + 1) % _classes.size();
+        }
+        return true;
+    }
+}
+
+bool agent::FairQueue::Empty() const
+{
+    return _size == 0;
+}
+
+std::size_t agent::FairQueue::Size() const
+{
+    return _size;
+}
+
+std::size_t agent::FairQueue::Size(std::size_t _class) const
+{
+    return _class < _classes.size() ? _classes[_class].items.size() : 0;
+}
+
+agent::FairQueue::Class& agent::FairQueue::_at(std::size_t _class)
+{
+    if (_class >= _classes.size())
+        _classes.resize(_class + 1);
+    return _classes[_class];
+}
@@ -0,0 +1,96 @@
+#include "agent/Hash.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+    constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+    constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+    inline std::uint64_t rotl(std::uint64_t _value, int _bits)
+    {
+        return (_value << _bits) | (_value >> (64 - _bits));
+    }
+
+    // Unaligned little-endian loads; memcpy compiles down to a plain move
+    inline std::uint64_t read64(const unsigned char* _p)
+    {
+        std::uint64_t value;
+        std::memcpy(&value, _p, sizeof(value));
+        return value;
+    }
+
+    inline std::uint32_t read32(const unsigned char* _p)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, _p, sizeof(value));
+        return value;
+    }
+
+    inline std::uint64_t round(std::uint64_t _acc, std::uint64_t _input)
+    {
+        _acc += _input * prime2;
+        _acc = rotl(_acc, 31);
+        return _acc * prime1;
+    }
+
+    inline std::uint64_t merge(std::uint64_t _acc, std::uint64_t _lane)
+    {
+        _acc ^= round(0, _lane);
+        return _acc * prime1 + prime4;
+    }
+}
+
+std::uint64_t agent::Hash64(const void* _data, std::size_t _size, std::uint64_t _seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(_data);
+    const unsigned char* const end = p + _size;
+    std::uint64_t hash;
+
+    if (_size >= 32)
+    {
+        std::uint64_t lanes[4] = {_seed + prime1 + prime2, _seed + prime2, _seed, _seed - prime1};
+        const unsigned char* const last = end - 32;
+        do
+        {
+            for (int i = 0; i < 4; ++i)
+                lanes[i] = round(lanes[i], read64(p + 8 * i));
+            p += 32;
+        } while (p <= last);
+
+        hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        for (int i = 0; i < 4; ++i)
+            hash = merge(hash, lanes[i]);
+    }
+    else
+    {
+        hash = _seed + prime5;
+    }
+
+    hash += static_cast<std::uint64_t>(_size);
+
+    // The tail, less than a stripe
+    for (; p + 8 <= end; p += 8)
+        hash = rotl(hash ^ round(0, read64(p)), 27) * prime1 + prime4;
+    if (p + 4 <= end)
+    {
+        hash = rotl(hash ^ (static_cast<std::uint64_t>(read32(p)) * prime1), 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        hash = rotl(hash ^ (*p * prime5), 11) * prime1;
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
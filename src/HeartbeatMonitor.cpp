@@ -0,0 +1,40 @@
+#include "agent/HeartbeatMonitor.hpp"
+
+#include <chrono>
+
+void agent::HeartbeatMonitor::Start(std::chrono::seconds __interval, Clock::time_point _now)
+{
+    _interval = __interval;
+    _lastReceived = _now;
+    _lastSent = _now;
+}
+
+void agent::HeartbeatMonitor::Stop()
+{
+    _interval = std::chrono::seconds(0);
+}
+
+void agent::HeartbeatMonitor::Received(Clock::time_point _now)
+{
+    _lastReceived = _now;
+}
+
+void agent::HeartbeatMonitor::Sent(Clock::time_point _now)
+{
+    _lastSent = _now;
+}
+
+bool agent::HeartbeatMonitor::SendDue(Clock::time_point _now) const
+{
+    return _interval.count() > 0 && _now - _lastSent >= std::chrono::milliseconds(_interval) / 2;
+}
+
+bool agent::HeartbeatMonitor::PeerDead(Clock::time_point _now) const
+{
+    return _interval.count() > 0 && _now - _lastReceived >= _interval * 2;
+}
+
+std::chrono::seconds agent::HeartbeatMonitor::Interval() const
+{
+    return _interval;
+}
@@ -1,304 +1,574 @@
-#include "agent/agent.hpp"
-
-#include "agent/IConnectionHandler.hpp"
-#include "agent/Buffer.hpp"
-#include "agent/IWorker.hpp"
-
-#include <amqpcpp.h>
-#include <spdlog/spdlog.h>
-#include <spdlog/sinks/stdout_color_sinks.h>
-#include <Poco/Net/StreamSocket.h>
-#include <Poco/Net/SocketAddress.h>
-
-#include <cstdint>
-#include <string>
-#include <sstream>
-
-agent::IConnectionHandler::IConnectionHandler(unsigned int _id)
-    : _client("IConnectionHandler"), // Default client name
-      _connected(false),
-      _connection(nullptr),
-      _inpbuffer(AGENT_CONN_BUFFER_SIZE),
-      _tmpbuffer(AGENT_CONN_TEMP_BUFFER_SIZE),
-      _outbuffer(AGENT_CONN_BUFFER_SIZE),
-      _address(Poco::Net::SocketAddress("localhost", 5672)),
-      _logger(nullptr), // Default no logger
-      IWorker(_id)
-{
-  // Check if logger called GetName() exists, else create it
-  _logger = spdlog::get(_client);
-  if (_logger == nullptr)
-    _logger = spdlog::stdout_color_mt(_client);
-
-  // Just announce the creation of the client; can turn this off via log level
-  _logger->info("Client {} created", _client);
-
-  // Set up the AMQP::Connection here and then Run()
-  _socket.connect(_address);
-  _socket.setKeepAlive(true);
-}
-
-agent::IConnectionHandler::IConnectionHandler(
-    unsigned int _id,
-    const std::string& _host,
-    std::uint16_t _port,
-    const std::string& _name,
-    const std::string& __product,
-    const std::string& __version,
-    const std::string& __copyright,
-    const std::string& __information
-  )
-    : _client(_name),
-      _product(__product),
-      _version(__version),
-      _copyright(__copyright),
-      _information(__information),
-      _connected(false),
-      _connection(nullptr),
-      _inpbuffer(AGENT_CONN_BUFFER_SIZE),
-      _tmpbuffer(AGENT_CONN_TEMP_BUFFER_SIZE),
-      _outbuffer(AGENT_CONN_BUFFER_SIZE),
-      _address(Poco::Net::SocketAddress(_host, _port)),
-      IWorker(_id, _name)
-{
-  // Check if logger called GetName() exists, else create it
-  _logger = spdlog::get(_client);
-  if (_logger == nullptr)
-    _logger = spdlog::stdout_color_mt(_client);
-  
-  // Just announce the creation of the client; can turn this off via log level
-  _logger->info("Client {} created", _client);
-
-  // Set up the AMQP::Connection here and then Run()
-  _socket.connect(_address);
-  _socket.setKeepAlive(true);
-}
-
-void agent::IConnectionHandler::onProperties(AMQP::Connection *__connection, const AMQP::Table &_server, AMQP::Table &__client)
-{
-  if (_connection == nullptr)
-    _connection = __connection;
-
-  // Make sure we know who you are
-  __client["connection_name"] = _client;
-  __client["product"] = _product;
-  __client["version"] = _version;
-  __client["copyright"] = _copyright;
-  __client["information"] = _information;
-
-  // Set the platform
-  #if defined(__linux__)
-  __client["platform"] = "Linux";
-  #elif defined(__APPLE__)
-  __client["platform"] = "Mac OS X";
-  #elif defined(__sun)
-  __client["platform"] = "Solaris";
-  #elif defined(__FreeBSD__)
-  __client["platform"] = "FreeBSD";
-  #elif defined(__OpenBSD__)
-  __client["platform"] = "OpenBSD";
-  #elif defined(__NetBSD__)
-  __client["platform"] = "NetBSD";
-  #elif defined(__hpux)
-  __client["platform"] = "HP-UX";
-  #elif defined(__osf__)
-  __client["platform"] = "Tru64 UNIX";
-  #elif defined(__sgi)
-  __client["platform"] = "Irix";
-  #elif defined(_AIX)
-  __client["platform"] = "AIX";
-  #elif defined(_WIN32)
-  __client["platform"] = "Windows";
-  #endif
-
-  // Print details of the client and server
-  auto _clientss = std::ostringstream();
-  auto _serverss = std::ostringstream();
-
-  _clientss << _client;
-  _serverss << _server;
-
-  _logger->info("[onProperties] Client: {}, Server: {}", _clientss.str(), _serverss.str());
-}
-
-uint16_t agent::IConnectionHandler::onNegotiate(AMQP::Connection *__connection, uint16_t _interval)
-{
-  if (_connection == nullptr)
-    _connection = __connection;
-
-  // Print details of the heartbeat negotiation
-  _logger->info("[onNegotiate] Accepting interval of length {}", _interval);
-
-  // Just accept the interval
-  return _interval;
-}
-
-void agent::IConnectionHandler::onData(AMQP::Connection *__connection, const char *_data, size_t _size)
-{
-  if (_connection == nullptr)
-    _connection = __connection;
-
-  // Send any outgoing data that has shown up in the buffer
-  _socket.sendBytes(_data, _size);
-
-  // TODO: Maybe make this debug level?
-  _logger->debug("[onData] Sent {} bytes", _size);
-}
-
-void agent::IConnectionHandler::onHeartbeat(AMQP::Connection *__connection)
-{
-  if (_connection == nullptr)
-    _connection = __connection;
-
-  // Announce that we received a heartbeat from the AMQP server
-  _logger->debug("[onHeartbeat] Received a heartbeat from server");
-
-  // Send a return heartbeat; this isn't ideal because it depends on receiving a
-  // heartbeat first, which might not happen. Set up an independent thread that
-  // takes care of this
-  _connection->heartbeat();
-}
-
-void agent::IConnectionHandler::onError(AMQP::Connection *__connection, const char *_message)
-{
-  if (_connection == nullptr)
-    _connection = __connection;
-
-  // Announce that we received a heartbeat from the AMQP server
-  _logger->error("[onError] Error: {}", _message);
-}
-
-void agent::IConnectionHandler::onReady(AMQP::Connection *__connection)
-{
-  if (_connection == nullptr)
-    _connection = __connection;
-
-  // Notify the log that the connection is read
-  _logger->info("[onReady] Connection is ready");
-}
-
-void agent::IConnectionHandler::onClosed(AMQP::Connection *__connection)
-{
-  if (_connection == nullptr)
-    _connection = __connection;
-
-  // Announce and close the connection
-  _logger->info("[onClosed] Connection closed");
-
-  // Exit the loop
-  quit();
-}
-
-// This function should not exist at all; why can't I get rid of it?
-int agent::IConnectionHandler::ProcessMessage(const void*_msg, std::uint32_t _size, void*_result, std::uint32_t*_rsize)
-{
-  return 0;
-}
-
-// Needed for handling conversion of StreamSocket to SecureStreamSocket
-Poco::Net::StreamSocket& agent::IConnectionHandler::socket()
-{
-  return _socket;
-}
-
-void agent::IConnectionHandler::operator()()
-{
-  // This is the main worker loop for AMQP transactions
-  if (_socket.secure())
-  {
-    // Debugging info; indicate we're in TLS mode
-    _logger->debug("Connection is secure");
-
-    // We need to ignore _socket.available() in secure mode; it always returns 0
-    while (GetState() != WORKER_QUIT)
-    {
-      /**
-       * Important: Because we can't use _socket.available() becuase it doesn't
-       * work for TLS, we need to have another way of sizing the buffer in the
-       * case of a large amount of incoming data.
-       */
-      
-      // Make sure all bytes read were processed
-      const int rbytes = _socket.receiveBytes(_tmpbuffer.data(), _tmpbuffer.size());
-      if (rbytes < 0)
-        _logger->info("Received rbytes = {}", rbytes);
-      const int wbytes = _inpbuffer.Write(_tmpbuffer.data(), rbytes);
-
-      if (wbytes != rbytes)
-        _logger->debug("Could not write full contents to input buffer");
-
-      const size_t iavail = _inpbuffer.Available();
-      if (iavail > 0)
-      {
-        const size_t parsed = _connection->parse(_inpbuffer.Data(), iavail);
-
-        if (parsed == iavail)
-          _inpbuffer.Drain();
-        else if (parsed > 0)
-          _inpbuffer.Shift(parsed);
-      }
-      _sendDataFromBuffer();
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
-  }
-  else
-  {
-    // Debugging info
-    _logger->debug("Connection is not secure");
-
-    // If we're not in TLS mode, we can use _socket.available()
-    while (GetState() != WORKER_QUIT)
-    {
-      // See if there's any data available on the incoming socket
-      const size_t savail = _socket.available();
-      if (savail > 0)
-      {
-        // You might have to resize for larger incoming chunk
-        if (savail > _tmpbuffer.size())
-          _tmpbuffer.resize(savail, 0);
-        
-        // Make sure all bytes read were processed
-        const int rbytes = _socket.receiveBytes(_tmpbuffer.data(), savail);
-        const int wbytes = _inpbuffer.Write(_tmpbuffer.data(), rbytes);
-
-        if (wbytes != rbytes)
-          _logger->debug("Could not write full contents to input buffer");
-      }
-      else if (savail < 0)
-      {
-        _logger->error("Socket error: Available bytes on socket < 0");
-      }
-
-      const size_t iavail = _inpbuffer.Available();
-      if (iavail > 0)
-      {
-        const size_t parsed = _connection->parse(_inpbuffer.Data(), iavail);
-
-        if (parsed == iavail)
-          _inpbuffer.Drain();
-        else if (parsed > 0)
-          _inpbuffer.Shift(parsed);
-      }
-      _sendDataFromBuffer();
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
-  }
-
-  if (GetState() == WORKER_QUIT && _outbuffer.Available())
-    _sendDataFromBuffer();
-}
-
-void agent::IConnectionHandler::quit()
-{
-  SetQuit();
-}
-
-void agent::IConnectionHandler::_sendDataFromBuffer()
-{
-  size_t avail = _outbuffer.Available();
-  if (avail > 0)
-  {
-    int sent = _socket.sendBytes(_outbuffer.Data(), avail);
-    _logger->info("Sent [{:6d} / {:6d}] bytes from buffer", sent, avail);
-  }
-}
\ No newline at end of file
+#include "agent/agent.hpp"
+
+#include "agent/IConnectionHandler.hpp"
+#include "agent/Buffer.hpp"
+#include "agent/BufferPool.hpp"
+#include "agent/IWorker.hpp"
+#include "agent/Metrics.hpp"
+#include "agent/Logging.hpp"
+#include "agent/Tracer.hpp"
+
+#include <amqpcpp.h>
+#include <spdlog/spdlog.h>
+#include <Poco/Net/StreamSocket.h>
+#include <Poco/Net/SecureStreamSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/Socket.h>
+#include <Poco/Net/NetException.h>
+#include <Poco/Timespan.h>
+#include <Poco/Exception.h>
+
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <exception>
+
+namespace
+{
+    // Every AMQP frame is a 7 byte header, ending in the payload size, then
+    // the payload and a frame-end octet; AMQP-CPP only parses whole frames
+    std::uint64_t countFrames(const char *_data, std::size_t _size)
+    {
+        std::uint64_t frames = 0;
+        std::size_t offset = 0;
+        while (offset + 7 <= _size)
+        {
+            const auto *size = reinterpret_cast<const unsigned char *>(_data + offset + 3);
+            offset += 8 + ((std::size_t(size[0]) << 24) | (std::size_t(size[1]) << 16) | (std::size_t(size[2]) << 8) | std::size_t(size[3]));
+            ++frames;
+        }
+        return frames;
+    }
+}
+
+agent::IConnectionHandler::IConnectionHandler(unsigned int _id)
+    : _client("IConnectionHandler"), // Default client name
+      _connected(false),
+      _connection(nullptr),
+      _pool(std::make_shared<BufferPool>(AGENT_CONN_SEGMENT_SIZE, AGENT_POOL_MAX_IDLE_SIZE)),
+      _inpbuffer(AGENT_CONN_BUFFER_SIZE, _pool),
+      _outbuffer(AGENT_CONN_BUFFER_SIZE, _pool),
+      _address(Poco::Net::SocketAddress("localhost", 5672)),
+      _logger(nullptr), // Default no logger
+      IWorker(_id)
+{
+  // Check if logger called GetName() exists, else create it
+  _logger = GetLogger(_client);
+
+  // Just announce the creation of the client; can turn this off via log level
+  _logger->info("Client {} created", _client);
+
+  // Set up the AMQP::Connection here and then Run()
+  _connectSocket();
+}
+
+agent::IConnectionHandler::IConnectionHandler(
+    unsigned int _id,
+    const std::string& _host,
+    std::uint16_t _port,
+    const std::string& _name,
+    const std::string& __product,
+    const std::string& __version,
+    const std::string& __copyright,
+    const std::string& __information,
+    std::size_t __segmentSize,
+    std::size_t __bufferCapacity,
+    std::size_t __poolIdleSize
+  )
+    : _client(_name),
+      _product(__product),
+      _version(__version),
+      _copyright(__copyright),
+      _information(__information),
+      _connected(false),
+      _connection(nullptr),
+      _pool(std::make_shared<BufferPool>(__segmentSize, __poolIdleSize)),
+      _inpbuffer(__bufferCapacity, _pool),
+      _outbuffer(__bufferCapacity, _pool),
+      _address(Poco::Net::SocketAddress(_host, _port)),
+      IWorker(_id, _name)
+{
+  // Check if logger called GetName() exists, else create it
+  _logger = GetLogger(_client);
+  
+  // Just announce the creation of the client; can turn this off via log level
+  _logger->info("Client {} created", _client);
+
+  // Set up the AMQP::Connection here and then Run()
+  _connectSocket();
+}
+
+void agent::IConnectionHandler::onProperties(AMQP::Connection *__connection, const AMQP::Table &_server, AMQP::Table &__client)
+{
+  if (_connection == nullptr)
+    _connection = __connection;
+
+  // Make sure we know who you are
+  __client["connection_name"] = _client;
+  __client["product"] = _product;
+  __client["version"] = _version;
+  __client["copyright"] = _copyright;
+  __client["information"] = _information;
+
+  // Set the platform
+  #if defined(__linux__)
+  __client["platform"] = "Linux";
+  #elif defined(__APPLE__)
+  __client["platform"] = "Mac OS X";
+  #elif defined(__sun)
+  __client["platform"] = "Solaris";
+  #elif defined(__FreeBSD__)
+  __client["platform"] = "FreeBSD";
+  #elif defined(__OpenBSD__)
+  __client["platform"] = "OpenBSD";
+  #elif defined(__NetBSD__)
+  __client["platform"] = "NetBSD";
+  #elif defined(__hpux)
+  __client["platform"] = "HP-UX";
+  #elif defined(__osf__)
+  __client["platform"] = "Tru64 UNIX";
+  #elif defined(__sgi)
+  __client["platform"] = "Irix";
+  #elif defined(_AIX)
+  __client["platform"] = "AIX";
+  #elif defined(_WIN32)
+  __client["platform"] = "Windows";
+  #endif
+
+  // Print details of the client and server
+  auto _clientss = std::ostringstream();
+  auto _serverss = std::ostringstream();
+
+  _clientss << _client;
+  _serverss << _server;
+
+  _logger->info("[onProperties] Client: {}, Server: {}", _clientss.str(), _serverss.str());
+}
+
+uint16_t agent::IConnectionHandler::onNegotiate(AMQP::Connection *__connection, uint16_t _interval)
+{
+  if (_connection == nullptr)
+    _connection = __connection;
+
+  // Print details of the heartbeat negotiation
+  _logger->info("[onNegotiate] Accepting interval of length {}", _interval);
+
+  // From here on the IO loop sends our heartbeats and watches for the broker's
+  _heartbeat.Start(std::chrono::seconds(_interval));
+
+  // Just accept the interval
+  return _interval;
+}
+
+void agent::IConnectionHandler::onData(AMQP::Connection *__connection, const char *_data, size_t _size)
+{
+  if (_connection == nullptr)
+    _connection = __connection;
+
+  // Queue the bytes; the IO loop sends them when the socket is writable
+  std::lock_guard<std::mutex> guard(_outbuffer_lock);
+  if (_reconnectPending)
+    return;
+
+  // The broker has stopped reading; waiting for room here would hold up the
+  // IO loop, and a frame cut short would corrupt the stream, so give up on
+  // the connection and let the loop start a new one
+  if (_outbuffer.Writable() < _size)
+  {
+    _logger->error("[onData] Output buffer full at {} bytes; dropping the connection", _outbuffer.Available());
+    _onSocketClosed();
+    return;
+  }
+
+  _outbuffer.Write(_data, _size);
+  SPDLOG_LOGGER_DEBUG(_logger, "[onData] Queued {} bytes", _size);
+}
+
+void agent::IConnectionHandler::onHeartbeat(AMQP::Connection *__connection)
+{
+  if (_connection == nullptr)
+    _connection = __connection;
+
+  // Announce that we received a heartbeat from the AMQP server; the bytes
+  // arriving have already told the heartbeat monitor the broker is alive
+  _logger->debug("[onHeartbeat] Received a heartbeat from server");
+}
+
+void agent::IConnectionHandler::onError(AMQP::Connection *__connection, const char *_message)
+{
+  if (_connection == nullptr)
+    _connection = __connection;
+
+  // Announce the error; the connection is unusable from here on
+  _logger->error("[onError] Error: {}", _message);
+  _onSocketClosed();
+}
+
+void agent::IConnectionHandler::onReady(AMQP::Connection *__connection)
+{
+  if (_connection == nullptr)
+    _connection = __connection;
+
+  // Notify the log that the connection is read
+  _logger->info("[onReady] Connection is ready");
+
+  // Only a connection that got this far counts as a successful reconnect
+  _backoff.Reset();
+}
+
+void agent::IConnectionHandler::onClosed(AMQP::Connection *__connection)
+{
+  if (_connection == nullptr)
+    _connection = __connection;
+
+  // Announce and close the connection
+  _logger->info("[onClosed] Connection closed");
+
+  // Unless we asked for it, the broker went away; go and find it again
+  _onSocketClosed();
+}
+
+// This function should not exist at all; why can't I get rid of it?
+int agent::IConnectionHandler::ProcessMessage(const void*_msg, std::uint32_t _size, void*_result, std::uint32_t*_rsize)
+{
+  return 0;
+}
+
+// Needed for handling conversion of StreamSocket to SecureStreamSocket
+Poco::Net::StreamSocket& agent::IConnectionHandler::socket()
+{
+  return _socket;
+}
+
+void agent::IConnectionHandler::operator()()
+{
+  // Debugging info; indicate whether we're in TLS mode
+  _logger->debug("Connection is {}", _socket.secure() ? "secure" : "not secure");
+
+  // Everything below is non-blocking; waiting happens only in poll()
+  _socket.setBlocking(false);
+
+  /**
+   * This is the main worker loop for AMQP transactions. Plain and TLS sockets
+   * share it: we wait until the socket is readable, or writable when there is
+   * output pending (or TLS asked for it), then read until the socket would
+   * block, parse, and write until it would block. In TLS mode a read can need
+   * the socket to be writable and vice versa (WANT_WRITE / WANT_READ), which
+   * is why both directions are tracked separately
+   */
+  while (GetState() != WORKER_QUIT)
+  {
+    try
+    {
+      int mode = Poco::Net::Socket::SELECT_ERROR;
+      if (_inpbuffer.Writable() > 0 || _readWantsWrite)
+        mode |= _readWantsWrite ? Poco::Net::Socket::SELECT_WRITE : Poco::Net::Socket::SELECT_READ;
+      if (_pendingOutput() || _writeWantsRead)
+        mode |= _writeWantsRead ? Poco::Net::Socket::SELECT_READ : Poco::Net::Socket::SELECT_WRITE;
+
+      _socket.poll(Poco::Timespan(0, AGENT_CONN_POLL_USEC), mode);
+
+      // TLS can hold decrypted bytes the socket no longer reports, so always try
+      _receiveIntoBuffer();
+      _parseFromBuffer();
+      _runTasks();
+      _checkHeartbeat();
+      _onPoll();
+
+      // Nothing queued for a connection being given up is worth sending
+      std::lock_guard<std::mutex> guard(_outbuffer_lock);
+      if (!_reconnectPending)
+        _sendDataFromBuffer();
+    }
+    catch (const Poco::Exception& e)
+    {
+      _logger->error("Socket error: {}", e.displayText());
+      _onSocketClosed();
+    }
+    catch (const std::exception& e)
+    {
+      // Thrown from inside a parse, e.g. by a frame no buffer can hold;
+      // the connection's state is past saving, so start it over
+      _logger->error("Connection error: {}", e.what());
+      _onSocketClosed();
+    }
+
+    if (_reconnectPending)
+      _reconnect();
+  }
+
+  // Give anything still queued (e.g. a close frame) one last chance to go out
+  std::lock_guard<std::mutex> guard(_outbuffer_lock);
+  if (_outbuffer.Available())
+    _sendDataFromBuffer();
+}
+
+void agent::IConnectionHandler::quit()
+{
+  SetQuit();
+}
+
+std::shared_ptr<agent::BufferPool> agent::IConnectionHandler::pool() const
+{
+  return _pool;
+}
+
+void agent::IConnectionHandler::_receiveIntoBuffer()
+{
+  _readWantsWrite = false;
+
+  Tracer* tracer = _tracer.get();
+  const auto began = tracer ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+  std::size_t received = 0;
+
+  // Read directly into the tail segments of the input buffer until the socket
+  // would block; once the buffer is at its cap we leave the rest in the socket
+  while (true)
+  {
+    std::size_t room = 0;
+    char* tail = _inpbuffer.Reserve(room);
+    if (room == 0)
+    {
+      SPDLOG_LOGGER_DEBUG(_logger, "Input buffer full at {} bytes", _inpbuffer.Available());
+      break;
+    }
+
+    const int rbytes = _socket.receiveBytes(tail, static_cast<int>(room));
+    if (rbytes > 0)
+    {
+      _inpbuffer.Commit(static_cast<std::size_t>(rbytes));
+      received += static_cast<std::size_t>(rbytes);
+      _heartbeat.Received();
+      if (_traffic.bytesIn != nullptr)
+        _traffic.bytesIn->Add(static_cast<std::uint64_t>(rbytes));
+      continue;
+    }
+
+    // Zero bytes on a non-blocking read means the peer went away
+    if (rbytes == 0)
+    {
+      _logger->error("Connection closed by peer");
+      _onSocketClosed();
+    }
+    else if (rbytes == Poco::Net::SecureStreamSocket::ERR_SSL_WANT_WRITE)
+    {
+      _readWantsWrite = true;
+    }
+    break;
+  }
+
+  if (tracer && received > 0)
+    tracer->Span("receive", 0, began, std::chrono::steady_clock::now());
+}
+
+void agent::IConnectionHandler::_parseFromBuffer()
+{
+  if (_connection == nullptr)
+    return;
+
+  Tracer* tracer = _tracer.get();
+  const auto began = tracer ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+  bool parsedAny = false;
+
+  // Hand complete frames to AMQP-CPP; a frame straddling two segments is made
+  // contiguous first, which copies at most that one frame
+  while (_inpbuffer.Available() > 0)
+  {
+    const std::size_t expected = std::max<std::size_t>(_connection->expected(), 1);
+    if (_inpbuffer.Available() < expected)
+      break;
+    if (_inpbuffer.Contiguous() < expected)
+      _inpbuffer.Linearize(expected);
+
+    const size_t parsed = _connection->parse(_inpbuffer.Data(), _inpbuffer.Contiguous());
+    if (parsed == 0)
+      break;
+
+    if (_traffic.frames != nullptr)
+      _traffic.frames->Add(countFrames(_inpbuffer.Data(), parsed));
+    _inpbuffer.Shift(parsed);
+    parsedAny = true;
+  }
+
+  // Spans the consumer callbacks the frames set off, too; under no
+  // message's ID, since one parse can complete many
+  if (tracer && parsedAny)
+    tracer->Span("parse", 0, began, std::chrono::steady_clock::now());
+}
+
+void agent::IConnectionHandler::_sendDataFromBuffer()
+{
+  _writeWantsRead = false;
+
+  size_t avail = _outbuffer.Available();
+  while (avail > 0)
+  {
+    const int sent = _socket.sendBytes(_outbuffer.Data(), static_cast<int>(_outbuffer.Contiguous()));
+    if (sent <= 0)
+    {
+      // The socket would block; TLS may need to read before it can write
+      _writeWantsRead = (sent == Poco::Net::SecureStreamSocket::ERR_SSL_WANT_READ && _socket.secure());
+      break;
+    }
+
+    SPDLOG_LOGGER_DEBUG(_logger, "Sent [{:6d} / {:6d}] bytes from buffer", sent, avail);
+    _heartbeat.Sent();
+    if (_traffic.bytesOut != nullptr)
+      _traffic.bytesOut->Add(static_cast<std::uint64_t>(sent));
+
+    // Drop what went out so it is not sent twice
+    _outbuffer.Shift(static_cast<std::size_t>(sent));
+    avail = _outbuffer.Available();
+  }
+}
+
+bool agent::IConnectionHandler::_pendingOutput()
+{
+  std::lock_guard<std::mutex> guard(_outbuffer_lock);
+  return _outbuffer.Available() > 0;
+}
+
+void agent::IConnectionHandler::_connectSocket()
+{
+  _socket = Poco::Net::StreamSocket();
+  _socket.connect(_address);
+  _socket.setKeepAlive(true);
+  _socket.setNoDelay(true);
+}
+
+void agent::IConnectionHandler::_onSocketClosed()
+{
+  // The loop picks this up once the current callback has returned, since the
+  // AMQP::Connection may still be on the stack here
+  if (GetState() != WORKER_QUIT)
+    _reconnectPending = true;
+}
+
+void agent::IConnectionHandler::_onPoll()
+{
+}
+
+void agent::IConnectionHandler::_onDisconnected()
+{
+}
+
+void agent::IConnectionHandler::_onReconnected()
+{
+}
+
+void agent::IConnectionHandler::_registerMetrics(MetricsRegistry& _registry)
+{
+  const MetricLabels labels{{"connection", GetName()}};
+  _traffic.bytesIn = &_registry.GetCounter("agent_connection_received_bytes_total", "Bytes read from the broker", labels);
+  _traffic.bytesOut = &_registry.GetCounter("agent_connection_sent_bytes_total", "Bytes written to the broker", labels);
+  _traffic.frames = &_registry.GetCounter("agent_connection_frames_parsed_total", "AMQP frames parsed", labels);
+}
+
+void agent::IConnectionHandler::Post(std::function<void()> _task)
+{
+  std::lock_guard<std::mutex> guard(_tasks_lock);
+  _tasks.push_back(std::move(_task));
+}
+
+void agent::IConnectionHandler::SetReconnectBackoff(std::chrono::milliseconds _initial, std::chrono::milliseconds _maximum)
+{
+  _backoff = Backoff(_initial, _maximum);
+}
+
+void agent::IConnectionHandler::_checkHeartbeat()
+{
+  if (_connection == nullptr)
+    return;
+
+  // Silence for two intervals means the broker (or the path to it) is gone;
+  // waiting for TCP to notice can take many minutes
+  if (_heartbeat.PeerDead())
+  {
+    _logger->error("No traffic from broker for {} s; reconnecting", 2 * _heartbeat.Interval().count());
+    _onSocketClosed();
+    return;
+  }
+
+  // Goes through onData, so it is sent below with everything else
+  if (_heartbeat.SendDue())
+  {
+    _logger->debug("Sending heartbeat");
+    _connection->heartbeat();
+    _heartbeat.Sent();
+  }
+}
+
+void agent::IConnectionHandler::_runTasks()
+{
+  std::deque<std::function<void()>> tasks;
+  {
+    std::lock_guard<std::mutex> guard(_tasks_lock);
+    tasks.swap(_tasks);
+  }
+
+  for (auto& task : tasks)
+    task();
+}
+
+void agent::IConnectionHandler::_reconnect()
+{
+  // Let the subclass drop its AMQP::Connection first; whatever it still
+  // sends on the way out has nowhere to go
+  _onDisconnected();
+  _connection = nullptr;
+  _heartbeat.Stop();
+  _reconnectPending = false;
+  _readWantsWrite = false;
+  _writeWantsRead = false;
+
+  _inpbuffer.Drain();
+  {
+    std::lock_guard<std::mutex> guard(_outbuffer_lock);
+    _outbuffer.Drain();
+  }
+
+  try
+  {
+    _socket.close();
+  }
+  catch (const Poco::Exception& e)
+  {
+    _logger->debug("Closing dead socket: {}", e.displayText());
+  }
+
+  while (GetState() != WORKER_QUIT)
+  {
+    const auto delay = _backoff.Next();
+    _logger->warn("Reconnecting in {} ms (attempt {})", delay.count(), _backoff.Attempts());
+
+    // Sleep in short steps so a shutdown is not held up by a long delay
+    const auto until = std::chrono::steady_clock::now() + delay;
+    while (GetState() != WORKER_QUIT && std::chrono::steady_clock::now() < until)
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - std::chrono::steady_clock::now(), std::chrono::microseconds(AGENT_CONN_POLL_USEC)));
+    if (GetState() == WORKER_QUIT)
+      break;
+
+    try
+    {
+      _connectSocket();
+      _socket.setBlocking(false);
+    }
+    catch (const Poco::Exception& e)
+    {
+      _logger->error("Reconnect failed: {}", e.displayText());
+      continue;
+    }
+
+    _logger->info("Socket reconnected to {}", _address.toString());
+    _onReconnected();
+    return;
+  }
+}
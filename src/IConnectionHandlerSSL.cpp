@@ -1,50 +1,76 @@
-#include "agent/IConnectionHandlerSSL.hpp"
-#include "agent/IConnectionHandler.hpp"
-
-#include <amqpcpp.h>
-#include <spdlog/spdlog.h>
-#include <Poco/Net/Net.h>
-#include <Poco/Net/NetSSL.h>
-#include <Poco/Net/Context.h>
-#include <Poco/Net/SecureStreamSocket.h>
-
-#include <cstdint>
-#include <string>
-
-agent::IConnectionHandlerSSL::IConnectionHandlerSSL(
-    unsigned int _id,
-    const std::string& _host,
-    std::uint16_t _port,
-    const std::string& _name,
-    const std::string& __privateKeyFile,
-    const std::string& __certificateFile,
-    const std::string& __caLocation,
-    const std::string& __product,
-    const std::string& __version,
-    const std::string& __copyright,
-    const std::string& __information
-  )
-    : _sslInitializer(),
-      IConnectionHandler(
-        _id,
-        _host,
-        _port,
-        _name,
-        __product,
-        __version,
-        __copyright,
-        __information
-      )
-{
-  // Set up the AMQP::Connection here and then Run()
-  socket() = Poco::Net::SecureStreamSocket::attach(
-    socket(),
-    new Poco::Net::Context(
-        Poco::Net::Context::Usage::CLIENT_USE,
-        __privateKeyFile,
-        __certificateFile,
-        __caLocation,
-        Poco::Net::Context::VerificationMode::VERIFY_NONE
-    )
-  );
-}
+#include "agent/IConnectionHandlerSSL.hpp"
+#include "agent/IConnectionHandler.hpp"
+
+#include <amqpcpp.h>
+#include <spdlog/spdlog.h>
+#include <Poco/Net/Net.h>
+#include <Poco/Net/NetSSL.h>
+#include <Poco/Net/Context.h>
+#include <Poco/Net/SecureStreamSocket.h>
+#include <Poco/Net/Session.h>
+
+#include <cstdint>
+#include <string>
+
+agent::IConnectionHandlerSSL::IConnectionHandlerSSL(
+    unsigned int _id,
+    const std::string& _host,
+    std::uint16_t _port,
+    const std::string& _name,
+    const std::string& __privateKeyFile,
+    const std::string& __certificateFile,
+    const std::string& __caLocation,
+    const std::string& __product,
+    const std::string& __version,
+    const std::string& __copyright,
+    const std::string& __information,
+    std::size_t __segmentSize,
+    std::size_t __bufferCapacity,
+    std::size_t __poolIdleSize
+  )
+    : _sslInitializer(),
+      IConnectionHandler(
+        _id,
+        _host,
+        _port,
+        _name,
+        __product,
+        __version,
+        __copyright,
+        __information,
+        __segmentSize,
+        __bufferCapacity,
+        __poolIdleSize
+      )
+{
+  // Keep client sessions so a reconnect can resume instead of doing a full handshake
+  _context = new Poco::Net::Context(
+      Poco::Net::Context::Usage::CLIENT_USE,
+      __privateKeyFile,
+      __certificateFile,
+      __caLocation,
+      Poco::Net::Context::VerificationMode::VERIFY_NONE
+  );
+  _context->enableSessionCache(true);
+
+  // The base class has already connected the plain socket
+  _secureSocket();
+}
+
+void agent::IConnectionHandlerSSL::_connectSocket()
+{
+  IConnectionHandler::_connectSocket();
+  _secureSocket();
+}
+
+void agent::IConnectionHandlerSSL::_secureSocket()
+{
+  // Offer the last session we had (if any) for resumption
+  Poco::Net::SecureStreamSocket secure = Poco::Net::SecureStreamSocket::attach(socket(), _context, _session);
+  secure.completeHandshake();
+
+  _session = secure.currentSession();
+  _logger->info("TLS handshake complete ({})", secure.sessionWasReused() ? "session resumed" : "full handshake");
+
+  socket() = secure;
+}
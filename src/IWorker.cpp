@@ -1,199 +1,497 @@
-#include "agent/IWorker.hpp"
-
-#include <string>
-#include <atomic>
-#include <thread>
-#include <chrono>
-#include <mutex>
-#include <vector>
-#include <deque>
-#include <cstdint>
-#include <memory>
-#include <utility>
-#include <algorithm>
-#include <exception>
-
-#include <spdlog/spdlog.h>
-#include <spdlog/sinks/stdout_color_sinks.h>
-
-agent::IWorker::IWorker(unsigned int __id)
-{
-    _id = __id;
-    _state.store(WORKER_READY); ///< Sets the default to "ready"
-
-    // Check if logger called GetName() exists, else create it
-    _logger = spdlog::get(_name);
-    if (_logger == nullptr)
-        _logger = spdlog::stdout_color_mt(_name);
-    _logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%t] %v");
-}
-
-agent::IWorker::IWorker(unsigned int __id, std::string __name)
-{
-    _id = __id;
-    _name = __name;
-    _state.store(WORKER_READY);
-
-    // Use the given name as name for _logger
-    _logger = spdlog::get(__name);
-    if (_logger == nullptr)
-        _logger = spdlog::stdout_color_mt(__name);
-    _logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%t] %v");
-}
-
-agent::IWorker::~IWorker()
-{
-    // Quit the loop
-    SetQuit();
-
-    // Wait for threads to join
-    std::for_each(
-        _threads.begin(),
-        _threads.end(),
-        [](std::thread &thr){
-            if (thr.joinable())
-                thr.join();
-        }
-    );
-
-    // Clear threads out because we're done
-    _threads.clear();
-
-    // Just to be pedantic
-    _state.store(WORKER_READY);
-}
-
-void agent::IWorker::Run(std::size_t _nthread)
-{
-    for (int tid = 0; tid < _nthread; ++tid)
-        _threads.emplace_back(std::ref(*this));
-    _state.store(WORKER_RUNNING);
-}
-
-void agent::IWorker::Stop()
-{
-    // Tell threads to quit
-    SetQuit();
-    
-    // Wait for threads to join
-    std::for_each(
-        _threads.begin(),
-        _threads.end(),
-        [](std::thread &thr){
-            if (thr.joinable())
-                thr.join();
-        }
-    );
-
-    // Clear threads out because we're done
-    _threads.clear();
-
-    // Threads stopped; ready for another run
-    _state.store(WORKER_READY);
-}
-
-unsigned int agent::IWorker::GetId() const
-{
-    return _id;
-}
-
-std::string agent::IWorker::GetName() const
-{
-    return _name;
-}
-
-void agent::IWorker::SetName(std::string __name)
-{
-    _name = __name;
-}
-
-agent::WorkerState agent::IWorker::GetState() const
-{
-    return _state.load();
-}
-
-void agent::IWorker::SetQuit()
-{
-    _state.store(WORKER_QUIT);
-}
-
-void agent::IWorker::AddMessage(const void *_msg, std::uint32_t _size)
-{
-    _data_lock.lock();
-    _data.push_front(std::pair<const void*, std::uint32_t>(_msg, _size));
-    _data_lock.unlock();
-}
-
-bool agent::IWorker::PopResult(std::pair<int, bool> &_result)
-{
-    bool popped = false;
-
-    _results_lock.lock();
-    if (!_results.empty())
-    {
-        _result = _results.back();
-        _results.pop_back();
-        popped = true;
-    }
-    _results_lock.unlock();
-
-    return popped;
-}
-
-std::size_t agent::IWorker::ResultsAvailable()
-{
-    _results_lock.lock();
-    std::size_t count = _results.size();
-    _results_lock.unlock();
-
-    return count;
-}
-
-void agent::IWorker::operator()()
-{
-    while (GetState() != WORKER_QUIT)
-    {
-        // Create space for a potential message
-        bool received = false;
-        std::pair<const void *, std::uint32_t> curmsg;
-
-        // Lock _data and grab a message
-        _data_lock.lock();
-        if (!_data.empty())
-        {
-            curmsg = _data.back();
-            _data.pop_back();
-            received = true;
-        }
-        _data_lock.unlock();
-
-        // Now the lock is off; process the message
-        if (received)
-        {
-            // Now process it
-            const auto message = curmsg.first;
-            const auto size = curmsg.second;
-            int msgId = -1;
-            bool success = false;
-            try
-            {
-                msgId = ProcessMessage(message, size);
-                success = true;
-                _logger->info("Successfully processed message {}", msgId);
-            }
-            catch(const std::exception& e)
-            {
-                _logger->critical(e.what());
-            }
-
-            // Record the outcome on the return value stack
-            _results_lock.lock();
-            _results.push_front(std::pair<int, bool>(msgId, success));
-            _results_lock.unlock();
-            _logger->debug(std::string("Message processed result: ") + std::to_string(msgId) + " -> " + std::to_string(success));
-        }
-
-        // TODO: Make this delay configurable via JSON sometime
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
-}
+#include "agent/IWorker.hpp"
+#include "agent/DedupCache.hpp"
+#include "agent/Hash.hpp"
+#include "agent/TileExecutor.hpp"
+#include "agent/Metrics.hpp"
+#include "agent/Logging.hpp"
+#include "agent/Tracer.hpp"
+#include "agent/Kernels.hpp"
+#include "agent/Codec.hpp"
+
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <functional>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    // Room in the result buffer of the message this thread is processing
+    thread_local std::uint32_t resultCapacity = 0;
+
+    // Seeds the memo's second hash of a body, independent of its key
+    constexpr std::uint64_t memoCheckSeed = 0x9e3779b97f4a7c15ULL;
+}
+
+agent::IWorker::IWorker(unsigned int __id)
+{
+    _id = __id;
+    _state.store(WORKER_READY); ///< Sets the default to "ready"
+    _tiles = std::make_shared<TileExecutor>();
+    _logSampler = std::make_unique<LogSampler>();
+
+    // Check if logger called GetName() exists, else create it
+    _logger = GetLogger(_name);
+    _logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%t] %v");
+}
+
+agent::IWorker::IWorker(unsigned int __id, std::string __name)
+{
+    _id = __id;
+    _name = __name;
+    _state.store(WORKER_READY);
+    _tiles = std::make_shared<TileExecutor>();
+    _logSampler = std::make_unique<LogSampler>();
+
+    // Use the given name as name for _logger
+    _logger = GetLogger(__name);
+    _logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%t] %v");
+}
+
+agent::IWorker::~IWorker()
+{
+    // Quit the loop
+    SetQuit();
+
+    // Wait for threads to join
+    std::for_each(
+        _threads.begin(),
+        _threads.end(),
+        [](std::thread &thr){
+            if (thr.joinable())
+                thr.join();
+        }
+    );
+
+    // Clear threads out because we're done
+    _threads.clear();
+
+    // Just to be pedantic
+    _state.store(WORKER_READY);
+}
+
+void agent::IWorker::Run(std::size_t _nthread)
+{
+    for (int tid = 0; tid < _nthread; ++tid)
+        _threads.emplace_back(std::ref(*this));
+    _state.store(WORKER_RUNNING);
+}
+
+void agent::IWorker::Stop()
+{
+    // Tell threads to quit
+    SetQuit();
+    
+    // Wait for threads to join
+    std::for_each(
+        _threads.begin(),
+        _threads.end(),
+        [](std::thread &thr){
+            if (thr.joinable())
+                thr.join();
+        }
+    );
+
+    // Clear threads out because we're done
+    _threads.clear();
+
+    // Threads stopped; ready for another run
+    _state.store(WORKER_READY);
+}
+
+unsigned int agent::IWorker::GetId() const
+{
+    return _id;
+}
+
+std::string agent::IWorker::GetName() const
+{
+    return _name;
+}
+
+void agent::IWorker::SetName(std::string __name)
+{
+    _name = __name;
+}
+
+agent::WorkerState agent::IWorker::GetState() const
+{
+    return _state.load();
+}
+
+void agent::IWorker::SetQuit()
+{
+    _state.store(WORKER_QUIT);
+}
+
+void agent::IWorker::AddMessage(const void *_msg, std::uint32_t _size)
+{
+    AddMessage(WorkItem(_msg, _size));
+}
+
+void agent::IWorker::AddMessage(PooledBuffer&& _msg)
+{
+    AddMessage(WorkItem(std::move(_msg)));
+}
+
+void agent::IWorker::AddMessage(WorkItem&& _item)
+{
+    const auto queued = std::chrono::steady_clock::now();
+    _item.queued = queued;
+
+    _data_lock.lock();
+    Tracer* tracer = _tracer.get();
+    if (tracer && _item.traceId == 0)
+        _item.traceId = tracer->NextId();
+    const std::uint64_t traceId = _item.traceId;
+    _data.Push(std::move(_item));
+    if (_stats)
+        _stats->waiting->Set(static_cast<std::int64_t>(_data.Size()));
+    _data_lock.unlock();
+
+    if (tracer)
+        tracer->Begin("queued", traceId, queued);
+}
+
+void agent::IWorker::SetQueueWeight(std::size_t _class, unsigned int _weight)
+{
+    _data_lock.lock();
+    _data.SetWeight(_class, _weight);
+    _data_lock.unlock();
+}
+
+void agent::IWorker::EnableMemo(std::size_t _maxEntries, std::size_t _maxBytes)
+{
+    std::lock_guard<std::mutex> lock(_data_lock);
+    if (_memo)
+    {
+        _logger->error("Memoization already enabled; ignoring");
+        return;
+    }
+    _memo = std::make_unique<DedupCache>(_maxEntries, _maxBytes);
+}
+
+const agent::DedupCache* agent::IWorker::GetMemoCache() const
+{
+    return _memo.get();
+}
+
+void agent::IWorker::SetTileExecutor(std::shared_ptr<TileExecutor> _executor)
+{
+    std::lock_guard<std::mutex> lock(_data_lock);
+    _tiles = std::move(_executor);
+}
+
+std::shared_ptr<agent::TileExecutor> agent::IWorker::GetTileExecutor()
+{
+    std::lock_guard<std::mutex> lock(_data_lock);
+    return _tiles;
+}
+
+void agent::IWorker::ForEachTile(const kernels::ImageView& _image, const std::function<void(const Tile&)>& _kernel, std::size_t _tileBytes)
+{
+    _runTiles(_image, _tileBytes, nullptr, [&](std::size_t, const Tile& _tile) { _kernel(_tile); });
+}
+
+void agent::IWorker::_runTiles(const kernels::ImageView& _image, std::size_t _tileBytes, const std::function<void(std::size_t)>& _prepare, const std::function<void(std::size_t, const Tile&)>& _kernel)
+{
+    // Out of line, so the header needs no more than the names of the types
+    const std::vector<Tile> tiles = TileExecutor::Split(_image, _tileBytes);
+    if (_prepare)
+        _prepare(tiles.size());
+    GetTileExecutor()->Run(tiles.size(), [&](std::size_t _i) { _kernel(_i, tiles[_i]); });
+}
+
+void agent::IWorker::SetMetrics(std::shared_ptr<MetricsRegistry> _registry)
+{
+    std::lock_guard<std::mutex> lock(_data_lock);
+    if (_metrics)
+    {
+        _logger->error("Metrics already set; ignoring");
+        return;
+    }
+    _metrics = std::move(_registry);
+    _registerMetrics(*_metrics);
+}
+
+std::shared_ptr<agent::MetricsRegistry> agent::IWorker::GetMetrics()
+{
+    std::lock_guard<std::mutex> lock(_data_lock);
+    return _metrics;
+}
+
+void agent::IWorker::_registerMetrics(MetricsRegistry& _registry)
+{
+    const MetricLabels labels{{"worker", _name}};
+
+    auto stats = std::make_unique<WorkerMetrics>();
+    stats->waiting = &_registry.GetGauge("agent_messages_waiting", "Messages queued for processing", labels);
+    stats->inFlight = &_registry.GetGauge("agent_messages_in_flight", "Messages being processed", labels);
+    stats->processed = &_registry.GetCounter("agent_messages_processed_total", "Messages processed successfully", labels);
+    stats->failed = &_registry.GetCounter("agent_messages_failed_total", "Messages whose processing threw", labels);
+    stats->queueWait = &_registry.GetHistogram("agent_queue_wait_seconds", "Time messages spent queued before processing", labels);
+    stats->processing = &_registry.GetHistogram("agent_processing_seconds", "Time taken to process a message, decompression included", labels);
+    _stats = std::move(stats);
+}
+
+void agent::IWorker::SetTracer(std::shared_ptr<Tracer> __tracer)
+{
+    std::lock_guard<std::mutex> lock(_data_lock);
+    if (_tracer)
+    {
+        _logger->error("Tracer already set; ignoring");
+        return;
+    }
+    _tracer = std::move(__tracer);
+}
+
+std::shared_ptr<agent::Tracer> agent::IWorker::GetTracer()
+{
+    std::lock_guard<std::mutex> lock(_data_lock);
+    return _tracer;
+}
+
+void agent::IWorker::SetLogSampling(std::uint32_t _every)
+{
+    _logSampler->SetEvery(_every);
+}
+
+std::uint32_t agent::IWorker::ResultCapacity()
+{
+    return resultCapacity;
+}
+
+std::size_t agent::IWorker::MessagesWaiting()
+{
+    _data_lock.lock();
+    std::size_t count = _data.Size();
+    _data_lock.unlock();
+
+    return count;
+}
+
+std::string agent::IWorker::MessageKey(const void *_msg, std::uint32_t _size) const
+{
+    return "";
+}
+
+bool agent::IWorker::PopResult(std::pair<int, bool> &_result)
+{
+    bool popped = false;
+
+    _results_lock.lock();
+    if (!_results.empty())
+    {
+        _result = _results.back();
+        _results.pop_back();
+        popped = true;
+    }
+    _results_lock.unlock();
+
+    return popped;
+}
+
+std::size_t agent::IWorker::ResultsAvailable()
+{
+    _results_lock.lock();
+    std::size_t count = _results.size();
+    _results_lock.unlock();
+
+    return count;
+}
+
+void agent::IWorker::operator()()
+{
+    while (GetState() != WORKER_QUIT)
+    {
+        // Create space for a potential message
+        bool received = false;
+        WorkItem curmsg;
+
+        // Lock _data and grab whichever message is due next
+        _data_lock.lock();
+        received = _data.Pop(curmsg);
+        DedupCache* memo = _memo.get();
+        WorkerMetrics* stats = _stats.get();
+        Tracer* tracer = _tracer.get();
+        if (received && stats)
+            stats->waiting->Set(static_cast<std::int64_t>(_data.Size()));
+        std::shared_ptr<TileExecutor> tiles = received ? nullptr : _tiles;
+        _data_lock.unlock();
+
+        // Now the lock is off; process the message
+        if (received)
+        {
+            int msgId = -1;
+            bool success = false;
+
+            std::chrono::steady_clock::time_point started;
+            if (stats || tracer)
+                started = std::chrono::steady_clock::now();
+            if (tracer)
+                tracer->End("queued", curmsg.traceId, started);
+            if (stats)
+            {
+                stats->queueWait->Observe(started - curmsg.queued);
+                stats->inFlight->Add(1);
+            }
+
+            try
+            {
+                // Compressed bodies are decompressed here, off the IO thread
+                if (curmsg.codec)
+                    _decode(curmsg);
+
+                // Now process it
+                const auto message = curmsg.data;
+                const auto size = curmsg.size;
+
+                // An identical body has been through already; reuse its result
+                std::string key, entry;
+                if (memo != nullptr)
+                    key = _memoKey(message, size);
+
+                if (memo != nullptr && memo->Find(key, entry) && _recall(entry, curmsg, msgId))
+                {
+                    if (_logSampler->Sample())
+                        _logger->info("Reused the result of an identical message {}", msgId);
+                }
+                else
+                {
+                    // With a result buffer, the handler writes straight into it;
+                    // a handler that says nothing has written nothing
+                    if (curmsg.result)
+                    {
+                        std::uint32_t rsize = 0;
+                        resultCapacity = static_cast<std::uint32_t>(curmsg.result.Capacity());
+                        msgId = ProcessMessage(message, size, curmsg.result.Data(), &rsize);
+                        resultCapacity = 0;
+                        curmsg.result.Resize(std::min<std::size_t>(rsize, curmsg.result.Capacity()));
+                    }
+                    else
+                    {
+                        msgId = ProcessMessage(message, size);
+                    }
+                    if (_logSampler->Sample())
+                        _logger->info("Successfully processed message {}", msgId);
+
+                    if (memo != nullptr)
+                        memo->Insert(key, _memoEntry(msgId, curmsg));
+                }
+                success = true;
+            }
+            catch(const PermanentFailure& e)
+            {
+                _logger->error("Giving up on message: {}", e.what());
+                curmsg.deadLetter = true;
+            }
+            catch(const std::exception& e)
+            {
+                _logger->critical(e.what());
+            }
+            catch(...)
+            {
+                // Still a failure to settle; letting it out would end the thread unsettled
+                _logger->critical("Unknown exception processing a message");
+            }
+            resultCapacity = 0;
+
+            const auto finished = stats || tracer ? std::chrono::steady_clock::now() : started;
+            if (tracer)
+                tracer->Span("process", curmsg.traceId, started, finished);
+            if (stats)
+            {
+                stats->processing->Observe(finished - started);
+                stats->inFlight->Add(-1);
+                (success ? stats->processed : stats->failed)->Add();
+            }
+
+            // Record the outcome on the return value stack
+            _results_lock.lock();
+            _results.push_front(std::pair<int, bool>(msgId, success));
+            _results_lock.unlock();
+            SPDLOG_LOGGER_DEBUG(_logger, "Message processed result: {} -> {}", msgId, success);
+
+            // Let whoever queued the message settle it (ack, retry, ...)
+            if (curmsg.onDone)
+                curmsg.onDone(curmsg, msgId, success);
+        }
+
+        // With nothing of our own to do, help with the tiles of other threads' messages
+        if (tiles)
+        {
+            tiles->Help(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        // TODO: Make this delay configurable via JSON sometime
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+// The hash alone would do; the size makes a collision that much less likely
+std::string agent::IWorker::_memoKey(const void* _msg, std::uint32_t _size)
+{
+    const std::uint64_t hash = Hash64(_msg, _size);
+
+    std::string key(sizeof(hash) + sizeof(_size), '\0');
+    std::memcpy(&key[0], &hash, sizeof(hash));
+    std::memcpy(&key[sizeof(hash)], &_size, sizeof(_size));
+    return key;
+}
+
+bool agent::IWorker::_recall(const std::string& _entry, WorkItem& _item, int& _msgId) const
+{
+    // Same key, but only the same body if an independent hash agrees too
+    const std::uint64_t check = Hash64(_item.data, _item.size, memoCheckSeed);
+    if (_entry.size() < sizeof(check) + sizeof(int) || std::memcmp(_entry.data(), &check, sizeof(check)) != 0)
+        return false;
+
+    // The result has to fit where this message wants it; if not, redo the work
+    const char* stored = _entry.data() + sizeof(check);
+    const std::size_t rsize = _entry.size() - sizeof(check) - sizeof(int);
+    if (rsize > 0 && (!_item.result || _item.result.Capacity() < rsize))
+        return false;
+
+    std::memcpy(&_msgId, stored, sizeof(int));
+    if (_item.result)
+    {
+        std::memcpy(_item.result.Data(), stored + sizeof(int), rsize);
+        _item.result.Resize(rsize);
+    }
+    return true;
+}
+
+// The check hash of the body, the message ID, then the result bytes
+std::string agent::IWorker::_memoEntry(int _msgId, const WorkItem& _item)
+{
+    const std::uint64_t check = Hash64(_item.data, _item.size, memoCheckSeed);
+
+    std::string entry(reinterpret_cast<const char*>(&check), sizeof(check));
+    entry.append(reinterpret_cast<const char*>(&_msgId), sizeof(_msgId));
+    if (_item.result)
+        entry.append(_item.result.Data(), _item.result.Size());
+    return entry;
+}
+
+void agent::IWorker::_decode(WorkItem& _item)
+{
+    _item.codec->Decode(static_cast<const char*>(_item.data), _item.size, _item.decoded.Data(), _item.decoded.Size());
+
+    // The compressed bytes go back to their pool now
+    _item.buffer = std::move(_item.decoded);
+    _item.data = _item.buffer.Data();
+    _item.size = static_cast<std::uint32_t>(_item.buffer.Size());
+    _item.codec.reset();
+}
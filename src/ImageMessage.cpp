@@ -0,0 +1,364 @@
+#include "agent/ImageMessage.hpp"
+#include "agent/Kernels.hpp"
+#include "agent/PixelCodec.hpp"
+#include "agent/BufferPool.hpp"
+#include "Message_generated.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+#include <optional>
+#include <stdexcept>
+
+#include <flatbuffers/flatbuffers.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AGENT_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define AGENT_PREFETCH(address) static_cast<void>(address)
+#endif
+
+namespace
+{
+    constexpr std::size_t prefetchDistance = 4; ///< Messages between fetching a table and reading it
+
+    template <typename T, typename V>
+    agent::Samples<T> samplesOf(const flatbuffers::Vector<V>* _vector)
+    {
+        agent::Samples<T> samples;
+        if (_vector != nullptr)
+        {
+            samples.data = reinterpret_cast<const T*>(_vector->data());
+            samples.size = _vector->size();
+        }
+        return samples;
+    }
+}
+
+agent::ImageMessage::ImageMessage(const Messages::Message* __message)
+    : _message(__message)
+{}
+
+agent::ImageMessage agent::ImageMessage::Of(const void* _msg, std::size_t _size)
+{
+    flatbuffers::Verifier verifier(static_cast<const std::uint8_t*>(_msg), _size);
+    // Older senders do not stamp the file identifier; do not insist on it
+    if (!verifier.VerifyBuffer<Messages::Message>(nullptr))
+        throw std::invalid_argument("Not a valid image message");
+
+    return ImageMessage(Messages::GetMessage(_msg));
+}
+
+const agent::Messages::Message* agent::ImageMessage::Raw() const
+{
+    return _message;
+}
+
+std::uint32_t agent::ImageMessage::Id() const
+{
+    return _message->id();
+}
+
+std::uint32_t agent::ImageMessage::Width() const
+{
+    return _message->width();
+}
+
+std::uint32_t agent::ImageMessage::Height() const
+{
+    return _message->height();
+}
+
+agent::Messages::PixelFormat agent::ImageMessage::Format() const
+{
+    return _message->format();
+}
+
+std::uint32_t agent::ImageMessage::Channels() const
+{
+    if (_message->channels() > 0)
+        return _message->channels();
+    if (FormatChannels(Format()) > 0)
+        return FormatChannels(Format());
+
+    // Older senders only tell us the size of the image
+    const std::size_t area = static_cast<std::size_t>(Width()) * Height();
+    const std::size_t samples = Data<std::uint8_t>().size + Data<std::uint16_t>().size + Data<float>().size;
+    return area > 0 && samples >= area ? static_cast<std::uint32_t>(samples / area) : 1;
+}
+
+std::size_t agent::ImageMessage::SampleBytes() const
+{
+    if (FormatSampleBytes(Format()) > 0)
+        return FormatSampleBytes(Format());
+    if (_message->data_u16() != nullptr)
+        return sizeof(std::uint16_t);
+    if (_message->data_f32() != nullptr)
+        return sizeof(float);
+    return sizeof(std::uint8_t);
+}
+
+std::size_t agent::ImageMessage::Stride() const
+{
+    if (_message->stride() > 0)
+        return _message->stride();
+    return static_cast<std::size_t>(Width()) * Channels() * SampleBytes();
+}
+
+template <>
+agent::Samples<std::uint8_t> agent::ImageMessage::Data<std::uint8_t>() const
+{
+    if (_message->data_u8() != nullptr)
+        return samplesOf<std::uint8_t>(_message->data_u8());
+    return samplesOf<std::uint8_t>(_message->pixels());
+}
+
+template <>
+agent::Samples<std::uint16_t> agent::ImageMessage::Data<std::uint16_t>() const
+{
+    return samplesOf<std::uint16_t>(_message->data_u16());
+}
+
+template <>
+agent::Samples<float> agent::ImageMessage::Data<float>() const
+{
+    return samplesOf<float>(_message->data_f32());
+}
+
+agent::kernels::ImageView agent::ImageMessage::View() const
+{
+    kernels::ImageView view;
+    if (Encoding() != Messages::PixelEncoding_Raw)
+        throw std::invalid_argument("Samples are coded; decode them first");
+
+    const Samples<std::uint8_t> samples = Data<std::uint8_t>();
+    if (samples.empty())
+        return view;
+
+    view.width = Width();
+    view.height = Height();
+    view.channels = Channels();
+    if (SampleBytes() != 1)
+        throw std::invalid_argument("Kernels take 8-bit samples only");
+    if (Stride() != static_cast<std::size_t>(view.width) * view.channels)
+        throw std::invalid_argument("Kernels take packed rows only");
+    if (samples.size < view.Size())
+        throw std::invalid_argument("Fewer samples than width by height pixels");
+
+    view.pixels = samples.data;
+    return view;
+}
+
+agent::Messages::PixelEncoding agent::ImageMessage::Encoding() const
+{
+    return _message->encoding();
+}
+
+agent::kernels::CodedImage agent::ImageMessage::Coded() const
+{
+    kernels::CodedImage coded;
+    if (Encoding() == Messages::PixelEncoding_Raw || _message->encoded() == nullptr)
+        return coded;
+    if (_message->encoded_rows() == nullptr || _message->encoded_rows()->size() < Height())
+        throw std::invalid_argument("Coded samples without an offset for every row");
+
+    coded.bytes = _message->encoded()->data();
+    coded.size = _message->encoded()->size();
+    coded.rows = _message->encoded_rows()->data();
+    coded.width = Width();
+    coded.height = Height();
+    coded.channels = Channels();
+    return coded;
+}
+
+agent::kernels::ImageView agent::ImageMessage::Decode(std::uint32_t _y, std::uint32_t _count, std::uint8_t* _out) const
+{
+    if (Encoding() != Messages::PixelEncoding_DeltaRle)
+        throw std::invalid_argument("Samples are not coded in a known way");
+
+    const kernels::CodedImage coded = Coded();
+    kernels::DecodeDeltaRle(coded, _y, _count, _out);
+
+    kernels::ImageView view;
+    view.pixels = _out;
+    view.width = coded.width;
+    view.height = _count;
+    view.channels = coded.channels;
+    return view;
+}
+
+agent::kernels::ImageView agent::ImageMessage::Decode(BufferPool& _pool, PooledBuffer& _into) const
+{
+    _into = _pool.Acquire(static_cast<std::size_t>(Width()) * Height() * Channels());
+    return Decode(0, Height(), reinterpret_cast<std::uint8_t*>(_into.Data()));
+}
+
+bool agent::ImageMessage::Aligned() const
+{
+    const void* data = nullptr;
+    if (_message->data_u8() != nullptr)
+        data = _message->data_u8()->data();
+    else if (_message->data_u16() != nullptr)
+        data = _message->data_u16()->data();
+    else if (_message->data_f32() != nullptr)
+        data = _message->data_f32()->data();
+
+    return data != nullptr && reinterpret_cast<std::uintptr_t>(data) % Alignment == 0;
+}
+
+std::optional<agent::Messages::Region> agent::ImageMessage::Roi() const
+{
+    if (_message->roi() == nullptr)
+        return std::nullopt;
+    return *_message->roi();
+}
+
+std::size_t agent::ImageMessage::TileCount() const
+{
+    return _message->tiles() == nullptr ? 0 : _message->tiles()->size();
+}
+
+const agent::Messages::ImageTile* agent::ImageMessage::TileAt(std::size_t _i) const
+{
+    return _i < TileCount() ? _message->tiles()->Get(static_cast<flatbuffers::uoffset_t>(_i)) : nullptr;
+}
+
+std::optional<std::chrono::system_clock::time_point> agent::ImageMessage::Captured() const
+{
+    if (_message->timestamp() == 0)
+        return std::nullopt;
+
+    const std::chrono::nanoseconds since(_message->timestamp());
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(since));
+}
+
+std::size_t agent::ImageColumns::Extract(const void* const* _messages, const std::uint32_t* _sizes, std::size_t _count, bool _verify)
+{
+    const std::size_t before = Size();
+    const std::size_t after = before + _count;
+    index.reserve(after);
+    ids.reserve(after);
+    widths.reserve(after);
+    heights.reserve(after);
+    channels.reserve(after);
+    pixels.reserve(after);
+
+    // The root offset at the start of a message is wanted first, then the
+    // table it points to, whose vtable the builder writes just before it;
+    // each is fetched some messages ahead of being read
+    for (std::size_t i = 0; i < std::min(2 * prefetchDistance, _count); ++i)
+        AGENT_PREFETCH(_messages[i]);
+
+    for (std::size_t i = 0; i < _count; ++i)
+    {
+        if (i + 2 * prefetchDistance < _count)
+            AGENT_PREFETCH(_messages[i + 2 * prefetchDistance]);
+
+        // The offset is not verified yet; one pointing outside its message is left alone
+        const std::size_t next = i + prefetchDistance;
+        if (next < _count && _sizes[next] >= sizeof(flatbuffers::uoffset_t))
+        {
+            const auto ahead = static_cast<const std::uint8_t*>(_messages[next]);
+            const flatbuffers::uoffset_t offset = flatbuffers::ReadScalar<flatbuffers::uoffset_t>(ahead);
+            if (offset < _sizes[next])
+            {
+                AGENT_PREFETCH(ahead + offset);
+                AGENT_PREFETCH(ahead + (offset > 64 ? offset - 64 : 0));
+            }
+        }
+
+        if (_verify)
+        {
+            flatbuffers::Verifier verifier(static_cast<const std::uint8_t*>(_messages[i]), _sizes[i]);
+            if (!verifier.VerifyBuffer<Messages::Message>(nullptr))
+            {
+                ++rejected;
+                continue;
+            }
+        }
+
+        const ImageMessage message(Messages::GetMessage(_messages[i]));
+        index.push_back(static_cast<std::uint32_t>(i));
+        ids.push_back(message.Id());
+        widths.push_back(message.Width());
+        heights.push_back(message.Height());
+        channels.push_back(message.Channels());
+        pixels.push_back(message.Data<std::uint8_t>());
+    }
+    return Size() - before;
+}
+
+void agent::ImageColumns::Clear()
+{
+    index.clear();
+    ids.clear();
+    widths.clear();
+    heights.clear();
+    channels.clear();
+    pixels.clear();
+    rejected = 0;
+}
+
+std::uint32_t agent::FormatChannels(Messages::PixelFormat _format)
+{
+    switch (_format)
+    {
+    case Messages::PixelFormat_Gray8:
+    case Messages::PixelFormat_Gray16:
+    case Messages::PixelFormat_Gray32F:
+        return 1;
+    case Messages::PixelFormat_RGB8:
+    case Messages::PixelFormat_BGR8:
+    case Messages::PixelFormat_RGB16:
+    case Messages::PixelFormat_RGB32F:
+        return 3;
+    case Messages::PixelFormat_RGBA8:
+    case Messages::PixelFormat_BGRA8:
+    case Messages::PixelFormat_RGBA16:
+    case Messages::PixelFormat_RGBA32F:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+std::size_t agent::FormatSampleBytes(Messages::PixelFormat _format)
+{
+    switch (_format)
+    {
+    case Messages::PixelFormat_Gray8:
+    case Messages::PixelFormat_RGB8:
+    case Messages::PixelFormat_RGBA8:
+    case Messages::PixelFormat_BGR8:
+    case Messages::PixelFormat_BGRA8:
+        return 1;
+    case Messages::PixelFormat_Gray16:
+    case Messages::PixelFormat_RGB16:
+    case Messages::PixelFormat_RGBA16:
+        return 2;
+    case Messages::PixelFormat_Gray32F:
+    case Messages::PixelFormat_RGB32F:
+    case Messages::PixelFormat_RGBA32F:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+agent::CodedSamples agent::CreateCodedSamples(flatbuffers::FlatBufferBuilder& _builder, const kernels::ImageView& _image)
+{
+    // Reused between calls, so a publishing thread only allocates them once
+    thread_local std::vector<std::uint8_t> bytes;
+    thread_local std::vector<std::uint32_t> rows;
+    bytes.resize(kernels::MaxDeltaRleSize(_image));
+    rows.resize(_image.height);
+
+    const std::size_t size = kernels::EncodeDeltaRle(_image, bytes.data(), rows.data());
+
+    CodedSamples coded;
+    coded.bytes = _builder.CreateVector(bytes.data(), size);
+    coded.rows = _builder.CreateVector(rows.data(), rows.size());
+    return coded;
+}
@@ -0,0 +1,670 @@
+#include "agent/Kernels.hpp"
+
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define AGENT_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using agent::kernels::Isa;
+
+    /**
+     * The loops each instruction set has its own version of; everything
+     * else is built from these. Each one finishes its tail in plain C++.
+     */
+    struct Primitives
+    {
+        std::uint64_t (*sum)(const std::uint8_t*, std::size_t);
+        void (*minMax)(const std::uint8_t*, std::size_t, std::uint8_t&, std::uint8_t&);
+        void (*threshold)(const std::uint8_t*, std::size_t, std::uint8_t, std::uint8_t*);
+        void (*clamp)(const std::uint8_t*, std::size_t, std::uint8_t, std::uint8_t, std::uint8_t*);
+        void (*average)(const std::uint8_t*, const std::uint8_t*, std::size_t, std::uint8_t*);
+        void (*accumulate)(const std::uint8_t*, std::size_t, std::uint16_t, std::uint16_t*);
+        void (*narrow)(const std::uint16_t*, std::size_t, std::uint16_t, std::uint16_t, std::uint8_t*);
+    };
+
+    // Plain C++, also used for the tails of the vector versions
+
+    std::uint64_t sumScalar(const std::uint8_t* _in, std::size_t _n)
+    {
+        std::uint64_t sum = 0;
+        for (std::size_t i = 0; i < _n; ++i)
+            sum += _in[i];
+        return sum;
+    }
+
+    void minMaxScalar(const std::uint8_t* _in, std::size_t _n, std::uint8_t& _min, std::uint8_t& _max)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+        {
+            _min = std::min(_min, _in[i]);
+            _max = std::max(_max, _in[i]);
+        }
+    }
+
+    void thresholdScalar(const std::uint8_t* _in, std::size_t _n, std::uint8_t _level, std::uint8_t* _out)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+            _out[i] = _in[i] > _level ? 255 : 0;
+    }
+
+    void clampScalar(const std::uint8_t* _in, std::size_t _n, std::uint8_t _min, std::uint8_t _max, std::uint8_t* _out)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+            _out[i] = std::min(std::max(_in[i], _min), _max);
+    }
+
+    // Rounds halves up, as the vector average instructions do
+    void averageScalar(const std::uint8_t* _a, const std::uint8_t* _b, std::size_t _n, std::uint8_t* _out)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+            _out[i] = static_cast<std::uint8_t>((_a[i] + _b[i] + 1) >> 1);
+    }
+
+    void accumulateScalar(const std::uint8_t* _in, std::size_t _n, std::uint16_t _weight, std::uint16_t* _acc)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+            _acc[i] = static_cast<std::uint16_t>(_acc[i] + _in[i] * _weight);
+    }
+
+    // Divides by multiplying with a 16-bit reciprocal, saturating at 255
+    void narrowScalar(const std::uint16_t* _acc, std::size_t _n, std::uint16_t _bias, std::uint16_t _scale, std::uint8_t* _out)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+        {
+            const std::uint32_t value = (static_cast<std::uint32_t>(static_cast<std::uint16_t>(_acc[i] + _bias)) * _scale) >> 16;
+            _out[i] = static_cast<std::uint8_t>(std::min<std::uint32_t>(value, 255));
+        }
+    }
+
+    // Folds the lanes of the vector versions' running minimum and maximum
+    void foldMinMax(const std::uint8_t* _lows, const std::uint8_t* _highs, std::size_t _n, std::uint8_t& _min, std::uint8_t& _max)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+        {
+            _min = std::min(_min, _lows[i]);
+            _max = std::max(_max, _highs[i]);
+        }
+    }
+
+    const Primitives scalar = {sumScalar, minMaxScalar, thresholdScalar, clampScalar, averageScalar, accumulateScalar, narrowScalar};
+
+#ifdef AGENT_KERNELS_X86
+    __attribute__((target("sse2"))) std::uint64_t sumSse2(const std::uint8_t* _in, std::size_t _n)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sums = zero;
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + i)), zero));
+
+        std::uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+        return lanes[0] + lanes[1] + sumScalar(_in + i, _n - i);
+    }
+
+    __attribute__((target("sse2"))) void minMaxSse2(const std::uint8_t* _in, std::size_t _n, std::uint8_t& _min, std::uint8_t& _max)
+    {
+        __m128i lo = _mm_set1_epi8(static_cast<char>(_min));
+        __m128i hi = _mm_set1_epi8(static_cast<char>(_max));
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + i));
+            lo = _mm_min_epu8(lo, v);
+            hi = _mm_max_epu8(hi, v);
+        }
+
+        std::uint8_t los[16], his[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(los), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(his), hi);
+        foldMinMax(los, his, 16, _min, _max);
+        minMaxScalar(_in + i, _n - i, _min, _max);
+    }
+
+    // Unsigned x > level is max(x, level + 1) == x; the caller handles level 255
+    __attribute__((target("sse2"))) void thresholdSse2(const std::uint8_t* _in, std::size_t _n, std::uint8_t _level, std::uint8_t* _out)
+    {
+        const __m128i above = _mm_set1_epi8(static_cast<char>(_level + 1));
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + i), _mm_cmpeq_epi8(_mm_max_epu8(v, above), v));
+        }
+        thresholdScalar(_in + i, _n - i, _level, _out + i);
+    }
+
+    __attribute__((target("sse2"))) void clampSse2(const std::uint8_t* _in, std::size_t _n, std::uint8_t _min, std::uint8_t _max, std::uint8_t* _out)
+    {
+        const __m128i lo = _mm_set1_epi8(static_cast<char>(_min));
+        const __m128i hi = _mm_set1_epi8(static_cast<char>(_max));
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + i), _mm_min_epu8(_mm_max_epu8(v, lo), hi));
+        }
+        clampScalar(_in + i, _n - i, _min, _max, _out + i);
+    }
+
+    __attribute__((target("sse2"))) void averageSse2(const std::uint8_t* _a, const std::uint8_t* _b, std::size_t _n, std::uint8_t* _out)
+    {
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_a + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + i), _mm_avg_epu8(a, b));
+        }
+        averageScalar(_a + i, _b + i, _n - i, _out + i);
+    }
+
+    __attribute__((target("sse2"))) void accumulateSse2(const std::uint8_t* _in, std::size_t _n, std::uint16_t _weight, std::uint16_t* _acc)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weight = _mm_set1_epi16(static_cast<short>(_weight));
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + i));
+            __m128i* acc = reinterpret_cast<__m128i*>(_acc + i);
+            const __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), weight);
+            const __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), weight);
+            _mm_storeu_si128(acc, _mm_add_epi16(_mm_loadu_si128(acc), lo));
+            _mm_storeu_si128(acc + 1, _mm_add_epi16(_mm_loadu_si128(acc + 1), hi));
+        }
+        accumulateScalar(_in + i, _n - i, _weight, _acc + i);
+    }
+
+    __attribute__((target("sse2"))) void narrowSse2(const std::uint16_t* _acc, std::size_t _n, std::uint16_t _bias, std::uint16_t _scale, std::uint8_t* _out)
+    {
+        const __m128i bias = _mm_set1_epi16(static_cast<short>(_bias));
+        const __m128i scale = _mm_set1_epi16(static_cast<short>(_scale));
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m128i* acc = reinterpret_cast<const __m128i*>(_acc + i);
+            const __m128i lo = _mm_mulhi_epu16(_mm_add_epi16(_mm_loadu_si128(acc), bias), scale);
+            const __m128i hi = _mm_mulhi_epu16(_mm_add_epi16(_mm_loadu_si128(acc + 1), bias), scale);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + i), _mm_packus_epi16(lo, hi));
+        }
+        narrowScalar(_acc + i, _n - i, _bias, _scale, _out + i);
+    }
+
+    const Primitives sse2 = {sumSse2, minMaxSse2, thresholdSse2, clampSse2, averageSse2, accumulateSse2, narrowSse2};
+
+    __attribute__((target("avx2"))) std::uint64_t sumAvx2(const std::uint8_t* _in, std::size_t _n)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i sums = zero;
+        std::size_t i = 0;
+        for (; i + 32 <= _n; i += 32)
+            sums = _mm256_add_epi64(sums, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + i)), zero));
+
+        std::uint64_t lanes[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sums);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumScalar(_in + i, _n - i);
+    }
+
+    __attribute__((target("avx2"))) void minMaxAvx2(const std::uint8_t* _in, std::size_t _n, std::uint8_t& _min, std::uint8_t& _max)
+    {
+        __m256i lo = _mm256_set1_epi8(static_cast<char>(_min));
+        __m256i hi = _mm256_set1_epi8(static_cast<char>(_max));
+        std::size_t i = 0;
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + i));
+            lo = _mm256_min_epu8(lo, v);
+            hi = _mm256_max_epu8(hi, v);
+        }
+
+        std::uint8_t los[32], his[32];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(los), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(his), hi);
+        foldMinMax(los, his, 32, _min, _max);
+        minMaxScalar(_in + i, _n - i, _min, _max);
+    }
+
+    __attribute__((target("avx2"))) void thresholdAvx2(const std::uint8_t* _in, std::size_t _n, std::uint8_t _level, std::uint8_t* _out)
+    {
+        const __m256i above = _mm256_set1_epi8(static_cast<char>(_level + 1));
+        std::size_t i = 0;
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i), _mm256_cmpeq_epi8(_mm256_max_epu8(v, above), v));
+        }
+        thresholdScalar(_in + i, _n - i, _level, _out + i);
+    }
+
+    __attribute__((target("avx2"))) void clampAvx2(const std::uint8_t* _in, std::size_t _n, std::uint8_t _min, std::uint8_t _max, std::uint8_t* _out)
+    {
+        const __m256i lo = _mm256_set1_epi8(static_cast<char>(_min));
+        const __m256i hi = _mm256_set1_epi8(static_cast<char>(_max));
+        std::size_t i = 0;
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i), _mm256_min_epu8(_mm256_max_epu8(v, lo), hi));
+        }
+        clampScalar(_in + i, _n - i, _min, _max, _out + i);
+    }
+
+    __attribute__((target("avx2"))) void averageAvx2(const std::uint8_t* _a, const std::uint8_t* _b, std::size_t _n, std::uint8_t* _out)
+    {
+        std::size_t i = 0;
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_a + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i), _mm256_avg_epu8(a, b));
+        }
+        averageScalar(_a + i, _b + i, _n - i, _out + i);
+    }
+
+    // Widening 16 bytes at a time keeps the halves out of the lane shuffles
+    __attribute__((target("avx2"))) void accumulateAvx2(const std::uint8_t* _in, std::size_t _n, std::uint16_t _weight, std::uint16_t* _acc)
+    {
+        const __m256i weight = _mm256_set1_epi16(static_cast<short>(_weight));
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_in + i)));
+            __m256i* acc = reinterpret_cast<__m256i*>(_acc + i);
+            _mm256_storeu_si256(acc, _mm256_add_epi16(_mm256_loadu_si256(acc), _mm256_mullo_epi16(v, weight)));
+        }
+        accumulateScalar(_in + i, _n - i, _weight, _acc + i);
+    }
+
+    __attribute__((target("avx2"))) void narrowAvx2(const std::uint16_t* _acc, std::size_t _n, std::uint16_t _bias, std::uint16_t _scale, std::uint8_t* _out)
+    {
+        const __m256i bias = _mm256_set1_epi16(static_cast<short>(_bias));
+        const __m256i scale = _mm256_set1_epi16(static_cast<short>(_scale));
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            const __m256i v = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(_acc + i)), bias), scale);
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0xD8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_out + i), _mm256_castsi256_si128(packed));
+        }
+        narrowScalar(_acc + i, _n - i, _bias, _scale, _out + i);
+    }
+
+    const Primitives avx2 = {sumAvx2, minMaxAvx2, thresholdAvx2, clampAvx2, averageAvx2, accumulateAvx2, narrowAvx2};
+
+    __attribute__((target("avx512f,avx512bw"))) std::uint64_t sumAvx512(const std::uint8_t* _in, std::size_t _n)
+    {
+        const __m512i zero = _mm512_setzero_si512();
+        __m512i sums = zero;
+        std::size_t i = 0;
+        for (; i + 64 <= _n; i += 64)
+            sums = _mm512_add_epi64(sums, _mm512_sad_epu8(_mm512_loadu_si512(_in + i), zero));
+
+        return static_cast<std::uint64_t>(_mm512_reduce_add_epi64(sums)) + sumScalar(_in + i, _n - i);
+    }
+
+    __attribute__((target("avx512f,avx512bw"))) void minMaxAvx512(const std::uint8_t* _in, std::size_t _n, std::uint8_t& _min, std::uint8_t& _max)
+    {
+        __m512i lo = _mm512_set1_epi8(static_cast<char>(_min));
+        __m512i hi = _mm512_set1_epi8(static_cast<char>(_max));
+        std::size_t i = 0;
+        for (; i + 64 <= _n; i += 64)
+        {
+            const __m512i v = _mm512_loadu_si512(_in + i);
+            lo = _mm512_min_epu8(lo, v);
+            hi = _mm512_max_epu8(hi, v);
+        }
+
+        std::uint8_t los[64], his[64];
+        _mm512_storeu_si512(los, lo);
+        _mm512_storeu_si512(his, hi);
+        foldMinMax(los, his, 64, _min, _max);
+        minMaxScalar(_in + i, _n - i, _min, _max);
+    }
+
+    __attribute__((target("avx512f,avx512bw"))) void thresholdAvx512(const std::uint8_t* _in, std::size_t _n, std::uint8_t _level, std::uint8_t* _out)
+    {
+        const __m512i level = _mm512_set1_epi8(static_cast<char>(_level));
+        std::size_t i = 0;
+        for (; i + 64 <= _n; i += 64)
+            _mm512_storeu_si512(_out + i, _mm512_movm_epi8(_mm512_cmpgt_epu8_mask(_mm512_loadu_si512(_in + i), level)));
+        thresholdScalar(_in + i, _n - i, _level, _out + i);
+    }
+
+    __attribute__((target("avx512f,avx512bw"))) void clampAvx512(const std::uint8_t* _in, std::size_t _n, std::uint8_t _min, std::uint8_t _max, std::uint8_t* _out)
+    {
+        const __m512i lo = _mm512_set1_epi8(static_cast<char>(_min));
+        const __m512i hi = _mm512_set1_epi8(static_cast<char>(_max));
+        std::size_t i = 0;
+        for (; i + 64 <= _n; i += 64)
+            _mm512_storeu_si512(_out + i, _mm512_min_epu8(_mm512_max_epu8(_mm512_loadu_si512(_in + i), lo), hi));
+        clampScalar(_in + i, _n - i, _min, _max, _out + i);
+    }
+
+    __attribute__((target("avx512f,avx512bw"))) void averageAvx512(const std::uint8_t* _a, const std::uint8_t* _b, std::size_t _n, std::uint8_t* _out)
+    {
+        std::size_t i = 0;
+        for (; i + 64 <= _n; i += 64)
+            _mm512_storeu_si512(_out + i, _mm512_avg_epu8(_mm512_loadu_si512(_a + i), _mm512_loadu_si512(_b + i)));
+        averageScalar(_a + i, _b + i, _n - i, _out + i);
+    }
+
+    __attribute__((target("avx512f,avx512bw"))) void accumulateAvx512(const std::uint8_t* _in, std::size_t _n, std::uint16_t _weight, std::uint16_t* _acc)
+    {
+        const __m512i weight = _mm512_set1_epi16(static_cast<short>(_weight));
+        std::size_t i = 0;
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m512i v = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + i)));
+            _mm512_storeu_si512(_acc + i, _mm512_add_epi16(_mm512_loadu_si512(_acc + i), _mm512_mullo_epi16(v, weight)));
+        }
+        accumulateScalar(_in + i, _n - i, _weight, _acc + i);
+    }
+
+    __attribute__((target("avx512f,avx512bw"))) void narrowAvx512(const std::uint16_t* _acc, std::size_t _n, std::uint16_t _bias, std::uint16_t _scale, std::uint8_t* _out)
+    {
+        const __m512i bias = _mm512_set1_epi16(static_cast<short>(_bias));
+        const __m512i scale = _mm512_set1_epi16(static_cast<short>(_scale));
+        std::size_t i = 0;
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m512i v = _mm512_mulhi_epu16(_mm512_add_epi16(_mm512_loadu_si512(_acc + i), bias), scale);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i), _mm512_cvtusepi16_epi8(v));
+        }
+        narrowScalar(_acc + i, _n - i, _bias, _scale, _out + i);
+    }
+
+    const Primitives avx512 = {sumAvx512, minMaxAvx512, thresholdAvx512, clampAvx512, averageAvx512, accumulateAvx512, narrowAvx512};
+#endif
+
+    const Primitives& primitivesFor(Isa _isa)
+    {
+#ifdef AGENT_KERNELS_X86
+        switch (_isa)
+        {
+        case Isa::AVX512:
+            return avx512;
+        case Isa::AVX2:
+            return avx2;
+        case Isa::SSE2:
+            return sse2;
+        case Isa::SCALAR:
+            break;
+        }
+#endif
+        return scalar;
+    }
+
+    Isa detect()
+    {
+#ifdef AGENT_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+            return Isa::AVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return Isa::SSE2;
+#endif
+        return Isa::SCALAR;
+    }
+
+    // Chosen once; UseIsa may lower it later
+    std::atomic<Isa>& current()
+    {
+        static std::atomic<Isa> isa(agent::kernels::BestIsa());
+        return isa;
+    }
+
+    const Primitives& use()
+    {
+        return primitivesFor(current().load(std::memory_order_relaxed));
+    }
+
+    void requireColour(std::uint32_t _channels)
+    {
+        if (_channels != 1 && _channels != 3 && _channels != 4)
+            throw std::invalid_argument("Images must be gray, RGB or RGBA");
+    }
+
+    /**
+     * Convolves with the same weights down and across, edges extended.
+     * Down is a weighted sum of whole rows; across is the same sum over a
+     * row shifted by whole pixels, with only the pixels that would fall off
+     * the edge done one at a time.
+     */
+    void separable(const agent::kernels::ImageView& _image, const std::vector<std::uint16_t>& _weights, std::uint32_t _divisor, std::uint8_t* _out)
+    {
+        const Primitives& p = use();
+        const std::size_t row = static_cast<std::size_t>(_image.width) * _image.channels;
+        const std::int64_t radius = static_cast<std::int64_t>(_weights.size() / 2);
+        const std::int64_t lastX = static_cast<std::int64_t>(_image.width) - 1;
+        const std::int64_t lastY = static_cast<std::int64_t>(_image.height) - 1;
+        const auto bias = static_cast<std::uint16_t>(_divisor / 2);
+        const auto scale = static_cast<std::uint16_t>((65536 + _divisor - 1) / _divisor);
+
+        // Reused between calls, so a worker thread only allocates them once
+        thread_local std::vector<std::uint16_t> acc;
+        thread_local std::vector<std::uint8_t> down;
+        acc.resize(row);
+        down.resize(row);
+
+        for (std::int64_t y = 0; y <= lastY; ++y)
+        {
+            std::fill(acc.begin(), acc.end(), 0);
+            for (std::int64_t k = -radius; k <= radius; ++k)
+            {
+                const std::int64_t source = std::min(std::max(y + k, std::int64_t(0)), lastY);
+                p.accumulate(_image.pixels + source * row, row, _weights[k + radius], acc.data());
+            }
+            p.narrow(acc.data(), row, bias, scale, down.data());
+
+            std::fill(acc.begin(), acc.end(), 0);
+            for (std::int64_t k = -radius; k <= radius; ++k)
+            {
+                const std::uint16_t weight = _weights[k + radius];
+                const std::int64_t first = std::max(-k, std::int64_t(0));
+                const std::int64_t last = std::min(lastX - k, lastX);
+                if (first <= last)
+                    p.accumulate(down.data() + (first + k) * _image.channels, (last - first + 1) * _image.channels, weight, acc.data() + first * _image.channels);
+
+                // Pixels whose neighbour is past an edge take the edge pixel instead
+                auto extend = [&](std::int64_t _from, std::int64_t _to, std::int64_t _edge) {
+                    for (std::int64_t x = _from; x < _to; ++x)
+                        for (std::uint32_t c = 0; c < _image.channels; ++c)
+                            acc[x * _image.channels + c] += static_cast<std::uint16_t>(down[_edge * _image.channels + c] * weight);
+                };
+                const std::int64_t left = std::min(first, lastX + 1);
+                extend(0, left, 0);
+                extend(std::max(last + 1, left), lastX + 1, lastX);
+            }
+            p.narrow(acc.data(), row, bias, scale, _out + y * row);
+        }
+    }
+}
+
+agent::kernels::Isa agent::kernels::BestIsa()
+{
+    static const Isa best = detect();
+    return best;
+}
+
+agent::kernels::Isa agent::kernels::CurrentIsa()
+{
+    return current().load(std::memory_order_relaxed);
+}
+
+agent::kernels::Isa agent::kernels::UseIsa(Isa _isa)
+{
+    const Isa chosen = std::min(_isa, BestIsa());
+    current().store(chosen, std::memory_order_relaxed);
+    return chosen;
+}
+
+const char* agent::kernels::IsaName(Isa _isa)
+{
+    switch (_isa)
+    {
+    case Isa::AVX512:
+        return "avx512";
+    case Isa::AVX2:
+        return "avx2";
+    case Isa::SSE2:
+        return "sse2";
+    case Isa::SCALAR:
+        break;
+    }
+    return "scalar";
+}
+
+std::uint64_t agent::kernels::Sum(const ImageView& _image)
+{
+    return use().sum(_image.pixels, _image.Size());
+}
+
+double agent::kernels::Mean(const ImageView& _image)
+{
+    const std::size_t size = _image.Size();
+    return size == 0 ? 0.0 : static_cast<double>(Sum(_image)) / static_cast<double>(size);
+}
+
+// Scattered increments do not vectorize; four tables instead of one keep
+// runs of equal samples from waiting on each other's stores
+std::array<std::uint64_t, 256> agent::kernels::Histogram(const ImageView& _image)
+{
+    std::array<std::array<std::uint64_t, 256>, 4> counts{};
+    const std::size_t size = _image.Size();
+    std::size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        ++counts[0][_image.pixels[i]];
+        ++counts[1][_image.pixels[i + 1]];
+        ++counts[2][_image.pixels[i + 2]];
+        ++counts[3][_image.pixels[i + 3]];
+    }
+    for (; i < size; ++i)
+        ++counts[0][_image.pixels[i]];
+
+    for (std::size_t value = 0; value < 256; ++value)
+        counts[0][value] += counts[1][value] + counts[2][value] + counts[3][value];
+    return counts[0];
+}
+
+agent::kernels::PixelRange agent::kernels::MinMax(const ImageView& _image)
+{
+    PixelRange range;
+    if (_image.Size() == 0)
+        return range;
+
+    range.min = 255;
+    use().minMax(_image.pixels, _image.Size(), range.min, range.max);
+    return range;
+}
+
+void agent::kernels::Threshold(const ImageView& _image, std::uint8_t _level, std::uint8_t* _out)
+{
+    // Nothing is above the top value, and level + 1 would wrap in the vector versions
+    if (_level == 255)
+        std::memset(_out, 0, _image.Size());
+    else
+        use().threshold(_image.pixels, _image.Size(), _level, _out);
+}
+
+void agent::kernels::Clamp(const ImageView& _image, std::uint8_t _min, std::uint8_t _max, std::uint8_t* _out)
+{
+    use().clamp(_image.pixels, _image.Size(), _min, _max, _out);
+}
+
+void agent::kernels::BoxBlur(const ImageView& _image, std::uint32_t _radius, std::uint8_t* _out)
+{
+    // Sums of up to 255 samples of 255 still fit in 16 bits
+    if (_radius > 127)
+        throw std::invalid_argument("Box blur radius over 127");
+
+    if (_radius == 0)
+    {
+        std::memcpy(_out, _image.pixels, _image.Size());
+        return;
+    }
+    if (_image.Size() > 0)
+        separable(_image, std::vector<std::uint16_t>(2 * _radius + 1, 1), 2 * _radius + 1, _out);
+}
+
+void agent::kernels::GaussianBlur(const ImageView& _image, std::uint8_t* _out)
+{
+    if (_image.Size() > 0)
+        separable(_image, {1, 4, 6, 4, 1}, 16, _out);
+}
+
+void agent::kernels::Downsample(const ImageView& _image, std::uint8_t* _out)
+{
+    const Primitives& p = use();
+    const std::size_t row = static_cast<std::size_t>(_image.width) * _image.channels;
+    const std::uint32_t width = _image.width / 2;
+    const std::uint32_t height = _image.height / 2;
+
+    thread_local std::vector<std::uint8_t> pairs;
+    pairs.resize(row);
+
+    // Rows are averaged whole; neighbouring pixels then one sample at a time
+    for (std::uint32_t y = 0; y < height; ++y)
+    {
+        p.average(_image.pixels + (2 * y) * row, _image.pixels + (2 * y + 1) * row, row, pairs.data());
+
+        std::uint8_t* out = _out + static_cast<std::size_t>(y) * width * _image.channels;
+        for (std::uint32_t x = 0; x < width; ++x)
+            for (std::uint32_t c = 0; c < _image.channels; ++c)
+            {
+                const std::size_t left = (2 * static_cast<std::size_t>(x)) * _image.channels + c;
+                out[x * _image.channels + c] = static_cast<std::uint8_t>((pairs[left] + pairs[left + _image.channels] + 1) >> 1);
+            }
+    }
+}
+
+void agent::kernels::Convert(const ImageView& _image, std::uint32_t _channels, std::uint8_t* _out)
+{
+    requireColour(_image.channels);
+    requireColour(_channels);
+
+    const std::size_t area = static_cast<std::size_t>(_image.width) * _image.height;
+    const std::uint8_t* in = _image.pixels;
+    if (_image.channels == _channels)
+    {
+        std::memcpy(_out, in, _image.Size());
+        return;
+    }
+
+    for (std::size_t i = 0; i < area; ++i, in += _image.channels, _out += _channels)
+    {
+        if (_image.channels == 1)
+        {
+            _out[0] = _out[1] = _out[2] = in[0];
+        }
+        else if (_channels == 1)
+        {
+            // BT.601 luma in 8-bit fixed point
+            _out[0] = static_cast<std::uint8_t>((77 * in[0] + 150 * in[1] + 29 * in[2] + 128) >> 8);
+            continue;
+        }
+        else
+        {
+            _out[0] = in[0];
+            _out[1] = in[1];
+            _out[2] = in[2];
+        }
+
+        if (_channels == 4)
+            _out[3] = 255;
+    }
+}
@@ -0,0 +1,101 @@
+#include "agent/Logging.hpp"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+
+#include <json/json.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/async_logger.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace
+{
+    // What ConfigureLogging last said, for the loggers and samplers made after
+    std::mutex policyLock;
+    agent::LogPolicy configured;
+    std::atomic<std::uint32_t> sampleEvery{AGENT_LOG_SAMPLE_EVERY};
+}
+
+agent::LogPolicy agent::LogPolicy::FromJson(const Json::Value& _config)
+{
+    LogPolicy policy;
+    policy.async = _config.get("async", policy.async).asBool();
+    policy.queueSize = std::max<Json::UInt64>(_config.get("queueSize", Json::Value::UInt64(policy.queueSize)).asUInt64(), 1);
+    policy.threads = std::max<Json::UInt64>(_config.get("threads", Json::Value::UInt64(policy.threads)).asUInt64(), 1);
+    policy.block = _config.get("overflow", "overrun").asString() == "block";
+    policy.sampleEvery = _config.get("sampleEvery", policy.sampleEvery).asUInt();
+    policy.level = _config.get("level", policy.level).asString();
+
+    return policy;
+}
+
+void agent::ConfigureLogging(const LogPolicy& _policy)
+{
+    std::lock_guard<std::mutex> lock(policyLock);
+    configured = _policy;
+    sampleEvery.store(_policy.sampleEvery, std::memory_order_relaxed);
+
+    // Asynchronous loggers keep a pointer to the pool; it is made only once
+    if (_policy.async && spdlog::thread_pool() == nullptr)
+        spdlog::init_thread_pool(_policy.queueSize, _policy.threads);
+
+    spdlog::set_level(spdlog::level::from_str(_policy.level));
+}
+
+void agent::ConfigureLogging(const Json::Value& _config)
+{
+    ConfigureLogging(LogPolicy::FromJson(_config["logging"]));
+}
+
+std::shared_ptr<spdlog::logger> agent::GetLogger(const std::string& _name)
+{
+    std::lock_guard<std::mutex> lock(policyLock);
+    auto logger = spdlog::get(_name);
+    if (logger != nullptr)
+        return logger;
+
+    if (!configured.async)
+        return spdlog::stdout_color_mt(_name);
+
+    auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    logger = std::make_shared<spdlog::async_logger>(
+        _name,
+        std::move(sink),
+        spdlog::thread_pool(),
+        configured.block ? spdlog::async_overflow_policy::block : spdlog::async_overflow_policy::overrun_oldest);
+    spdlog::initialize_logger(logger);
+    return logger;
+}
+
+agent::LogSampler::LogSampler()
+    : _every(sampleEvery.load(std::memory_order_relaxed))
+{}
+
+agent::LogSampler::LogSampler(std::uint32_t __every)
+    : _every(__every)
+{}
+
+bool agent::LogSampler::Sample()
+{
+    const std::uint32_t every = _every.load(std::memory_order_relaxed);
+    if (every == 0)
+        return false;
+    if (every == 1)
+        return true;
+    return _events.fetch_add(1, std::memory_order_relaxed) % every == 0;
+}
+
+void agent::LogSampler::SetEvery(std::uint32_t __every)
+{
+    _every.store(__every, std::memory_order_relaxed);
+}
+
+std::uint32_t agent::LogSampler::Every() const
+{
+    return _every.load(std::memory_order_relaxed);
+}
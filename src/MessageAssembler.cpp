@@ -0,0 +1,67 @@
+#include "agent/MessageAssembler.hpp"
+#include "agent/BufferPool.hpp"
+
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+agent::MessageAssembler::MessageAssembler(std::shared_ptr<BufferPool> __pool)
+    : _pool(std::move(__pool))
+{}
+
+void agent::MessageAssembler::Begin(std::uint64_t _size)
+{
+    // Size the buffer for the whole body up front so frames never move
+    _current = _pool->Acquire(static_cast<std::size_t>(_size));
+    _received = 0;
+    _active = true;
+}
+
+void agent::MessageAssembler::Append(const char* _data, std::size_t _size)
+{
+    if (!_active)
+        Begin(_size);
+
+    // The header lied or was missing; grow rather than drop bytes
+    if (_received + _size > _current.Capacity())
+    {
+        auto larger = _pool->Acquire(_received + _size);
+        if (_received > 0)
+            std::memcpy(larger.Data(), _current.Data(), _received);
+        _current = std::move(larger);
+    }
+
+    std::memcpy(_current.Data() + _received, _data, _size);
+    _received += _size;
+}
+
+agent::PooledBuffer agent::MessageAssembler::Finish()
+{
+    // An empty body never gets a Begin from some brokers; give back an empty block
+    if (!_active)
+        _current = _pool->Acquire(0);
+
+    _current.Resize(_received);
+    _received = 0;
+    _active = false;
+
+    return std::move(_current);
+}
+
+void agent::MessageAssembler::Reset()
+{
+    _current.Reset();
+    _received = 0;
+    _active = false;
+}
+
+bool agent::MessageAssembler::Active() const
+{
+    return _active;
+}
+
+std::size_t agent::MessageAssembler::Received() const
+{
+    return _received;
+}
@@ -0,0 +1,278 @@
+#include "agent/Metrics.hpp"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    std::atomic<std::size_t> threads{0};
+
+    // Threads take the slots in turn as they first record something
+    std::size_t threadSlot()
+    {
+        thread_local const std::size_t slot = threads.fetch_add(1, std::memory_order_relaxed) % AGENT_METRICS_SLOTS;
+        return slot;
+    }
+
+    bool validName(const std::string &_name)
+    {
+        if (_name.empty() || (_name[0] >= '0' && _name[0] <= '9'))
+            return false;
+        return std::all_of(_name.begin(), _name.end(), [](char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == ':';
+        });
+    }
+
+    std::string escape(const std::string &_text, bool _quotes)
+    {
+        std::string escaped;
+        escaped.reserve(_text.size());
+        for (const char c : _text)
+        {
+            if (c == '\\')
+                escaped += "\\\\";
+            else if (c == '\n')
+                escaped += "\\n";
+            else if (c == '"' && _quotes)
+                escaped += "\\\"";
+            else
+                escaped += c;
+        }
+        return escaped;
+    }
+
+    // a="1",b="2"; the key of the series in its family, and its labels once rendered
+    std::string renderLabels(const agent::MetricLabels &_labels)
+    {
+        std::string rendered;
+        for (const auto &label : _labels)
+        {
+            if (!validName(label.first) || label.first.find(':') != std::string::npos)
+                throw std::invalid_argument("Malformed label name '" + label.first + "'");
+            if (!rendered.empty())
+                rendered += ',';
+            rendered += label.first + "=\"" + escape(label.second, true) + '"';
+        }
+        return rendered;
+    }
+
+    std::string formatValue(double _value)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.15g", _value);
+        return text;
+    }
+
+    void writeSample(std::string &_out, const std::string &_name, const std::string &_labels, const std::string &_value)
+    {
+        _out += _name;
+        if (!_labels.empty())
+            _out += '{' + _labels + '}';
+        _out += ' ';
+        _out += _value;
+        _out += '\n';
+    }
+
+    // The sum is kept as the bits of a double, in a cell like the counts
+    double toDouble(std::uint64_t _bits)
+    {
+        double value;
+        std::memcpy(&value, &_bits, sizeof(value));
+        return value;
+    }
+
+    std::uint64_t toBits(double _value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &_value, sizeof(bits));
+        return bits;
+    }
+}
+
+void agent::Counter::Add(std::uint64_t _n)
+{
+    _slots[threadSlot()].value.fetch_add(_n, std::memory_order_relaxed);
+}
+
+std::uint64_t agent::Counter::Value() const
+{
+    std::uint64_t total = 0;
+    for (const auto &slot : _slots)
+        total += slot.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+void agent::Gauge::Set(std::int64_t __value)
+{
+    _value.store(__value, std::memory_order_relaxed);
+}
+
+void agent::Gauge::Add(std::int64_t _n)
+{
+    _value.fetch_add(_n, std::memory_order_relaxed);
+}
+
+std::int64_t agent::Gauge::Value() const
+{
+    return _value.load(std::memory_order_relaxed);
+}
+
+agent::Histogram::Histogram(std::vector<double> __bounds)
+    : _bounds(std::move(__bounds))
+{
+    if (!std::is_sorted(_bounds.begin(), _bounds.end()) || std::adjacent_find(_bounds.begin(), _bounds.end()) != _bounds.end())
+        throw std::invalid_argument("Histogram bounds must be ascending");
+
+    // The buckets, the overflow and the sum, rounded up to whole lines
+    _lines = (_bounds.size() + 2 + 7) / 8;
+    _cells = std::make_unique<Line[]>(_lines * AGENT_METRICS_SLOTS);
+    for (std::size_t i = 0; i < _lines * AGENT_METRICS_SLOTS; ++i)
+        for (auto &cell : _cells[i].cells)
+            cell.store(0, std::memory_order_relaxed);
+}
+
+void agent::Histogram::Observe(double _value)
+{
+    const std::size_t slot = threadSlot();
+    const std::size_t bucket = std::lower_bound(_bounds.begin(), _bounds.end(), _value) - _bounds.begin();
+    _cell(slot, bucket).fetch_add(1, std::memory_order_relaxed);
+
+    // Only this thread, or the odd one sharing its slot, writes the sum
+    std::atomic<std::uint64_t> &sum = _cell(slot, _bounds.size() + 1);
+    std::uint64_t bits = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(bits, toBits(toDouble(bits) + _value), std::memory_order_relaxed))
+        ;
+}
+
+void agent::Histogram::Observe(std::chrono::steady_clock::duration _elapsed)
+{
+    Observe(std::chrono::duration<double>(_elapsed).count());
+}
+
+const std::vector<double> &agent::Histogram::Bounds() const
+{
+    return _bounds;
+}
+
+std::vector<std::uint64_t> agent::Histogram::Counts() const
+{
+    std::vector<std::uint64_t> counts(_bounds.size() + 1, 0);
+    for (std::size_t slot = 0; slot < AGENT_METRICS_SLOTS; ++slot)
+        for (std::size_t i = 0; i < counts.size(); ++i)
+            counts[i] += _cell(slot, i).load(std::memory_order_relaxed);
+    return counts;
+}
+
+double agent::Histogram::Sum() const
+{
+    double sum = 0;
+    for (std::size_t slot = 0; slot < AGENT_METRICS_SLOTS; ++slot)
+        sum += toDouble(_cell(slot, _bounds.size() + 1).load(std::memory_order_relaxed));
+    return sum;
+}
+
+std::vector<double> agent::Histogram::LatencyBounds()
+{
+    return {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+}
+
+std::atomic<std::uint64_t> &agent::Histogram::_cell(std::size_t _slot, std::size_t _index) const
+{
+    return _cells[_slot * _lines + _index / 8].cells[_index % 8];
+}
+
+agent::Counter &agent::MetricsRegistry::GetCounter(const std::string &_name, const std::string &_help, const MetricLabels &_labels)
+{
+    const std::string key = renderLabels(_labels);
+    std::lock_guard<std::mutex> lock(_lock);
+    auto &series = _family(_name, _help, "counter").counters[key];
+    if (series == nullptr)
+        series = std::make_unique<Counter>();
+    return *series;
+}
+
+agent::Gauge &agent::MetricsRegistry::GetGauge(const std::string &_name, const std::string &_help, const MetricLabels &_labels)
+{
+    const std::string key = renderLabels(_labels);
+    std::lock_guard<std::mutex> lock(_lock);
+    auto &series = _family(_name, _help, "gauge").gauges[key];
+    if (series == nullptr)
+        series = std::make_unique<Gauge>();
+    return *series;
+}
+
+agent::Histogram &agent::MetricsRegistry::GetHistogram(const std::string &_name, const std::string &_help, const MetricLabels &_labels, const std::vector<double> &_bounds)
+{
+    const std::string key = renderLabels(_labels);
+    std::lock_guard<std::mutex> lock(_lock);
+    auto &series = _family(_name, _help, "histogram").histograms[key];
+    if (series == nullptr)
+        series = std::make_unique<Histogram>(_bounds);
+    return *series;
+}
+
+std::string agent::MetricsRegistry::Render() const
+{
+    std::string out;
+    std::lock_guard<std::mutex> lock(_lock);
+    for (const auto &named : _families)
+    {
+        const std::string &name = named.first;
+        const Family &family = named.second;
+        out += "# HELP " + name + ' ' + escape(family.help, false) + '\n';
+        out += "# TYPE " + name + ' ' + family.type + '\n';
+
+        for (const auto &series : family.counters)
+            writeSample(out, name, series.first, std::to_string(series.second->Value()));
+        for (const auto &series : family.gauges)
+            writeSample(out, name, series.first, std::to_string(series.second->Value()));
+
+        // Buckets are cumulative, each counting everything up to its bound
+        for (const auto &series : family.histograms)
+        {
+            const std::vector<double> &bounds = series.second->Bounds();
+            const std::vector<std::uint64_t> counts = series.second->Counts();
+            const std::string prefix = series.first.empty() ? "" : series.first + ',';
+
+            std::uint64_t total = 0;
+            for (std::size_t i = 0; i < counts.size(); ++i)
+            {
+                total += counts[i];
+                const std::string bound = i < bounds.size() ? formatValue(bounds[i]) : "+Inf";
+                writeSample(out, name + "_bucket", prefix + "le=\"" + bound + '"', std::to_string(total));
+            }
+            writeSample(out, name + "_sum", series.first, formatValue(series.second->Sum()));
+            writeSample(out, name + "_count", series.first, std::to_string(total));
+        }
+    }
+    return out;
+}
+
+agent::MetricsRegistry::Family &agent::MetricsRegistry::_family(const std::string &_name, const std::string &_help, const char *_type)
+{
+    if (!validName(_name))
+        throw std::invalid_argument("Malformed metric name '" + _name + "'");
+
+    Family &family = _families[_name];
+    if (family.type.empty())
+    {
+        family.help = _help;
+        family.type = _type;
+    }
+    else if (family.type != _type)
+    {
+        throw std::invalid_argument("Metric '" + _name + "' is a " + family.type + ", not a " + _type);
+    }
+    return family;
+}
@@ -0,0 +1,105 @@
+#include "agent/MetricsServer.hpp"
+#include "agent/Metrics.hpp"
+#include "agent/Tracer.hpp"
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <utility>
+
+#include <Poco/Net/HTTPServer.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/HTTPResponse.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/SocketAddress.h>
+
+namespace
+{
+    class MetricsHandler : public Poco::Net::HTTPRequestHandler
+    {
+    public:
+        MetricsHandler(std::shared_ptr<const agent::MetricsRegistry> __registry, std::shared_ptr<const agent::Tracer> __tracer)
+            : _registry(std::move(__registry)), _tracer(std::move(__tracer))
+        {}
+
+        void handleRequest(Poco::Net::HTTPServerRequest &_request, Poco::Net::HTTPServerResponse &_response) override
+        {
+            const std::string &uri = _request.getURI();
+            const bool metrics = uri == "/metrics" || uri.rfind("/metrics?", 0) == 0;
+            const bool trace = _tracer != nullptr && (uri == "/trace" || uri.rfind("/trace?", 0) == 0);
+            if (!metrics && !trace)
+            {
+                _response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+                _response.send();
+                return;
+            }
+            if (_request.getMethod() != Poco::Net::HTTPRequest::HTTP_GET && _request.getMethod() != Poco::Net::HTTPRequest::HTTP_HEAD)
+            {
+                _response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_METHOD_NOT_ALLOWED);
+                _response.send();
+                return;
+            }
+
+            if (trace)
+            {
+                const std::string body = _tracer->ChromeTrace();
+                _response.setContentType("application/json");
+                _response.sendBuffer(body.data(), body.size());
+                return;
+            }
+
+            const std::string body = _registry->Render();
+            _response.setContentType("text/plain; version=0.0.4; charset=utf-8");
+            _response.sendBuffer(body.data(), body.size());
+        }
+
+    private:
+        std::shared_ptr<const agent::MetricsRegistry> _registry;
+        std::shared_ptr<const agent::Tracer> _tracer;
+    };
+
+    class MetricsHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory
+    {
+    public:
+        MetricsHandlerFactory(std::shared_ptr<const agent::MetricsRegistry> __registry, std::shared_ptr<const agent::Tracer> __tracer)
+            : _registry(std::move(__registry)), _tracer(std::move(__tracer))
+        {}
+
+        Poco::Net::HTTPRequestHandler *createRequestHandler(const Poco::Net::HTTPServerRequest &_request) override
+        {
+            return new MetricsHandler(_registry, _tracer);
+        }
+
+    private:
+        std::shared_ptr<const agent::MetricsRegistry> _registry;
+        std::shared_ptr<const agent::Tracer> _tracer;
+    };
+}
+
+agent::MetricsServer::MetricsServer(std::shared_ptr<const MetricsRegistry> __registry, const std::string &_address, std::uint16_t _port, std::shared_ptr<const Tracer> __tracer)
+    : _registry(std::move(__registry)), _tracer(std::move(__tracer))
+{
+    // Scrapes are rare and cheap; two threads are plenty
+    Poco::Net::HTTPServerParams::Ptr params = new Poco::Net::HTTPServerParams;
+    params->setMaxThreads(2);
+    params->setKeepAlive(false);
+
+    Poco::Net::ServerSocket socket(Poco::Net::SocketAddress(_address, _port));
+    _server = std::make_unique<Poco::Net::HTTPServer>(new MetricsHandlerFactory(_registry, _tracer), socket, params);
+    _server->start();
+}
+
+agent::MetricsServer::~MetricsServer()
+{
+    _server->stopAll();
+}
+
+std::uint16_t agent::MetricsServer::Port() const
+{
+    return _server->port();
+}
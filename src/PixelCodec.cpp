@@ -0,0 +1,351 @@
+#include "agent/PixelCodec.hpp"
+#include "agent/Kernels.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define AGENT_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using agent::kernels::Isa;
+
+    constexpr std::size_t maxLiteral = 128; ///< Longest run of differences sent as they are
+    constexpr std::size_t minRun = 3; ///< Shortest run of one difference worth a control byte
+    constexpr std::size_t maxRun = 130; ///< Longest run of one difference
+
+    // A row of differences with no runs: all of it, and a control byte per literal
+    std::size_t maxRowSize(std::size_t _row)
+    {
+        return _row + (_row + maxLiteral - 1) / maxLiteral;
+    }
+
+    /**
+     * The loops with a vector version. Decoding a row is one, so its
+     * token loop inlines the vector copies; encoding finds the tokens from
+     * a bit per byte, which the vector versions set 32 at a time. Each
+     * vector loop finishes its tail in plain C++.
+     */
+    struct Primitives
+    {
+        void (*delta)(const std::uint8_t*, std::size_t, std::uint32_t, std::uint8_t*);
+        void (*repeats)(const std::uint8_t*, std::size_t, std::uint64_t*);
+        std::size_t (*decode)(const std::uint8_t*, std::size_t, std::uint8_t*, std::size_t, std::uint32_t);
+    };
+
+    [[noreturn]] void malformed()
+    {
+        throw std::invalid_argument("Coded row overruns its pixels or is cut short");
+    }
+
+    // Each sample less the same channel of the pixel to its left
+    void deltaScalar(const std::uint8_t* _row, std::size_t _n, std::uint32_t _channels, std::uint8_t* _out)
+    {
+        for (std::size_t i = 0; i < _n; ++i)
+            _out[i] = static_cast<std::uint8_t>(_row[i] - (i >= _channels ? _row[i - _channels] : 0));
+    }
+
+    // Sets bit i of _same for each byte equal to the one before it
+    void repeatsScalar(const std::uint8_t* _in, std::size_t _n, std::uint64_t* _same)
+    {
+        for (std::size_t i = 1; i < _n; ++i)
+            if (_in[i] == _in[i - 1])
+                _same[i >> 6] |= std::uint64_t(1) << (i & 63);
+    }
+
+    void undeltaScalar(std::uint8_t* _row, std::size_t _from, std::size_t _n, std::uint32_t _channels)
+    {
+        for (std::size_t i = std::max<std::size_t>(_from, _channels); i < _n; ++i)
+            _row[i] = static_cast<std::uint8_t>(_row[i] + _row[i - _channels]);
+    }
+
+    // Expands the differences of a row then adds them up; returns the bytes read
+    std::size_t decodeScalar(const std::uint8_t* _in, std::size_t _size, std::uint8_t* _out, std::size_t _n, std::uint32_t _channels)
+    {
+        std::size_t in = 0;
+        for (std::size_t o = 0; o < _n;)
+        {
+            if (in >= _size)
+                malformed();
+            const std::uint8_t control = _in[in++];
+            const std::size_t length = control < 128 ? control + 1u : control - 128u + minRun;
+            if (o + length > _n || in + (control < 128 ? length : 1) > _size)
+                malformed();
+
+            if (control < 128)
+            {
+                std::memcpy(_out + o, _in + in, length);
+                in += length;
+            }
+            else
+                std::memset(_out + o, _in[in++], length);
+            o += length;
+        }
+
+        undeltaScalar(_out, 0, _n, _channels);
+        return in;
+    }
+
+    const Primitives scalar = {deltaScalar, repeatsScalar, decodeScalar};
+
+#ifdef AGENT_KERNELS_X86
+    __attribute__((target("avx2"))) void deltaAvx2(const std::uint8_t* _row, std::size_t _n, std::uint32_t _channels, std::uint8_t* _out)
+    {
+        const std::size_t head = std::min<std::size_t>(_channels, _n);
+        deltaScalar(_row, head, _channels, _out);
+
+        std::size_t i = head;
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m256i here = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_row + i));
+            const __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_row + i - _channels));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i), _mm256_sub_epi8(here, left));
+        }
+        for (; i < _n; ++i)
+            _out[i] = static_cast<std::uint8_t>(_row[i] - _row[i - _channels]);
+    }
+
+    __attribute__((target("avx2"))) void repeatsAvx2(const std::uint8_t* _in, std::size_t _n, std::uint64_t* _same)
+    {
+        std::size_t i = 32;
+        repeatsScalar(_in, std::min(i, _n), _same);
+        for (; i + 32 <= _n; i += 32)
+        {
+            const __m256i here = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + i));
+            const __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + i - 1));
+            const auto equal = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(here, left)));
+            _same[i >> 6] |= static_cast<std::uint64_t>(equal) << (i & 63);
+        }
+        for (; i < _n; ++i)
+            if (_in[i] == _in[i - 1])
+                _same[i >> 6] |= std::uint64_t(1) << (i & 63);
+    }
+
+    // Copies in whole vectors, as far past _n as _room allows
+    __attribute__((target("avx2"))) inline void copyAvx2(std::uint8_t* _out, const std::uint8_t* _in, std::size_t _n, std::size_t _room)
+    {
+        if (_n + 31 >= _room)
+        {
+            std::memcpy(_out, _in, _n);
+            return;
+        }
+        for (std::size_t k = 0; k < _n; k += 32)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + k), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_in + k)));
+    }
+
+    __attribute__((target("avx2"))) inline void fillAvx2(std::uint8_t* _out, std::uint8_t _value, std::size_t _n, std::size_t _room)
+    {
+        if (_n + 31 >= _room)
+        {
+            std::memset(_out, _value, _n);
+            return;
+        }
+        const __m256i value = _mm256_set1_epi8(static_cast<char>(_value));
+        for (std::size_t k = 0; k < _n; k += 32)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + k), value);
+    }
+
+    /**
+     * Adds up each channel along the row: within a block of 16 by adding
+     * the block to itself shifted by 1, 2, 4 and 8 pixels, then the last
+     * total of each channel in the block before. Every block waits on the
+     * one before, so wider vectors would not help.
+     */
+    __attribute__((target("avx2"))) inline void undeltaAvx2(std::uint8_t* _row, std::size_t _n, std::uint32_t _channels)
+    {
+        alignas(16) std::uint8_t shifts[4][16];
+        alignas(16) std::uint8_t carry[16];
+        std::size_t steps = 0;
+        for (std::size_t s = _channels; s < 16; s <<= 1, ++steps)
+            for (std::size_t j = 0; j < 16; ++j)
+                shifts[steps][j] = j >= s ? static_cast<std::uint8_t>(j - s) : 0x80;
+        for (std::size_t j = 0; j < 16; ++j)
+            carry[j] = static_cast<std::uint8_t>(15 - (_channels - 1 - j % _channels));
+
+        const __m128i last = _mm_load_si128(reinterpret_cast<const __m128i*>(carry));
+        __m128i previous = _mm_setzero_si128();
+        std::size_t i = 0;
+        for (; i + 16 <= _n; i += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_row + i));
+            for (std::size_t step = 0; step < steps; ++step)
+                block = _mm_add_epi8(block, _mm_shuffle_epi8(block, _mm_load_si128(reinterpret_cast<const __m128i*>(shifts[step]))));
+            block = _mm_add_epi8(block, _mm_shuffle_epi8(previous, last));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_row + i), block);
+            previous = block;
+        }
+        undeltaScalar(_row, i, _n, _channels);
+    }
+
+    __attribute__((target("avx2"))) std::size_t decodeAvx2(const std::uint8_t* _in, std::size_t _size, std::uint8_t* _out, std::size_t _n, std::uint32_t _channels)
+    {
+        std::size_t in = 0;
+        for (std::size_t o = 0; o < _n;)
+        {
+            if (in >= _size)
+                malformed();
+            const std::uint8_t control = _in[in++];
+            const std::size_t length = control < 128 ? control + 1u : control - 128u + minRun;
+            if (o + length > _n || in + (control < 128 ? length : 1) > _size)
+                malformed();
+
+            // Spilling into the rest of the row is fine; it is written over next
+            if (control < 128)
+            {
+                const std::size_t room = std::min(_n - o, _size - in);
+                copyAvx2(_out + o, _in + in, length, room);
+                in += length;
+            }
+            else
+                fillAvx2(_out + o, _in[in++], length, _n - o);
+            o += length;
+        }
+
+        undeltaAvx2(_out, _n, _channels);
+        return in;
+    }
+
+    const Primitives avx2 = {deltaAvx2, repeatsAvx2, decodeAvx2};
+#endif
+
+    // Walks set bits from _i on; returns how far it got before a clear one, at most _limit
+    std::size_t spanOfSet(const std::uint64_t* _bits, std::size_t _i, std::size_t _limit)
+    {
+        const std::size_t end = _i + _limit;
+        std::size_t k = _i;
+        while (k < end)
+        {
+            const std::uint64_t clear = ~_bits[k >> 6] >> (k & 63);
+            if (clear != 0)
+            {
+                k += __builtin_ctzll(clear);
+                break;
+            }
+            k += 64 - (k & 63);
+        }
+        return std::min(k, end) - _i;
+    }
+
+    // As spanOfSet, for clear bits
+    std::size_t spanOfClear(const std::uint64_t* _bits, std::size_t _i, std::size_t _limit)
+    {
+        const std::size_t end = _i + _limit;
+        std::size_t k = _i;
+        while (k < end)
+        {
+            const std::uint64_t set = _bits[k >> 6] >> (k & 63);
+            if (set != 0)
+            {
+                k += __builtin_ctzll(set);
+                break;
+            }
+            k += 64 - (k & 63);
+        }
+        return std::min(k, end) - _i;
+    }
+
+    /**
+     * Codes a row of differences from the bits set for repeats: a run goes
+     * on as long as they are set, and a literal until the first byte
+     * followed by two repeats, where a run long enough to code starts.
+     */
+    std::size_t encodeRow(const std::uint8_t* _differences, std::size_t _n, const std::uint64_t* _same, std::uint64_t* _starts, std::size_t _words, std::uint8_t* _out)
+    {
+        for (std::size_t w = 0; w + 1 < _words; ++w)
+            _starts[w] = ((_same[w] >> 1) | (_same[w + 1] << 63)) & ((_same[w] >> 2) | (_same[w + 1] << 62));
+
+        std::size_t o = 0;
+        for (std::size_t i = 0; i < _n;)
+        {
+            const std::size_t run = 1 + spanOfSet(_same, i + 1, std::min(_n - i, maxRun) - 1);
+            if (run >= minRun)
+            {
+                _out[o++] = static_cast<std::uint8_t>(128 + run - minRun);
+                _out[o++] = _differences[i];
+                i += run;
+                continue;
+            }
+
+            // Never empty, as no run starts here
+            const std::size_t literal = std::max<std::size_t>(spanOfClear(_starts, i, std::min(_n - i, maxLiteral)), 1);
+            _out[o++] = static_cast<std::uint8_t>(literal - 1);
+            std::memcpy(_out + o, _differences + i, literal);
+            o += literal;
+            i += literal;
+        }
+        return o;
+    }
+
+    const Primitives& use()
+    {
+#ifdef AGENT_KERNELS_X86
+        if (agent::kernels::CurrentIsa() >= Isa::AVX2)
+            return avx2;
+#endif
+        return scalar;
+    }
+
+    void requireColour(std::uint32_t _channels)
+    {
+        if (_channels != 1 && _channels != 3 && _channels != 4)
+            throw std::invalid_argument("Images must be gray, RGB or RGBA");
+    }
+
+}
+
+std::size_t agent::kernels::MaxDeltaRleSize(const ImageView& _image)
+{
+    return maxRowSize(static_cast<std::size_t>(_image.width) * _image.channels) * _image.height;
+}
+
+std::size_t agent::kernels::EncodeDeltaRle(const ImageView& _image, std::uint8_t* _out, std::uint32_t* _rows)
+{
+    requireColour(_image.channels);
+    const Primitives& p = use();
+    const std::size_t row = static_cast<std::size_t>(_image.width) * _image.channels;
+
+    // Reused between calls, so a publishing thread only allocates them once;
+    // a clear word past the row ends every run there
+    const std::size_t words = row / 64 + 2;
+    thread_local std::vector<std::uint8_t> differences;
+    thread_local std::vector<std::uint64_t> same;
+    thread_local std::vector<std::uint64_t> starts;
+    differences.resize(row);
+    same.resize(words);
+    starts.resize(words);
+
+    std::size_t o = 0;
+    for (std::uint32_t y = 0; y < _image.height; ++y)
+    {
+        _rows[y] = static_cast<std::uint32_t>(o);
+        p.delta(_image.pixels + y * row, row, _image.channels, differences.data());
+        std::fill(same.begin(), same.end(), 0);
+        p.repeats(differences.data(), row, same.data());
+        o += encodeRow(differences.data(), row, same.data(), starts.data(), words, _out + o);
+    }
+    return o;
+}
+
+void agent::kernels::DecodeDeltaRle(const CodedImage& _image, std::uint32_t _y, std::uint32_t _count, std::uint8_t* _out)
+{
+    requireColour(_image.channels);
+    if (static_cast<std::uint64_t>(_y) + _count > _image.height)
+        throw std::invalid_argument("Rows past the bottom of the image");
+
+    const Primitives& p = use();
+    const std::size_t row = static_cast<std::size_t>(_image.width) * _image.channels;
+    for (std::uint32_t y = _y; y < _y + _count; ++y)
+    {
+        const std::size_t start = _image.rows[y];
+        if (start > _image.size)
+            malformed();
+        p.decode(_image.bytes + start, _image.size - start, _out + static_cast<std::size_t>(y - _y) * row, row, _image.channels);
+    }
+}
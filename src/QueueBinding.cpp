@@ -0,0 +1,86 @@
+#include "agent/QueueBinding.hpp"
+#include "agent/SymbolMaps.hpp"
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <amqpcpp.h>
+#include <json/json.h>
+
+namespace
+{
+    int flagsFromJson(const Json::Value& _flags, const std::string& _what)
+    {
+        int flags = 0;
+        for (const auto& flag : _flags)
+        {
+            auto found = agent::allBitFlags.find(flag.asString());
+            if (found == agent::allBitFlags.end())
+                throw std::invalid_argument("Unknown " + _what + " flag '" + flag.asString() + "'");
+            flags |= found->second;
+        }
+        return flags;
+    }
+}
+
+agent::QueueBinding agent::QueueBinding::FromJson(const Json::Value& _config)
+{
+    if (!_config.isObject())
+        throw std::invalid_argument("A binding must be an object");
+
+    // Whatever is left out keeps its default; the key defaults to the queue
+    QueueBinding binding;
+    binding.queue = _config.get("queue", binding.queue).asString();
+    binding.exchange = _config.get("exchange", binding.exchange).asString();
+    binding.key = _config.get("key", binding.queue).asString();
+
+    binding.queueFlags = flagsFromJson(_config["queueFlags"], "queue");
+    binding.exchangeFlags = flagsFromJson(_config["exchangeFlags"], "exchange");
+
+    if (_config.isMember("exchangeType"))
+    {
+        auto found = exchangeTypeMap.find(_config["exchangeType"].asString());
+        if (found == exchangeTypeMap.end())
+            throw std::invalid_argument("Unknown exchange type '" + _config["exchangeType"].asString() + "'");
+        binding.exchangeType = found->second;
+    }
+
+    const Json::Value& prefetch = _config["prefetch"];
+    if (!prefetch.isNull())
+    {
+        if (!prefetch.isUInt() || prefetch.asUInt() > 65535)
+            throw std::invalid_argument("Prefetch of queue '" + binding.queue + "' must be 0 to 65535");
+        binding.prefetch = static_cast<std::uint16_t>(prefetch.asUInt());
+    }
+
+    const Json::Value& weight = _config["weight"];
+    if (!weight.isNull())
+    {
+        if (!weight.isUInt() || weight.asUInt() == 0)
+            throw std::invalid_argument("Weight of queue '" + binding.queue + "' must be at least 1");
+        binding.weight = weight.asUInt();
+    }
+
+    return binding;
+}
+
+std::vector<agent::QueueBinding> agent::QueueBinding::ListFromJson(const Json::Value& _config)
+{
+    std::vector<QueueBinding> bindings;
+
+    const Json::Value& list = _config["bindings"];
+    if (!list.isNull() && !list.isArray())
+        throw std::invalid_argument("The bindings must be a list");
+    if (!list.empty())
+    {
+        for (const auto& entry : list)
+            bindings.push_back(FromJson(entry));
+    }
+    else
+    {
+        bindings.push_back(FromJson(_config.get("settings", Json::Value(Json::objectValue))));
+    }
+
+    return bindings;
+}
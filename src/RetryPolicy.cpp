@@ -0,0 +1,37 @@
+#include "agent/RetryPolicy.hpp"
+
+#include <cmath>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include <json/json.h>
+
+std::chrono::milliseconds agent::RetryPolicy::Delay(unsigned int _attempt) const
+{
+    const double delay = initialDelay.count() * std::pow(multiplier, _attempt > 0 ? _attempt - 1 : 0);
+    if (delay >= static_cast<double>(maxDelay.count()))
+        return maxDelay;
+    return std::chrono::milliseconds(static_cast<long long>(delay));
+}
+
+std::string agent::RetryPolicy::DelayQueue(const std::string& _queue, unsigned int _attempt)
+{
+    return _queue + ".retry." + std::to_string(_attempt);
+}
+
+std::string agent::RetryPolicy::DeadLetterQueue(const std::string& _queue)
+{
+    return _queue + ".dead";
+}
+
+agent::RetryPolicy agent::RetryPolicy::FromJson(const Json::Value& _config)
+{
+    RetryPolicy policy;
+    policy.maxAttempts = std::max(_config.get("maxAttempts", policy.maxAttempts).asUInt(), 1u);
+    policy.initialDelay = std::chrono::milliseconds(_config.get("initialDelay", Json::Value::Int64(policy.initialDelay.count())).asInt64());
+    policy.maxDelay = std::chrono::milliseconds(_config.get("maxDelay", Json::Value::Int64(policy.maxDelay.count())).asInt64());
+    policy.multiplier = _config.get("multiplier", policy.multiplier).asDouble();
+
+    return policy;
+}
@@ -0,0 +1,67 @@
+#include "agent/RpcClient.hpp"
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+agent::RpcClient::RpcClient()
+{
+    std::random_device device;
+    const std::uint64_t seed = (static_cast<std::uint64_t>(device()) << 32) | device();
+
+    static const char digits[] = "0123456789abcdef";
+    for (int shift = 60; shift >= 0; shift -= 4)
+        _prefix += digits[(seed >> shift) & 0xf];
+    _prefix += '-';
+}
+
+std::string agent::RpcClient::Register(Callback _callback, std::chrono::milliseconds _timeout, Clock::time_point _now)
+{
+    std::string id = _prefix + std::to_string(++_next);
+    _calls.emplace(id, Call{std::move(_callback), _now + _timeout});
+    return id;
+}
+
+bool agent::RpcClient::Resolve(const std::string& _correlationId, const char* _data, std::size_t _size, bool _succeeded)
+{
+    auto it = _calls.find(_correlationId);
+    if (it == _calls.end())
+        return false;
+
+    // Out of the map first, in case the callback makes another call
+    Callback callback = std::move(it->second.callback);
+    _calls.erase(it);
+    callback(_succeeded, _succeeded ? _data : nullptr, _succeeded ? _size : 0);
+
+    return true;
+}
+
+std::size_t agent::RpcClient::Expire(Clock::time_point _now)
+{
+    std::vector<Callback> expired;
+    for (auto it = _calls.begin(); it != _calls.end();)
+    {
+        if (it->second.deadline <= _now)
+        {
+            expired.push_back(std::move(it->second.callback));
+            it = _calls.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (auto& callback : expired)
+        callback(false, nullptr, 0);
+
+    return expired.size();
+}
+
+std::size_t agent::RpcClient::Outstanding() const
+{
+    return _calls.size();
+}
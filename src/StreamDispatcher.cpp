@@ -0,0 +1,137 @@
+#include "agent/StreamDispatcher.hpp"
+#include "agent/IStreamHandler.hpp"
+#include "agent/IWorker.hpp"
+#include "agent/Logging.hpp"
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <amqpcpp.h>
+#include <spdlog/spdlog.h>
+
+agent::StreamDispatcher::StreamDispatcher(unsigned int __id, std::string __name, IStreamHandler* __handler)
+    : IWorker(__id, __name),
+      _handler(__handler)
+{
+}
+
+agent::StreamDispatcher::~StreamDispatcher()
+{
+    // Our thread runs our operator(); it must be gone before our members are
+    Stop();
+}
+
+void agent::StreamDispatcher::Begin(std::uint64_t _size, const AMQP::Table& _headers)
+{
+    Event event{Event::BEGIN};
+    event.size = _size;
+    event.headers = _headers;
+    _push(std::move(event));
+}
+
+void agent::StreamDispatcher::Chunk(PooledBuffer&& _chunk)
+{
+    Event event{Event::CHUNK};
+    event.chunk = std::move(_chunk);
+    _push(std::move(event));
+}
+
+void agent::StreamDispatcher::End(Completion _onDone)
+{
+    Event event{Event::END};
+    event.onDone = std::move(_onDone);
+    _push(std::move(event));
+}
+
+void agent::StreamDispatcher::Abort()
+{
+    _push(Event{Event::ABORT});
+}
+
+// Streams never arrive as whole messages
+int agent::StreamDispatcher::ProcessMessage(const void* _msg, std::uint32_t _size, void* _result, std::uint32_t* _rsize)
+{
+    return 0;
+}
+
+void agent::StreamDispatcher::operator()()
+{
+    bool failed = false;
+
+    while (GetState() != WORKER_QUIT)
+    {
+        // Wait briefly for an event so we still notice being told to quit
+        std::unique_lock<std::mutex> lock(_events_lock);
+        _events_ready.wait_for(lock, std::chrono::milliseconds(10), [this]() { return !_events.empty(); });
+        if (_events.empty())
+            continue;
+
+        Event event = std::move(_events.front());
+        _events.pop_front();
+        lock.unlock();
+
+        // Once a message has failed, skip the rest of it up to its end
+        int msgId = -1;
+        try
+        {
+            switch (event.kind)
+            {
+            case Event::BEGIN:
+                failed = false;
+                _handler->OnBegin(event.size, event.headers);
+                break;
+            case Event::CHUNK:
+                if (!failed)
+                    _handler->OnChunk(event.chunk.Data(), event.chunk.Size());
+                break;
+            case Event::END:
+                if (!failed)
+                {
+                    msgId = _handler->OnEnd();
+                    if (_logSampler->Sample())
+                        _logger->info("Successfully processed streamed message {}", msgId);
+                    _results_lock.lock();
+                    _results.push_front(std::pair<int, bool>(msgId, true));
+                    _results_lock.unlock();
+                }
+                break;
+            case Event::ABORT:
+                _logger->warn("Streamed message abandoned before its end");
+                failed = true;
+                break;
+            }
+        }
+        catch(const std::exception& e)
+        {
+            _logger->critical(e.what());
+            failed = true;
+        }
+
+        // Record a failure once, when the failing message ends
+        if (failed && (event.kind == Event::END || event.kind == Event::ABORT))
+        {
+            _results_lock.lock();
+            _results.push_front(std::pair<int, bool>(-1, false));
+            _results_lock.unlock();
+        }
+
+        // Only now is the message done with, and safe to settle
+        if (event.kind == Event::END && event.onDone)
+            event.onDone(failed ? -1 : msgId, !failed);
+    }
+}
+
+void agent::StreamDispatcher::_push(Event&& _event)
+{
+    _events_lock.lock();
+    _events.push_back(std::move(_event));
+    _events_lock.unlock();
+    _events_ready.notify_one();
+}
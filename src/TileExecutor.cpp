@@ -0,0 +1,136 @@
+#include "agent/TileExecutor.hpp"
+#include "agent/Kernels.hpp"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <functional>
+
+agent::TileExecutor::TileExecutor(std::size_t __threads)
+{
+    for (std::size_t i = 0; i < __threads; ++i)
+        _threads.emplace_back([this]() {
+            while (!_quit.load())
+                Help(std::chrono::milliseconds(10));
+        });
+}
+
+agent::TileExecutor::~TileExecutor()
+{
+    _quit.store(true);
+    _jobs_ready.notify_all();
+    for (auto &thread : _threads)
+        if (thread.joinable())
+            thread.join();
+}
+
+void agent::TileExecutor::Run(std::size_t _count, const std::function<void(std::size_t)>& _task)
+{
+    // Not worth waking anyone for
+    if (_count <= 1)
+    {
+        if (_count == 1)
+            _task(0);
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->task = &_task;
+    job->count = _count;
+
+    _jobs_lock.lock();
+    _jobs.push_back(job);
+    _jobs_lock.unlock();
+    _jobs_ready.notify_all();
+
+    // Work on it ourselves, then wait for the tasks others took
+    _work(*job);
+    _retire(job);
+
+    std::unique_lock<std::mutex> lock(job->lock);
+    job->finished.wait(lock, [&job]() { return job->done.load() == job->count; });
+    if (job->error)
+        std::rethrow_exception(job->error);
+}
+
+bool agent::TileExecutor::Help(std::chrono::milliseconds _wait)
+{
+    std::shared_ptr<Job> job;
+    {
+        std::unique_lock<std::mutex> lock(_jobs_lock);
+        if (!_jobs_ready.wait_for(lock, _wait, [this]() { return !_jobs.empty() || _quit.load(); }) || _jobs.empty())
+            return false;
+        job = _jobs.front();
+    }
+
+    const bool ran = _work(*job);
+    _retire(job);
+    return ran;
+}
+
+std::vector<agent::Tile> agent::TileExecutor::Split(const kernels::ImageView& _image, std::size_t _tileBytes)
+{
+    std::vector<Tile> tiles;
+    const std::size_t row = static_cast<std::size_t>(_image.width) * _image.channels;
+    if (row == 0 || _image.height == 0)
+        return tiles;
+
+    const auto rows = static_cast<std::uint32_t>(std::max<std::size_t>(1, std::min<std::size_t>(_tileBytes / row, _image.height)));
+    tiles.reserve((_image.height + rows - 1) / rows);
+    for (std::uint32_t y = 0; y < _image.height; y += rows)
+    {
+        Tile tile;
+        tile.index = tiles.size();
+        tile.y = y;
+        tile.view = _image;
+        tile.view.pixels = _image.pixels + y * row;
+        tile.view.height = std::min(rows, _image.height - y);
+        tiles.push_back(tile);
+    }
+    return tiles;
+}
+
+// Takes task numbers until none are left; true if it got any
+bool agent::TileExecutor::_work(Job& _job)
+{
+    bool ran = false;
+    for (std::size_t i = _job.next.fetch_add(1); i < _job.count; i = _job.next.fetch_add(1))
+    {
+        ran = true;
+        try
+        {
+            (*_job.task)(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(_job.lock);
+            if (!_job.error)
+                _job.error = std::current_exception();
+        }
+
+        if (_job.done.fetch_add(1) + 1 == _job.count)
+        {
+            std::lock_guard<std::mutex> lock(_job.lock);
+            _job.finished.notify_all();
+        }
+    }
+    return ran;
+}
+
+// Once every task is handed out, nobody else need look at the job
+void agent::TileExecutor::_retire(const std::shared_ptr<Job>& _job)
+{
+    std::lock_guard<std::mutex> lock(_jobs_lock);
+    auto found = std::find(_jobs.begin(), _jobs.end(), _job);
+    if (found != _jobs.end())
+        _jobs.erase(found);
+}
@@ -0,0 +1,53 @@
+#include "agent/Topology.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include <amqpcpp.h>
+
+void agent::Topology::DeclareExchange(AMQP::Channel& _channel, const std::string& _name, AMQP::ExchangeType _type, int _flags, const AMQP::Table& _arguments)
+{
+    _exchanges.push_back(Exchange{_name, _type, _flags, _arguments});
+    _channel.declareExchange(_name, _type, _flags, _arguments);
+}
+
+void agent::Topology::DeclareQueue(AMQP::Channel& _channel, const std::string& _name, int _flags, const AMQP::Table& _arguments)
+{
+    _queues.push_back(Queue{_name, _flags, _arguments});
+    _channel.declareQueue(_name, _flags, _arguments);
+}
+
+void agent::Topology::BindQueue(AMQP::Channel& _channel, const std::string& _exchange, const std::string& _queue, const std::string& _key, const AMQP::Table& _arguments)
+{
+    _bindings.push_back(Binding{_exchange, _queue, _key, _arguments});
+    _channel.bindQueue(_exchange, _queue, _key, _arguments);
+}
+
+void agent::Topology::SetQos(AMQP::Channel& _channel, std::uint16_t __prefetch)
+{
+    _prefetch = __prefetch;
+    _channel.setQos(_prefetch);
+}
+
+void agent::Topology::Consume(AMQP::Channel& _channel, const std::string& _queue, const std::string& _tag, int _flags, ConsumerSetup _setup)
+{
+    _setup(_channel.consume(_queue, _tag, _flags));
+    _consumers.push_back(Consumer{_queue, _tag, _flags, std::move(_setup)});
+}
+
+void agent::Topology::Replay(AMQP::Channel& _channel) const
+{
+    // Consumers last, so they only start once their queues exist again
+    for (const auto& exchange : _exchanges)
+        _channel.declareExchange(exchange.name, exchange.type, exchange.flags, exchange.arguments);
+    for (const auto& queue : _queues)
+        _channel.declareQueue(queue.name, queue.flags, queue.arguments);
+    for (const auto& binding : _bindings)
+        _channel.bindQueue(binding.exchange, binding.queue, binding.key, binding.arguments);
+    if (_prefetch > 0)
+        _channel.setQos(_prefetch);
+    for (const auto& consumer : _consumers)
+        consumer.setup(_channel.consume(consumer.queue, consumer.tag, consumer.flags));
+}
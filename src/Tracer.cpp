@@ -0,0 +1,200 @@
+#include "agent/Tracer.hpp"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+
+// One thread's events. Only its thread writes it; a reader checks afterwards
+// which slots were overwritten while it was reading and drops those
+struct agent::Tracer::Ring
+{
+    struct Slot
+    {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<char> phase{0};
+        std::atomic<std::uint64_t> id{0};
+        std::atomic<std::int64_t> at{0};
+        std::atomic<std::int64_t> duration{0};
+    };
+
+    Ring(std::size_t _capacity, std::uint32_t _tid)
+        : slots(std::make_unique<Slot[]>(_capacity)), capacity(_capacity), tid(_tid)
+    {}
+
+    std::unique_ptr<Slot[]> slots;
+    const std::size_t capacity;
+    const std::uint32_t tid;
+    std::atomic<std::uint64_t> written{0};
+};
+
+namespace
+{
+    // The ring a thread last recorded into, and the tracer it belongs to
+    struct ThreadRing
+    {
+        std::uint64_t owner = 0;
+        void *ring = nullptr;
+    };
+
+    thread_local ThreadRing threadRing;
+
+    std::atomic<std::uint64_t> serials{0};
+
+    struct Event
+    {
+        const char *name;
+        char phase;
+        std::uint64_t id;
+        std::int64_t at;
+        std::int64_t duration;
+        std::uint32_t tid;
+    };
+
+    // Chrome wants microseconds; nanoseconds are kept as fractions
+    std::string microseconds(std::int64_t _nanoseconds)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", _nanoseconds / 1000.0);
+        return text;
+    }
+}
+
+agent::Tracer::Tracer(std::size_t __capacity)
+    : _serial(++serials),
+      _capacity(__capacity > 0 ? __capacity : 1),
+      _epoch(Clock::now())
+{}
+
+agent::Tracer::~Tracer() = default;
+
+std::uint64_t agent::Tracer::NextId()
+{
+    return _ids.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void agent::Tracer::Span(const char *_name, std::uint64_t _id, Clock::time_point _begin, Clock::time_point _end)
+{
+    _record(_name, 'X', _id, _begin, _end - _begin);
+}
+
+void agent::Tracer::Begin(const char *_name, std::uint64_t _id, Clock::time_point _at)
+{
+    _record(_name, 'b', _id, _at, Clock::duration::zero());
+}
+
+void agent::Tracer::End(const char *_name, std::uint64_t _id, Clock::time_point _at)
+{
+    _record(_name, 'e', _id, _at, Clock::duration::zero());
+}
+
+std::string agent::Tracer::ChromeTrace() const
+{
+    std::vector<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(_rings_lock);
+        for (const auto &owned : _rings)
+        {
+            const Ring &ring = *owned.second;
+            const std::uint64_t end = ring.written.load(std::memory_order_acquire);
+            const std::uint64_t begin = end > ring.capacity ? end - ring.capacity : 0;
+
+            const std::size_t first = events.size();
+            for (std::uint64_t i = begin; i < end; ++i)
+            {
+                const Ring::Slot &slot = ring.slots[i % ring.capacity];
+                events.push_back(Event{
+                    slot.name.load(std::memory_order_relaxed),
+                    slot.phase.load(std::memory_order_relaxed),
+                    slot.id.load(std::memory_order_relaxed),
+                    slot.at.load(std::memory_order_relaxed),
+                    slot.duration.load(std::memory_order_relaxed),
+                    ring.tid});
+            }
+
+            // The slot being written now, and any after it, may be torn
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const std::uint64_t after = ring.written.load(std::memory_order_relaxed);
+            const std::uint64_t valid = after + 1 > ring.capacity ? after + 1 - ring.capacity : 0;
+            if (valid > begin)
+                events.erase(events.begin() + first, events.begin() + first + static_cast<std::ptrdiff_t>(std::min(valid, end) - begin));
+        }
+    }
+
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (std::size_t i = 0; i < events.size(); ++i)
+    {
+        const Event &event = events[i];
+        if (i > 0)
+            out += ',';
+        out += "{\"name\":\"";
+        out += event.name;
+        out += "\",\"ph\":\"";
+        out += event.phase;
+        out += "\",\"ts\":" + microseconds(event.at);
+        out += ",\"pid\":1,\"tid\":" + std::to_string(event.tid);
+
+        // Stages of a message are drawn on a track of its own, by its ID
+        if (event.phase == 'X')
+        {
+            out += ",\"dur\":" + microseconds(event.duration);
+            if (event.id != 0)
+                out += ",\"args\":{\"message\":" + std::to_string(event.id) + '}';
+        }
+        else
+        {
+            out += ",\"cat\":\"message\",\"id\":" + std::to_string(event.id);
+        }
+        out += '}';
+    }
+    out += "]}";
+    return out;
+}
+
+bool agent::Tracer::Dump(const std::string &_path) const
+{
+    const std::string trace = ChromeTrace();
+    std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+    file.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+    return static_cast<bool>(file);
+}
+
+agent::Tracer::Ring &agent::Tracer::_ring()
+{
+    if (threadRing.owner == _serial)
+        return *static_cast<Ring *>(threadRing.ring);
+
+    // First event of this thread, or it recorded for another tracer since
+    std::lock_guard<std::mutex> lock(_rings_lock);
+    auto &ring = _rings[std::this_thread::get_id()];
+    if (ring == nullptr)
+        ring = std::make_unique<Ring>(_capacity, static_cast<std::uint32_t>(_rings.size()));
+    threadRing.owner = _serial;
+    threadRing.ring = ring.get();
+    return *ring;
+}
+
+void agent::Tracer::_record(const char *_name, char _phase, std::uint64_t _id, Clock::time_point _at, Clock::duration _duration)
+{
+    Ring &ring = _ring();
+    const std::uint64_t i = ring.written.load(std::memory_order_relaxed);
+    Ring::Slot &slot = ring.slots[i % ring.capacity];
+
+    // A reader seeing any of the stores below also sees that slot i is in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(_name, std::memory_order_relaxed);
+    slot.phase.store(_phase, std::memory_order_relaxed);
+    slot.id.store(_id, std::memory_order_relaxed);
+    slot.at.store(std::chrono::duration_cast<std::chrono::nanoseconds>(_at - _epoch).count(), std::memory_order_relaxed);
+    slot.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(_duration).count(), std::memory_order_relaxed);
+    ring.written.store(i + 1, std::memory_order_release);
+}
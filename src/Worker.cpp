@@ -1,40 +1,57 @@
-#include "agent/Worker.hpp"
-#include "Message_generated.h"
-
-#include <iostream>
-#include <exception>
-#include <utility>
-#include <string>
-#include <sstream>
-
-#include <spdlog/spdlog.h>
-#include <spdlog/sinks/stdout_color_sinks.h>
-#include <flatbuffers/flatbuffers.h>
-
-agent::Worker::Worker(unsigned int _id)
-    : IWorker(_id)
-{
-}
-
-agent::Worker::Worker(unsigned int _id, std::string _name)
-    : IWorker(_id, _name)
-{
-}
-
-agent::Worker::~Worker()
-{
-    _logger->info("Worker {} finished", GetId());
-}
-
-int agent::Worker::ProcessMessage(const void* _msg, std::uint32_t _size, void* _result, std::uint32_t* _rsize)
-{
-    auto message = Messages::GetMessage(_msg);
-    int id = message->id();
-    int width = message->width();
-    int height = message->height();
-    auto pixels = message->pixels()->Data();
-
-    _logger->info("Received message: id: {} width: {} height: {}", id, width, height);
-
-    return id;
-}
+#include "agent/Worker.hpp"
+#include "agent/ImageMessage.hpp"
+#include "agent/Hash.hpp"
+#include "Message_generated.h"
+
+#include <iostream>
+#include <exception>
+#include <utility>
+#include <string>
+#include <sstream>
+#include <cstdio>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <flatbuffers/flatbuffers.h>
+
+agent::Worker::Worker(unsigned int _id)
+    : IWorker(_id)
+{
+}
+
+agent::Worker::Worker(unsigned int _id, std::string _name)
+    : IWorker(_id, _name)
+{
+}
+
+agent::Worker::~Worker()
+{
+    _logger->info("Worker {} finished", GetId());
+}
+
+int agent::Worker::ProcessMessage(const void* _msg, std::uint32_t _size, void* _result, std::uint32_t* _rsize)
+{
+    // Newer senders may leave pixels out in favour of the typed fields
+    ImageMessage message(Messages::GetMessage(_msg));
+    int id = message.Id();
+    int width = message.Width();
+    int height = message.Height();
+
+    _logger->info("Received message: id: {} width: {} height: {} channels: {} sample bytes: {}", id, width, height, message.Channels(), message.SampleBytes());
+
+    return id;
+}
+
+std::string agent::Worker::MessageKey(const void* _msg, std::uint32_t _size) const
+{
+    if (_size == 0)
+        return "";
+
+    // Two seeds make a 128-bit key, so distinct messages practically never collide
+    char key[48];
+    std::snprintf(key, sizeof(key), "%016llx%016llx:%u",
+        static_cast<unsigned long long>(Hash64(_msg, _size, 0)),
+        static_cast<unsigned long long>(Hash64(_msg, _size, 0x9e3779b97f4a7c15ULL)),
+        _size);
+    return key;
+}
@@ -1,9 +1,9 @@
-#include "agent/agent.hpp"
-
-namespace agent {
-
-int add_one(int x){
-  return x + 1;
-}
-
+#include "agent/agent.hpp"
+
+namespace agent {
+
+int add_one(int x){
+  return x + 1;
+}
+
 } // namespace agent
\ No newline at end of file
@@ -1 +1 @@
-#include <gtest/gtest.h>
+#include <gtest/gtest.h>